@@ -0,0 +1,352 @@
+#include "GameServerEmulator.h"
+#include <atomic>
+#include <chrono>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef int socklen_t;
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    const std::string kHeader("\xFF\xFF\xFF\xFF", 4);
+
+    // Player name with color codes, as real servers report them
+    std::string PlayerName(int slot) {
+        return "^" + std::to_string(slot % 10) + "Player ^7#" + std::to_string(slot);
+    }
+
+    // Splits "rcon <password> <command>" (password optionally quoted); returns false if it is malformed
+    bool SplitRcon(const std::string& body, std::string& password, std::string& command) {
+        size_t pos = 5;
+        if (pos < body.size() && body[pos] == '"') {
+            size_t end = body.find('"', pos + 1);
+            if (end == std::string::npos) {
+                return false;
+            }
+            password = body.substr(pos + 1, end - pos - 1);
+            pos = end + 1;
+        }
+        else {
+            size_t end = body.find(' ', pos);
+            password = body.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+            pos = end == std::string::npos ? body.size() : end;
+        }
+        while (pos < body.size() && body[pos] == ' ') ++pos;
+        command = body.substr(pos);
+        while (!command.empty() && (command.back() == '\n' || command.back() == ' ')) command.pop_back();
+        return true;
+    }
+}
+
+struct GameServerEmulator::Impl {
+    // A reply datagram waiting for its simulated latency to pass
+    struct Delayed {
+        Clock::time_point sendAt;
+        unsigned long long order;
+        std::string data;
+        sockaddr_in to;
+        bool operator>(const Delayed& other) const {
+            return sendAt != other.sendAt ? sendAt > other.sendAt : order > other.order;
+        }
+    };
+
+    explicit Impl(GameServerEmulatorConfig config) : config(std::move(config)), random(this->config.seed) {}
+
+    void Serve() {
+        char buffer[2048];
+        while (running) {
+            SendDue();
+            long waitUs = 50 * 1000;
+            if (!delayed.empty()) {
+                auto until = std::chrono::duration_cast<std::chrono::microseconds>(delayed.top().sendAt - Clock::now()).count();
+                waitUs = until < 0 ? 0 : (until < waitUs ? static_cast<long>(until) : waitUs);
+            }
+            fd_set readSet;
+            FD_ZERO(&readSet);
+            FD_SET(sock, &readSet);
+            timeval tv = { 0, waitUs };
+            if (select(static_cast<int>(sock) + 1, &readSet, nullptr, nullptr, &tv) <= 0) {
+                continue;
+            }
+            sockaddr_in from;
+            socklen_t fromLen = sizeof(from);
+            int bytesReceived = recvfrom(sock, buffer, sizeof(buffer) - 1, 0, (sockaddr*)&from, &fromLen);
+            if (bytesReceived <= 0) {
+                continue;
+            }
+            ++received;
+            Answer(std::string(buffer, bytesReceived), from);
+        }
+    }
+
+    // Builds the reply datagrams for one query and schedules them
+    void Answer(const std::string& packet, const sockaddr_in& from) {
+        if (packet.compare(0, kHeader.size(), kHeader) != 0) {
+            return;
+        }
+        // Medal of Honor prefixes queries with \x02 and replies with \x01
+        bool moh = packet.size() > 4 && packet[4] == '\x02';
+        int protocolId = moh ? 1 : 2;
+        std::string body = packet.substr(moh ? 5 : 4);
+        std::string prefix = moh ? kHeader + "\x01" : kHeader;
+
+        if (body.compare(0, 9, "getstatus") == 0) {
+            Schedule(WithCurrentMap(StatusReply(protocolId, config.players, config.firstPlayer, config.scoreOffset)), from);
+        }
+        else if (!moh && body.compare(0, 7, "getinfo") == 0) {
+            Schedule(WithCurrentMap(InfoReply(config.players)), from);
+        }
+        else if (body.compare(0, 5, "rcon ") == 0) {
+            std::string password, command;
+            if (!SplitRcon(body, password, command) || password != config.rconPassword) {
+                Schedule(prefix + "print\nBad rconpassword.\n", from);
+                return;
+            }
+            // Flood protection silently ignores commands that follow the previous one too closely
+            auto now = Clock::now();
+            if (config.rconFloodMs > 0 && lastRcon != Clock::time_point() && now < lastRcon + std::chrono::milliseconds(config.rconFloodMs)) {
+                ++floodIgnored;
+                return;
+            }
+            lastRcon = now;
+            if (command.compare(0, 4, "map ") == 0) {
+                nextMap = command.substr(4);
+                nextMapAt = now + std::chrono::milliseconds(config.mapLoadMs);
+            }
+            std::string text = command == "status" ? RconStatusText(protocolId, config.players, config.steamLayout, config.firstPlayer, config.scoreOffset) :
+                command.compare(0, 5, "echo ") == 0 ? command.substr(5) + "\n" : "";
+            // Long output is split over several print packets, like a real server
+            size_t offset = 0;
+            do {
+                Schedule(prefix + "print\n" + text.substr(offset, 1000), from);
+                offset += 1000;
+            } while (offset < text.size());
+        }
+    }
+
+    // Reports the map set by the latest rcon map once its load time has passed
+    std::string WithCurrentMap(std::string reply) {
+        if (!nextMap.empty() && Clock::now() >= nextMapAt) {
+            currentMap = std::move(nextMap);
+            nextMap.clear();
+        }
+        static const std::string generated = "\\mapname\\mp_harbor";
+        size_t pos = reply.find(generated);
+        if (pos != std::string::npos && currentMap != "mp_harbor") {
+            reply.replace(pos, generated.size(), "\\mapname\\" + currentMap);
+        }
+        return reply;
+    }
+
+    void Schedule(std::string data, const sockaddr_in& to) {
+        if (config.lossRate > 0 && std::uniform_real_distribution<double>(0.0, 1.0)(random) < config.lossRate) {
+            ++dropped;
+            return;
+        }
+        int delayMs = config.latencyMs;
+        if (config.jitterMs > 0) {
+            delayMs += std::uniform_int_distribution<int>(0, config.jitterMs)(random);
+        }
+        delayed.push({ Clock::now() + std::chrono::milliseconds(delayMs), order++, std::move(data), to });
+        SendDue();
+    }
+
+    void SendDue() {
+        auto now = Clock::now();
+        while (!delayed.empty() && delayed.top().sendAt <= now) {
+            const Delayed& next = delayed.top();
+            sendto(sock, next.data.c_str(), static_cast<int>(next.data.size()), 0, (const sockaddr*)&next.to, sizeof(next.to));
+            delayed.pop();
+        }
+    }
+
+    GameServerEmulatorConfig config;
+    std::mt19937 random;
+    SOCKET sock = INVALID_SOCKET;
+    int port = 0;
+    std::atomic<bool> running{ false };
+    std::atomic<unsigned long long> received{ 0 };
+    std::atomic<unsigned long long> dropped{ 0 };
+    std::atomic<unsigned long long> floodIgnored{ 0 };
+    Clock::time_point lastRcon;
+    std::string currentMap = "mp_harbor";
+    std::string nextMap;                // Map being loaded after an rcon map
+    Clock::time_point nextMapAt;
+    unsigned long long order = 0;
+    std::priority_queue<Delayed, std::vector<Delayed>, std::greater<Delayed>> delayed;
+    std::thread worker;
+};
+
+GameServerEmulator::GameServerEmulator(GameServerEmulatorConfig config) : impl(new Impl(std::move(config))) {}
+
+GameServerEmulator::~GameServerEmulator() {
+    Stop();
+}
+
+bool GameServerEmulator::Start(int port) {
+    if (impl->running) {
+        return false;
+    }
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        return false;
+    }
+#endif
+    impl->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<unsigned short>(port));
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    socklen_t addrLen = sizeof(addr);
+    if (impl->sock == INVALID_SOCKET ||
+        bind(impl->sock, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+        getsockname(impl->sock, (sockaddr*)&addr, &addrLen) != 0) {
+        if (impl->sock != INVALID_SOCKET) {
+            closesocket(impl->sock);
+            impl->sock = INVALID_SOCKET;
+        }
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return false;
+    }
+    impl->port = ntohs(addr.sin_port);
+    impl->running = true;
+    impl->worker = std::thread([this]() { impl->Serve(); });
+    return true;
+}
+
+void GameServerEmulator::Stop() {
+    if (!impl->running) {
+        return;
+    }
+    impl->running = false;
+    impl->worker.join();
+    closesocket(impl->sock);
+    impl->sock = INVALID_SOCKET;
+    impl->port = 0;
+    impl->delayed = {};
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+int GameServerEmulator::Port() const {
+    return impl->port;
+}
+
+unsigned long long GameServerEmulator::Received() const {
+    return impl->received;
+}
+
+unsigned long long GameServerEmulator::FloodIgnored() const {
+    return impl->floodIgnored;
+}
+
+unsigned long long GameServerEmulator::Dropped() const {
+    return impl->dropped;
+}
+
+// getstatus reply modelled on a busy server: ~40 cvars and the given number of players
+std::string GameServerEmulator::StatusReply(int protocolId, int players, int firstPlayer, int scoreOffset) {
+    std::string packet = protocolId == 1 ? kHeader + "\x01statusResponse\n" : kHeader + "statusResponse\n";
+    const char* cvars[][2] = {
+        { "sv_hostname", "^1Emulated ^7Server | Fast Downloads" }, { "mapname", "mp_harbor" }, { "g_gametype", "tdm" },
+        { "sv_maxclients", "64" }, { "sv_privateClients", "2" }, { "sv_maxRate", "25000" }, { "sv_maxPing", "250" },
+        { "sv_minPing", "0" }, { "sv_floodProtect", "1" }, { "sv_allowAnonymous", "0" }, { "sv_pure", "1" },
+        { "sv_punkbuster", "1" }, { "g_antilag", "1" }, { "g_allowvote", "1" }, { "g_friendlyfire", "0" },
+        { "scr_friendlyfire", "0" }, { "scr_killcam", "1" }, { "scr_teambalance", "1" }, { "scr_drawfriend", "1" },
+        { "scr_forcerespawn", "0" }, { "scr_tdm_scorelimit", "300" }, { "scr_tdm_timelimit", "30" },
+        { "shortversion", "1.1" }, { "version", "Call of Duty MP 1.1 build win-x86 Oct 21 2003" },
+        { "protocol", "6" }, { "fs_game", "main" }, { "gamename", "Call of Duty" }, { "g_timeoutsallowed", "0" },
+        { "sv_disableClientConsole", "0" }, { "sv_fps", "20" }, { "sv_cheats", "0" }, { "sv_allowDownload", "1" },
+        { "sv_wwwDownload", "1" }, { "sv_wwwBaseURL", "http://dl.example.org/cod" }, { "g_needpass", "0" },
+        { "sv_voice", "0" }, { "ui_maxclients", "64" }, { "_Admin", "Emulator" }, { "_Website", "www.example.org" },
+        { "_Location", "Europe" },
+    };
+    for (const auto& cvar : cvars) {
+        packet += std::string("\\") + cvar[0] + "\\" + cvar[1];
+    }
+    packet += "\n";
+    for (int i = 0; i < players; ++i) {
+        if (protocolId == 1) {
+            packet += std::to_string(i) + " \"" + PlayerName(firstPlayer + i) + "\"\n";
+        }
+        else {
+            packet += std::to_string((i * 37) % 150 - 5 + scoreOffset) + " " + std::to_string(30 + (i * 11) % 120) + " \"" + PlayerName(firstPlayer + i) + "\"\n";
+        }
+    }
+    return packet;
+}
+
+// getinfo reply (Call of Duty only)
+std::string GameServerEmulator::InfoReply(int players) {
+    return kHeader + "infoResponse\n\\protocol\\6\\hostname\\^1Emulated ^7Server\\mapname\\mp_harbor\\clients\\" +
+        std::to_string(players) + "\\sv_maxclients\\64\\gametype\\tdm\\pure\\1\\kc\\1";
+}
+
+// Console text of rcon status, without the print header
+std::string GameServerEmulator::RconStatusText(int protocolId, int players, bool steamLayout, int firstPlayer, int scoreOffset) {
+    std::string text;
+    char line[256];
+    if (protocolId == 1) {
+        text = "map: dm/mohdm6\n"
+            "num score ping name            lastmsg address               qport rate\n"
+            "--- ----- ---- --------------- ------- --------------------- ----- -----\n";
+    }
+    else if (steamLayout) {
+        text = "hostname: ^1Emulated ^7Server\n"
+            "version : 1.8.0 build 1\n"
+            "udp/ip  : 127.0.0.1:28960\n"
+            "os      : Linux\n"
+            "type    : dedicated\n"
+            "map     : mp_harbor\n"
+            "num score ping playerid steamid           name            lastmsg address               qport rate\n"
+            "--- ----- ---- -------- ----------------- --------------- ------- --------------------- ----- -----\n";
+    }
+    else {
+        text = "map: mp_harbor\n"
+            "num score ping guid       name            lastmsg address               qport rate\n"
+            "--- ----- ---- ---------- --------------- ------- --------------------- ----- -----\n";
+    }
+    for (int i = 0; i < players; ++i) {
+        int n = firstPlayer + i;
+        std::string name = PlayerName(n);
+        std::string address = "10." + std::to_string(n / 62500) + "." + std::to_string(n / 250 % 250) + "." + std::to_string(n % 250 + 1) + ":28960";
+        int score = (i * 37) % 150 + scoreOffset;
+        int ping = 30 + (i * 11) % 120;
+        if (protocolId == 1) {
+            snprintf(line, sizeof(line), "%3d %5d %4d %-15s %7d %-21s %5d %5d\n", i, score, ping, name.c_str(), i % 50, address.c_str(), 1000 + i, 25000);
+        }
+        else if (steamLayout) {
+            snprintf(line, sizeof(line), "%3d %5d %4d %8d %17llu %s^7 %7d %-21s %5d %5d\n", i, score, ping, 100 + i,
+                76561197960265728ULL + static_cast<unsigned long long>(n) * 7919, name.c_str(), i % 50, address.c_str(), 1000 + i, 25000);
+        }
+        else {
+            snprintf(line, sizeof(line), "%3d %5d %4d %10d %s^7 %7d %-21s %5d %5d\n", i, score, ping, 100000 + n * 7919, name.c_str(), i % 50,
+                address.c_str(), 1000 + i, 25000);
+        }
+        text += line;
+    }
+    return text;
+}
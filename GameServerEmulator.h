@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <memory>
+
+// Behaviour of an emulated game server
+struct GameServerEmulatorConfig {
+    int players = 16;                   // Players listed in getstatus, getinfo and rcon status replies
+    int firstPlayer = 0;                // Number of the first player's name, guid, steamid and address, so emulators can list different players
+    int scoreOffset = 0;                // Added to every player's score, so a restarted emulator can report score changes
+    bool steamLayout = false;           // Use the Steam rcon status layout (hostname block, playerid/steamid columns)
+    int latencyMs = 0;                  // Delay added before every reply datagram
+    int jitterMs = 0;                   // Random extra delay of up to this many milliseconds per datagram
+    double lossRate = 0.0;              // Probability (0 to 1) that a reply datagram is dropped
+    std::string rconPassword = "secret";// Password accepted by rcon commands
+    int mapLoadMs = 0;                  // Delay before getstatus/getinfo report the map set by rcon map
+    int rconFloodMs = 0;                // rcon commands arriving sooner than this after the previous one are ignored (sv_floodprotect)
+    unsigned seed = 1;                  // Seed for jitter and loss, so runs are repeatable
+};
+
+// Loopback UDP server that answers Medal of Honor (\x02getstatus, \x02rcon) and Call of Duty (getinfo,
+// getstatus, rcon) queries with generated replies, for tests and benchmarks that must run without real
+// servers. rcon status lists the players, rcon echo prints its argument back
+// and rcon map changes the reported mapname.
+class GameServerEmulator {
+public:
+    explicit GameServerEmulator(GameServerEmulatorConfig config = GameServerEmulatorConfig());
+    ~GameServerEmulator();
+    GameServerEmulator(const GameServerEmulator&) = delete;
+    GameServerEmulator& operator=(const GameServerEmulator&) = delete;
+
+    // Binds to 127.0.0.1 (port 0 picks a free port) and starts answering on a background thread
+    bool Start(int port = 0);
+    void Stop();
+
+    int Port() const;                   // Bound port, or 0 if not started
+    unsigned long long Received() const;// Queries received
+    unsigned long long Dropped() const; // Reply datagrams dropped by the loss setting
+    unsigned long long FloodIgnored() const; // rcon commands ignored by the flood protection setting
+
+    // Reply packets as the emulator sends them, also used to benchmark the parsers without any I/O
+    static std::string StatusReply(int protocolId, int players, int firstPlayer = 0, int scoreOffset = 0);
+    static std::string InfoReply(int players);
+    static std::string RconStatusText(int protocolId, int players, bool steamLayout, int firstPlayer = 0, int scoreOffset = 0);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
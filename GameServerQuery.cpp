@@ -1,673 +1,5777 @@
 #include "GameServerQuery.h"
 #include <chrono>
 #include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
 #include <sstream>
 #include <vector>
+#include <deque>
 #include <algorithm>
-#include <windows.h>
+#include <atomic>
+#include <functional>
+#include <set>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <random>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <cctype>
+#include <charconv>
+#include <string_view>
+#include <memory_resource>
+#include <optional>
+#include <filesystem>
+#include <cstdio>
 
+#ifdef _WIN32
+#include <windows.h>
 #pragma comment(lib, "Ws2_32.lib")
+typedef int socklen_t;
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+// BSD sockets under the Winsock names used throughout this file
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define closesocket close
+#define WSAGetLastError() errno
+#define WSAEWOULDBLOCK EWOULDBLOCK
+#define WSAECONNRESET ECONNREFUSED
+#define WSAETIMEDOUT ETIMEDOUT
+#define WSAEMSGSIZE EMSGSIZE
+#endif
+
+#if defined(__linux__)
+#define GSQ_HAVE_MMSG 1     // sendmmsg/recvmmsg move a whole batch of datagrams per system call
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define GSQ_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define GSQ_TARGET(isa)
+#else
+#include <immintrin.h>
+#define GSQ_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
 
 namespace {
-    // DNS cache entry structure with 5-minute TTL
-    struct DnsCacheEntry {
-        std::string ip;
-        std::chrono::steady_clock::time_point timestamp;
-    };
-    std::map<std::string, DnsCacheEntry> dnsCache;
-    std::mutex dnsMutex;
+    using Clock = std::chrono::steady_clock;
 
-    // Registry for protocol handlers
-    std::map<int, std::unique_ptr<ProtocolHandler>> protocolRegistry;
+    // Query phases timed by the built-in metrics
+    enum MetricPhase { PHASE_RESOLVE, PHASE_NETWORK, PHASE_PARSE, PHASE_JSON, PHASE_TOTAL, PHASE_COUNT };
+    const char* const kPhaseNames[PHASE_COUNT] = { "resolve", "network", "parse", "json", "total" };
 
-    // Sanitizes command by removing semicolons and newlines
-    std::string SanitizeCommand(const std::string& command) {
-        std::string sanitized = command;
-        sanitized.erase(std::remove_if(sanitized.begin(), sanitized.end(),
-            [](char c) { return c == ';' || c == '\n' || c == '\r'; }), sanitized.end());
-        return sanitized;
-    }
+    // Lock-free latency histogram; bucket i counts samples of at most 2^i microseconds and the last bucket the rest
+    struct LatencyHistogram {
+        static constexpr int kBuckets = 26;     // 1 us .. 2^24 us (~17 s), then +Inf
+        std::atomic<uint64_t> buckets[kBuckets] = {};
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<uint64_t> sumNanos{ 0 };
 
-    // Escapes special characters in a string for JSON output
-    std::string EscapeJson(const std::string& input) {
-        std::string result;
-        for (char c : input) {
-            if (c == '"') result += "\\\"";
-            else if (c == '\\') result += "\\\\";
-            else if (c == '\n') result += "\\n";
-            else if (c == '\r') continue;
-            else result += c;
+        void Record(Clock::duration elapsed) {
+            uint64_t nanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+            uint64_t micros = (nanos + 999) / 1000;
+            int bucket = 0;
+            while (bucket < kBuckets - 1 && (uint64_t(1) << bucket) < micros) {
+                ++bucket;
+            }
+            buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+            count.fetch_add(1, std::memory_order_relaxed);
+            sumNanos.fetch_add(nanos, std::memory_order_relaxed);
         }
-        return result;
-    }
 
-    // Parses key-value pairs from server response
-    std::map<std::string, std::string> ParseKeyValues(const std::string& response) {
-        std::map<std::string, std::string> result;
-        std::string key;
-        size_t pos = 0;
+        void Reset() {
+            for (auto& bucket : buckets) bucket = 0;
+            count = 0;
+            sumNanos = 0;
+        }
+    };
 
-        while (pos < response.size() && response[pos] == '\n') {
-            ++pos;
+    // Always-on counters and per-phase, per-protocol latency histograms
+    class QueryMetrics {
+    public:
+        static constexpr int kProtocolSlots = 8;    // Slot 0 collects protocol IDs outside 1..7
+
+        std::atomic<uint64_t> queries{ 0 };         // Queries sent to a server
+        std::atomic<uint64_t> retransmits{ 0 };     // Extra copies of queries whose reply seemed lost
+        std::atomic<uint64_t> timeouts{ 0 };        // Queries that received no reply before their deadline
+        std::atomic<uint64_t> sendErrors{ 0 };
+        std::atomic<uint64_t> receiveErrors{ 0 };
+        std::atomic<uint64_t> sendCalls{ 0 };       // System calls that sent query packets; a batched call counts once
+        std::atomic<uint64_t> receiveCalls{ 0 };    // System calls that read replies, including ones that found none
+        std::atomic<uint64_t> scanSteals{ 0 };      // Target ranges a ScanGameServerList worker took from another worker
+        std::atomic<uint64_t> poolReused{ 0 };      // Returned strings served from the response pool
+        std::atomic<uint64_t> poolAllocated{ 0 };   // Returned strings that needed a new heap block
+        std::atomic<uint64_t> arenaSpills{ 0 };     // Heap blocks taken by parse arenas that outgrew their thread's buffer
+        std::atomic<uint64_t> bytesOut{ 0 };
+        std::atomic<uint64_t> bytesIn{ 0 };
+        std::atomic<uint64_t> dnsHits{ 0 };
+        std::atomic<uint64_t> dnsMisses{ 0 };
+
+        void Record(int protocolId, MetricPhase phase, Clock::duration elapsed) {
+            Histogram(protocolId, phase).Record(elapsed);
         }
 
-        while (pos < response.size()) {
-            if (response[pos] != '\\') {
-                break;
-            }
-            ++pos;
-            size_t next = response.find('\\', pos);
-            if (next == std::string::npos) {
-                break;
-            }
-            key = response.substr(pos, next - pos);
-            pos = next + 1;
-            next = response.find('\\', pos);
-            if (next == std::string::npos) {
-                next = response.find('\n', pos);
-                if (next == std::string::npos) {
-                    next = response.size();
-                }
+        LatencyHistogram& Histogram(int protocolId, MetricPhase phase) {
+            return histograms[protocolId > 0 && protocolId < kProtocolSlots ? protocolId : 0][phase];
+        }
+
+        void Reset() {
+            for (auto* counter : { &queries, &retransmits, &timeouts, &sendErrors, &receiveErrors, &sendCalls, &receiveCalls, &scanSteals, &poolReused, &poolAllocated, &arenaSpills, &bytesOut, &bytesIn, &dnsHits, &dnsMisses }) {
+                *counter = 0;
             }
-            if (!key.empty()) {
-                result[key] = response.substr(pos, next - pos);
+            for (auto& protocol : histograms) {
+                for (auto& histogram : protocol) histogram.Reset();
             }
-            pos = next;
         }
-        return result;
-    }
 
-    // Parses player data from getstatus response
-    std::vector<std::map<std::string, std::string>> ParseGetStatusPlayers(const std::string& response, int protocolId) {
-        std::vector<std::map<std::string, std::string>> players;
-        std::stringstream ss(response);
-        std::string line;
-        bool inKeyValues = true;
+    private:
+        LatencyHistogram histograms[kProtocolSlots][PHASE_COUNT];
+    } metrics;
 
-        while (std::getline(ss, line)) {
-            if (line.empty()) {
-                inKeyValues = false;
-                continue;
-            }
-            if (inKeyValues && line[0] == '\\') {
-                continue;
-            }
-            inKeyValues = false;
-            // Trim whitespace
-            line.erase(line.begin(), std::find_if(line.begin(), line.end(), [](char c) { return !std::isspace(c); }));
-            line.erase(std::find_if(line.rbegin(), line.rend(), [](char c) { return !std::isspace(c); }).base(), line.end());
-            if (line.empty()) {
-                continue;
-            }
-            std::stringstream playerStream(line);
-            std::vector<std::string> tokens;
-            std::string token;
-            bool inQuotes = false;
-            for (char c : line) {
-                if (c == '"') {
-                    inQuotes = !inQuotes;
-                    token += c;
-                    continue;
-                }
-                if (c == ' ' && !inQuotes && !token.empty()) {
-                    tokens.push_back(token);
-                    token.clear();
-                    continue;
-                }
-                token += c;
-            }
-            if (!token.empty()) {
-                tokens.push_back(token);
-            }
-            if (protocolId == 1 && tokens.size() >= 2) { // Medal of Honor: slot "name"
-                std::map<std::string, std::string> player;
-                player["slot"] = tokens[0];
-                std::string name = tokens[1];
-                if (name.size() >= 2 && name[0] == '"' && name.back() == '"') {
-                    player["name"] = name.substr(1, name.size() - 2);
-                    player["score"] = "0";
-                    player["ping"] = "0";
-                    if (std::all_of(player["slot"].begin(), player["slot"].end(), ::isdigit)) {
-                        players.push_back(player);
-                    }
-                }
+    // Records the time from construction to destruction as one phase sample
+    class PhaseTimer {
+    public:
+        PhaseTimer(int protocolId, MetricPhase phase) : protocolId(protocolId), phase(phase), start(Clock::now()) {}
+        ~PhaseTimer() { metrics.Record(protocolId, phase, Clock::now() - start); }
+        PhaseTimer(const PhaseTimer&) = delete;
+        PhaseTimer& operator=(const PhaseTimer&) = delete;
+    private:
+        int protocolId;
+        MetricPhase phase;
+        Clock::time_point start;
+    };
+
+    // Time this thread has spent building JSON since the last TimedParse began
+    thread_local Clock::duration jsonTime{};
+
+    // Adds the lifetime of a JSON builder call to jsonTime
+    class JsonTimer {
+    public:
+        JsonTimer() : start(Clock::now()) {}
+        ~JsonTimer() { jsonTime += Clock::now() - start; }
+    private:
+        Clock::time_point start;
+    };
+
+    // Heap used by parse arenas once a parse outgrows its thread's buffer; every block it hands out is counted
+    class SpillResource : public std::pmr::memory_resource {
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override {
+            ++metrics.arenaSpills;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+        }
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    } spillResource;
+
+    // Scratch memory for the intermediates of one parse: the structural index, setting and player slices, and
+    // rcon status lines. The outermost arena on a thread bump-allocates from a 64 KB buffer the thread keeps
+    // for its lifetime, and rewinds it on close, so repeated parses allocate nothing. Nested arenas share the
+    // outer one. Containers built while no arena is open use the normal heap.
+    class ParseArena {
+    public:
+        ParseArena() {
+            if (!active) {
+                resource.emplace(Buffer(), kBufferSize, &spillResource);
+                active = &*resource;
             }
-            else if (protocolId == 2 && tokens.size() >= 3) { // Call of Duty: score ping "name"
-                std::map<std::string, std::string> player;
-                player["score"] = tokens[0];
-                player["ping"] = tokens[1];
-                std::string name = tokens[2];
-                if (name.size() >= 2 && name[0] == '"' && name.back() == '"') {
-                    player["name"] = name.substr(1, name.size() - 2);
-                    player["slot"] = "0";
-                    if ((player["score"].empty() || std::all_of(player["score"].begin(), player["score"].end(), ::isdigit) ||
-                        (player["score"].size() > 1 && player["score"][0] == '-' &&
-                            std::all_of(player["score"].begin() + 1, player["score"].end(), ::isdigit))) &&
-                        (player["ping"].empty() || std::all_of(player["ping"].begin(), player["ping"].end(), ::isdigit))) {
-                        players.push_back(player);
-                    }
-                }
+        }
+        ~ParseArena() {
+            if (resource) {
+                active = nullptr;
             }
         }
-        return players;
-    }
+        ParseArena(const ParseArena&) = delete;
+        ParseArena& operator=(const ParseArena&) = delete;
 
-    // Parses player data from rcon status response
-    std::vector<std::map<std::string, std::string>> ParseRconStatusPlayers(const std::string& response, int protocolId) {
-        std::vector<std::map<std::string, std::string>> players;
-        std::stringstream ss(response);
-        std::string line;
-        bool isSteam = false;
+        // Memory for a parse container: the open arena, or the heap outside one
+        static std::pmr::memory_resource* Current() {
+            return active ? active : std::pmr::get_default_resource();
+        }
 
-        // Determine if server is Steam-based by checking for hostname or map
-        while (std::getline(ss, line)) {
-            line.erase(line.begin(), std::find_if(line.begin(), line.end(), [](char c) { return !std::isspace(c); }));
-            line.erase(std::find_if(line.rbegin(), line.rend(), [](char c) { return !std::isspace(c); }).base(), line.end());
-            if (line.empty()) {
-                continue;
-            }
-            std::string lowerLine = line;
-            std::transform(lowerLine.begin(), lowerLine.end(), lowerLine.begin(), ::tolower);
-            if (lowerLine.find("hostname:") == 0) {
-                isSteam = true;
-                break;
-            }
-            else if (lowerLine.find("map:") == 0) {
-                isSteam = false;
-                break;
-            }
-            else if (lowerLine.find("num score ping playerid steamid name") != std::string::npos) {
-                isSteam = true;
-                break;
-            }
-            else if (lowerLine.find("num score ping guid name") != std::string::npos) {
-                isSteam = false;
-                break;
-            }
+    private:
+        static constexpr size_t kBufferSize = 64 * 1024;
+
+        static void* Buffer() {
+            thread_local std::unique_ptr<std::max_align_t[]> buffer(new std::max_align_t[kBufferSize / sizeof(std::max_align_t)]);
+            return buffer.get();
         }
-        ss.clear();
-        ss.seekg(0, std::ios::beg);
 
-        while (std::getline(ss, line)) {
-            // Trim whitespace
-            line.erase(line.begin(), std::find_if(line.begin(), line.end(), [](char c) { return !std::isspace(c); }));
-            line.erase(std::find_if(line.rbegin(), line.rend(), [](char c) { return !std::isspace(c); }).base(), line.end());
-            if (line.empty()) {
-                continue;
-            }
-            // Skip headers
-            if (line.find("map:") != std::string::npos ||
-                line.find("num score ping") != std::string::npos ||
-                line.find("----") != std::string::npos ||
-                line.find("hostname:") != std::string::npos ||
-                line.find("version :") != std::string::npos ||
-                line.find("udp/ip  :") != std::string::npos ||
-                line.find("os      :") != std::string::npos ||
-                line.find("type    :") != std::string::npos) {
-                continue;
-            }
-            // Tokenize space-separated fields
-            std::vector<std::string> tokens;
-            std::string token;
-            size_t i = 0;
-            int fieldCount = 0;
-            int nameField = (protocolId == 1) ? 3 : (isSteam ? 5 : 4);
-            bool inName = false;
+        static inline thread_local std::pmr::memory_resource* active = nullptr;
+        std::optional<std::pmr::monotonic_buffer_resource> resource;
+    };
 
-            while (i < line.size()) {
-                // Handle name field
-                if (fieldCount == nameField) {
-                    inName = true;
-                    size_t nextField = i;
-                    bool foundLastmsg = false;
-                    size_t lastCaret7 = std::string::npos;
-                    // Find last ^7 before numeric lastmsg
-                    while (nextField < line.size() && !foundLastmsg) {
-                        size_t numStart = nextField;
-                        while (numStart < line.size() && line[numStart] == ' ') numStart++;
-                        size_t numEnd = numStart;
-                        while (numEnd < line.size() && line[numEnd] != ' ') numEnd++;
-                        std::string maybeNumber = line.substr(numStart, numEnd - numStart);
-                        if (!maybeNumber.empty() && std::all_of(maybeNumber.begin(), maybeNumber.end(), ::isdigit)) {
-                            foundLastmsg = true;
-                            break;
-                        }
-                        if (protocolId == 2 && numStart >= 2 && line[numStart - 2] == '^' && line[numStart - 1] == '7') {
-                            lastCaret7 = numStart - 2;
-                        }
-                        nextField = numEnd + 1;
-                    }
-                    if (protocolId == 2 && lastCaret7 != std::string::npos && lastCaret7 >= i) {
-                        nextField = lastCaret7 + 2;
-                        while (nextField < line.size() && line[nextField] == ' ') nextField++;
-                    }
-                    token = line.substr(i, nextField - i);
-                    while (!token.empty() && token.back() == ' ') token.pop_back();
-                    if (token.empty()) token = "";
-                    tokens.push_back(token);
-                    token.clear();
-                    fieldCount++;
-                    i = nextField;
-                    inName = false;
-                    while (i < line.size() && line[i] == ' ') i++;
-                    continue;
-                }
-                // Handle other fields
-                if (line[i] == ' ' && !token.empty() && !inName) {
-                    tokens.push_back(token);
-                    token.clear();
-                    fieldCount++;
-                    i++;
-                    while (i < line.size() && line[i] == ' ') i++;
-                    continue;
-                }
-                // Capture last field
-                if ((protocolId == 1 && fieldCount == 7) || (protocolId == 2 && fieldCount == (isSteam ? 9 : 8))) {
-                    token = line.substr(i);
-                    while (!token.empty() && token.back() == ' ') token.pop_back();
-                    if (!token.empty()) {
-                        tokens.push_back(token);
-                    }
-                    break;
-                }
-                token += line[i];
-                i++;
-            }
-            if (!token.empty()) {
-                tokens.push_back(token);
-            }
-            // Process tokens based on protocol
-            if (protocolId == 1 && tokens.size() >= 8) { // Medal of Honor
-                std::map<std::string, std::string> player;
-                player["slot"] = tokens[0];
-                player["score"] = tokens[1];
-                player["ping"] = tokens[2];
-                player["name"] = tokens[3];
-                player["lastmsg"] = tokens[4];
-                player["address"] = tokens[5];
-                player["qport"] = tokens[6];
-                player["rate"] = tokens[7];
-                if (std::all_of(player["slot"].begin(), player["slot"].end(), ::isdigit) &&
-                    (player["score"].empty() || std::all_of(player["score"].begin(), player["score"].end(), ::isdigit) ||
-                        (player["score"].size() > 1 && player["score"][0] == '-' &&
-                            std::all_of(player["score"].begin() + 1, player["score"].end(), ::isdigit))) &&
-                    (player["ping"].empty() || std::all_of(player["ping"].begin(), player["ping"].end(), ::isdigit))) {
-                    players.push_back(player);
-                }
-            }
-            else if (protocolId == 2 && tokens.size() >= (isSteam ? 10 : 9)) { // Call of Duty
-                std::map<std::string, std::string> player;
-                player["slot"] = tokens[0];
-                player["score"] = tokens[1];
-                player["ping"] = tokens[2];
-                if (isSteam) { // Steam
-                    player["playerid"] = tokens[3];
-                    player["steamid"] = tokens[4];
-                    player["name"] = tokens[5];
-                    player["lastmsg"] = tokens[6];
-                    player["address"] = tokens[7];
-                    player["qport"] = tokens[8];
-                    player["rate"] = tokens[9];
-                }
-                else { // Non-Steam
-                    player["guid"] = tokens[3];
-                    player["name"] = tokens[4];
-                    player["lastmsg"] = tokens[5];
-                    player["address"] = tokens[6];
-                    player["qport"] = tokens[7];
-                    player["rate"] = tokens[8];
-                }
-                if (std::all_of(player["slot"].begin(), player["slot"].end(), ::isdigit) &&
-                    (player["score"].empty() || std::all_of(player["score"].begin(), player["score"].end(), ::isdigit) ||
-                        (player["score"].size() > 1 && player["score"][0] == '-' &&
-                            std::all_of(player["score"].begin() + 1, player["score"].end(), ::isdigit))) &&
-                    (player["ping"].empty() || std::all_of(player["ping"].begin(), player["ping"].end(), ::isdigit))) {
-                    players.push_back(player);
-                }
-            }
+    // Strings kept on each thread for their capacity. Received packets and finished results are handed back
+    // once their contents have been copied out, and the next packet or JSON output is built in one of them.
+    constexpr size_t kMaxSpareStrings = 4;
+    constexpr size_t kMaxSpareCapacity = 256 * 1024;
+
+    std::vector<std::string>& SpareStrings() {
+        thread_local std::vector<std::string> spare = [] {
+            std::vector<std::string> list;
+            list.reserve(kMaxSpareStrings);
+            return list;
+        }();
+        return spare;
+    }
+
+    // An empty string, with the capacity of a spare one when the thread has any
+    std::string TakeSpareString() {
+        auto& spare = SpareStrings();
+        if (spare.empty()) {
+            return std::string();
         }
-        return players;
+        std::string text = std::move(spare.back());
+        spare.pop_back();
+        text.clear();
+        return text;
     }
 
-    // Converts key-value pairs and player data to JSON format
-    std::string ToJson(const std::map<std::string, std::string>& kv, const std::vector<std::map<std::string, std::string>>& players) {
-        std::string result = "{";
-        result += "\"server\":{";
-        bool first = true;
-        for (const auto& pair : kv) {
-            if (!first) result += ",";
-            result += "\"" + EscapeJson(pair.first) + "\":\"" + EscapeJson(pair.second) + "\"";
-            first = false;
+    void KeepSpareString(std::string&& text) {
+        auto& spare = SpareStrings();
+        if (spare.size() < kMaxSpareStrings && text.capacity() <= kMaxSpareCapacity) {
+            spare.push_back(std::move(text));
         }
-        result += "},\"players\":[";
-        first = true;
-        for (const auto& player : players) {
-            if (!first) result += ",";
-            result += "{";
-            result += "\"slot\":\"" + EscapeJson(player.at("slot")) + "\",";
-            result += "\"score\":\"" + EscapeJson(player.at("score")) + "\",";
-            result += "\"ping\":\"" + EscapeJson(player.at("ping")) + "\",";
-            result += "\"name\":\"" + EscapeJson(player.at("name")) + "\"";
-            if (player.count("lastmsg")) result += ",\"lastmsg\":\"" + EscapeJson(player.at("lastmsg")) + "\"";
-            if (player.count("address")) result += ",\"address\":\"" + EscapeJson(player.at("address")) + "\"";
-            if (player.count("qport")) result += ",\"qport\":\"" + EscapeJson(player.at("qport")) + "\"";
-            if (player.count("rate")) result += ",\"rate\":\"" + EscapeJson(player.at("rate")) + "\"";
-            if (player.count("guid")) result += ",\"guid\":\"" + EscapeJson(player.at("guid")) + "\"";
-            if (player.count("playerid")) result += ",\"playerid\":\"" + EscapeJson(player.at("playerid")) + "\"";
-            if (player.count("steamid")) result += ",\"steamid\":\"" + EscapeJson(player.at("steamid")) + "\"";
-            result += "}";
-            first = false;
-        }
-        result += "]}";
-        return result;
     }
 
-    // Handler for Medal of Honor server commands
-    class MedalOfHonorHandler : public ProtocolHandler {
+    // Size-classed pool for the strings handed to callers. Each block starts with a header naming its class,
+    // so FreeGameServerResponse can put it on the freeing thread's cache. A full cache passes half its blocks
+    // to a shared depot, and an empty one refills from there before falling back to malloc. Strings over the
+    // largest class are malloc'd and freed directly.
+    class ResponsePool {
     public:
-        std::string ProcessCommand(bool raw, const std::string& ip, int port, const std::string& command, const std::string& rconPassword) override {
-            std::string query;
-            std::string cmd = SanitizeCommand(command);
-            if (cmd == "getstatus") {
-                query = "\xFF\xFF\xFF\xFF\x02getstatus";
+        ResponsePool() {
+            for (auto& depot : depots) depot.blocks.reserve(kDepotPerClass);
+        }
+
+        ~ResponsePool() {
+            for (auto& depot : depots) {
+                for (char* block : depot.blocks) free(block);
             }
-            else if (cmd.find("rcon ") == 0) {
-                query = "\xFF\xFF\xFF\xFF\x02rcon \"" + rconPassword + "\" " + cmd.substr(5);
+        }
+
+        // Copies text into a pooled, NUL-terminated buffer; null if memory ran out
+        const char* Copy(std::string_view text) {
+            size_t sizeClass = ClassFor(text.size() + 1);
+            char* block = sizeClass < kClasses ? Take(sizeClass) : nullptr;
+            if (block) {
+                ++metrics.poolReused;
             }
             else {
-                return "error=Invalid command";
-            }
-
-            std::string response = SendUDPQuery(ip, port, query, cmd.find("rcon map ") == 0 ? 2000 : 1000);
-            if (cmd.find("rcon map ") == 0) {
-                std::string map = cmd.substr(9);
-                return "{\"status\":\"success\",\"message\":\"Map changed to " + EscapeJson(map) + "\"}";
+                block = static_cast<char*>(malloc(kHeaderSize + (sizeClass < kClasses ? ClassSize(sizeClass) : text.size() + 1)));
+                if (!block) {
+                    return nullptr;
+                }
+                ++metrics.poolAllocated;
+                *reinterpret_cast<size_t*>(block) = sizeClass;
             }
-            if (response.find("error=") == 0 || response.empty()) {
-                return response.empty() ? "error=Empty response from server" : response;
+            char* data = block + kHeaderSize;
+            if (!text.empty()) {
+                memcpy(data, text.data(), text.size());
             }
+            data[text.size()] = '\0';
+            return data;
+        }
 
-            if (cmd == "getstatus") {
-                size_t pos = response.find("statusResponse");
-                if (pos == std::string::npos) {
-                    return "error=Invalid server response;raw=" + response;
-                }
-                response = response.substr(pos + 14);
-                if (response.empty()) {
-                    return "error=Empty response after header removal;raw=" + response;
-                }
-                if (raw) {
-                    return response;
-                }
-                auto kv = ParseKeyValues(response);
-                auto players = ParseGetStatusPlayers(response, 1);
-                return ToJson(kv, players);
+        void Release(const char* text) {
+            if (!text) {
+                return;
             }
-            else if (cmd.find("rcon ") == 0) {
-                size_t pos = response.find("print");
-                if (pos == std::string::npos) {
-                    return "error=Invalid server response;raw=" + response;
-                }
-                response = response.substr(pos + 5);
-                if (response.empty()) {
-                    return "error=Empty response after header removal;raw=" + response;
-                }
-                if (cmd == "rcon status") {
-                    if (raw) {
-                        return response;
+            char* block = const_cast<char*>(text) - kHeaderSize;
+            size_t sizeClass = *reinterpret_cast<size_t*>(block);
+            if (sizeClass >= kClasses) {
+                free(block);
+                return;
+            }
+            std::vector<char*>& cached = Cache().blocks[sizeClass];
+            if (cached.size() == kCachedPerClass) {
+                Depot& depot = depots[sizeClass];
+                std::lock_guard<std::mutex> lock(depot.mutex);
+                while (cached.size() > kCachedPerClass / 2) {
+                    if (depot.blocks.size() < kDepotPerClass) {
+                        depot.blocks.push_back(cached.back());
                     }
-                    auto players = ParseRconStatusPlayers(response, 1);
-                    std::string result = "{\"players\":[";
-                    bool first = true;
-                    for (const auto& player : players) {
-                        if (!first) result += ",";
-                        result += "{";
-                        result += "\"slot\":\"" + EscapeJson(player.at("slot")) + "\",";
-                        result += "\"score\":\"" + EscapeJson(player.at("score")) + "\",";
-                        result += "\"ping\":\"" + EscapeJson(player.at("ping")) + "\",";
-                        result += "\"name\":\"" + EscapeJson(player.at("name")) + "\",";
-                        result += "\"lastmsg\":\"" + EscapeJson(player.at("lastmsg")) + "\",";
-                        result += "\"address\":\"" + EscapeJson(player.at("address")) + "\",";
-                        result += "\"qport\":\"" + EscapeJson(player.at("qport")) + "\",";
-                        result += "\"rate\":\"" + EscapeJson(player.at("rate")) + "\"";
-                        result += "}";
-                        first = false;
-                    }
-                    result += "]}";
-                    return result;
-                }
-                else {
-                    response.erase(0, response.find_first_not_of("\n")); // Trim leading newlines
-                    return raw ? response : "{\"response\":\"" + EscapeJson(response) + "\"}";
+                    else {
+                        free(cached.back());
+                    }
+                    cached.pop_back();
                 }
             }
-            return "error=Unsupported command";
+            cached.push_back(block);
         }
-    };
 
-    // Handler for Call of Duty server commands
-    class CallOfDutyHandler : public ProtocolHandler {
-    public:
-        std::string ProcessCommand(bool raw, const std::string& ip, int port, const std::string& command, const std::string& rconPassword) override {
-            std::string query;
-            std::string cmd = SanitizeCommand(command);
-            if (cmd == "getinfo") {
-                query = "\xFF\xFF\xFF\xFFgetinfo";
-            }
-            else if (cmd == "getstatus") {
-                query = "\xFF\xFF\xFF\xFFgetstatus";
-            }
-            else if (cmd.find("rcon ") == 0) {
-                query = "\xFF\xFF\xFF\xFFrcon \"" + rconPassword + "\" " + cmd.substr(5);
-            }
-            else {
-                return "error=Invalid command";
-            }
+    private:
+        static constexpr size_t kClasses = 9;              // 256 bytes to 64 KB, doubling
+        static constexpr size_t kSmallestClass = 256;
+        static constexpr size_t kHeaderSize = alignof(std::max_align_t);
+        static constexpr size_t kCachedPerClass = 32;      // Blocks per class a thread keeps for itself
+        static constexpr size_t kDepotPerClass = 256;      // Blocks per class shared between threads
 
-            std::string response = SendUDPQuery(ip, port, query, cmd.find("rcon map ") == 0 ? 2000 : 1000);
-            if (cmd.find("rcon map ") == 0) {
-                std::string map = cmd.substr(9);
-                return "{\"status\":\"success\",\"message\":\"Map changed to " + EscapeJson(map) + "\"}";
+        struct ThreadCache {
+            ThreadCache() {
+                for (auto& cached : blocks) cached.reserve(kCachedPerClass);
             }
-            if (response.find("error=") == 0 || response.empty()) {
-                return response.empty() ? "error=Empty response from server" : response;
+            ~ThreadCache() {
+                for (auto& cached : blocks) {
+                    for (char* block : cached) free(block);
+                }
             }
+            std::vector<char*> blocks[kClasses];
+        };
 
-            if (cmd == "getinfo" || cmd == "getstatus") {
-                size_t pos = response.find(cmd == "getinfo" ? "infoResponse" : "statusResponse");
-                if (pos == std::string::npos) {
-                    return "error=Invalid server response;raw=" + response;
-                }
-                response = response.substr(pos + (cmd == "getinfo" ? 12 : 14));
-                if (response.empty()) {
-                    return "error=Empty response after header removal;raw=" + response;
-                }
-                if (raw) {
-                    return response;
+        struct Depot {
+            std::mutex mutex;
+            std::vector<char*> blocks;
+        };
+
+        static ThreadCache& Cache() {
+            thread_local ThreadCache cache;
+            return cache;
+        }
+
+        static size_t ClassSize(size_t sizeClass) {
+            return kSmallestClass << sizeClass;
+        }
+
+        // Smallest class that holds size bytes after the header, or kClasses if none does
+        static size_t ClassFor(size_t size) {
+            size_t sizeClass = 0;
+            while (sizeClass < kClasses && ClassSize(sizeClass) < size) ++sizeClass;
+            return sizeClass;
+        }
+
+        char* Take(size_t sizeClass) {
+            std::vector<char*>& cached = Cache().blocks[sizeClass];
+            if (cached.empty()) {
+                Depot& depot = depots[sizeClass];
+                std::lock_guard<std::mutex> lock(depot.mutex);
+                while (!depot.blocks.empty() && cached.size() < kCachedPerClass / 2) {
+                    cached.push_back(depot.blocks.back());
+                    depot.blocks.pop_back();
                 }
-                auto kv = ParseKeyValues(response);
-                auto players = ParseGetStatusPlayers(response, 2);
-                return ToJson(kv, players);
             }
-            else if (cmd.find("rcon ") == 0) {
-                size_t pos = response.find("print");
-                if (pos == std::string::npos) {
-                    return "error=Invalid server response;raw=" + response;
-                }
-                response = response.substr(pos + 5);
-                if (response.empty()) {
-                    return "error=Empty response after header removal;raw=" + response;
-                }
-                if (cmd == "rcon status") {
-                    if (raw) {
-                        return response;
-                    }
-                    auto players = ParseRconStatusPlayers(response, 2);
-                    std::string result = "{\"players\":[";
-                    bool first = true;
-                    for (const auto& player : players) {
-                        if (!first) result += ",";
-                        result += "{";
-                        result += "\"slot\":\"" + EscapeJson(player.at("slot")) + "\",";
-                        result += "\"score\":\"" + EscapeJson(player.at("score")) + "\",";
-                        result += "\"ping\":\"" + EscapeJson(player.at("ping")) + "\",";
-                        result += "\"name\":\"" + EscapeJson(player.at("name")) + "\",";
-                        result += "\"lastmsg\":\"" + EscapeJson(player.at("lastmsg")) + "\",";
-                        result += "\"address\":\"" + EscapeJson(player.at("address")) + "\",";
-                        result += "\"qport\":\"" + EscapeJson(player.at("qport")) + "\",";
-                        result += "\"rate\":\"" + EscapeJson(player.at("rate")) + "\"";
-                        if (player.count("guid")) result += ",\"guid\":\"" + EscapeJson(player.at("guid")) + "\"";
-                        if (player.count("playerid")) result += ",\"playerid\":\"" + EscapeJson(player.at("playerid")) + "\"";
-                        if (player.count("steamid")) result += ",\"steamid\":\"" + EscapeJson(player.at("steamid")) + "\"";
-                        result += "}";
-                        first = false;
-                    }
-                    result += "]}";
-                    return result;
-                }
-                else {
-                    response.erase(0, response.find_first_not_of("\n")); // Trim leading newlines
-                    return raw ? response : "{\"response\":\"" + EscapeJson(response) + "\"}";
-                }
+            if (cached.empty()) {
+                return nullptr;
             }
-            return "error=Unsupported command";
+            char* block = cached.back();
+            cached.pop_back();
+            return block;
         }
-    };
 
-    // Initializes protocol registry with handlers
-    struct ProtocolInitializer {
-        ProtocolInitializer() {
-            protocolRegistry[1] = std::make_unique<MedalOfHonorHandler>();
-            protocolRegistry[2] = std::make_unique<CallOfDutyHandler>();
+        Depot depots[kClasses];
+    } responsePool;
+
+    // A getstatus or rcon status reply from a server that is being parsed on this thread. The handler passes
+    // the players it parsed to ObserveStatus or ObserveRconStatus, which feed the player index and the history
+    // store, so the reply is only tokenized once.
+    class ReplyObservation {
+    public:
+        ReplyObservation(int protocolId, uint64_t server, Clock::duration rtt, const std::string& cmd)
+            : protocolId(protocolId), server(server), rtt(rtt), rcon(cmd == "rcon status"), previous(current) {
+            if (server != 0 && (rcon || cmd == "getstatus")) {
+                current = this;
+            }
         }
-    } initializer;
-}
+        ~ReplyObservation() { current = previous; }
+        ReplyObservation(const ReplyObservation&) = delete;
+        ReplyObservation& operator=(const ReplyObservation&) = delete;
 
-// Resolves hostname to IP address with DNS caching
-std::string ResolveHostname(const std::string& hostname) {
-    std::lock_guard<std::mutex> lock(dnsMutex);
-    auto now = std::chrono::steady_clock::now();
-    auto it = dnsCache.find(hostname);
-    if (it != dnsCache.end()) {
-        auto age = std::chrono::duration_cast<std::chrono::minutes>(now - it->second.timestamp).count();
-        if (age < 5) return it->second.ip;
-    }
+        // The observed reply being parsed on this thread, or null
+        static ReplyObservation* Current() { return current; }
 
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-        return "error=Winsock initialization failed";
-    }
+        const int protocolId;
+        const uint64_t server;              // EndpointKey of the server
+        const Clock::duration rtt;
+        const bool rcon;
 
-    addrinfo hints = { 0 };
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_DGRAM;
-    addrinfo* result = nullptr;
-    if (getaddrinfo(hostname.c_str(), nullptr, &hints, &result) != 0) {
-        WSACleanup();
-        return "error=Failed to resolve hostname";
-    }
+    private:
+        static thread_local ReplyObservation* current;
+        ReplyObservation* previous;
+    };
 
-    std::string ip;
-    for (addrinfo* ptr = result; ptr != nullptr; ptr = ptr->ai_next) {
-        char ipStr[INET_ADDRSTRLEN];
-        auto* sa = (sockaddr_in*)ptr->ai_addr;
-        inet_ntop(AF_INET, &sa->sin_addr, ipStr, sizeof(ipStr));
-        ip = ipStr;
-        break;
-    }
-    freeaddrinfo(result);
-    WSACleanup();
+    thread_local ReplyObservation* ReplyObservation::current = nullptr;
 
-    if (!ip.empty()) {
-        dnsCache[hostname] = { ip, now };
+    // Parses a response, recording parsing and JSON output as separate phases. server is the EndpointKey
+    // the response came from, or 0 for a captured packet, and rtt the time the server took to answer.
+    std::string TimedParse(ProtocolHandler* handler, int protocolId, bool raw, const std::string& cmd, std::string response, uint64_t server,
+        Clock::duration rtt) {
+        ParseArena arena;
+        jsonTime = Clock::duration::zero();
+        auto start = Clock::now();
+        ReplyObservation observation(protocolId, server, rtt, cmd);
+        std::string result = handler->ParseResponse(raw, cmd, std::move(response));
+        auto elapsed = Clock::now() - start;
+        metrics.Record(protocolId, PHASE_PARSE, elapsed - jsonTime);
+        if (jsonTime > Clock::duration::zero()) {
+            metrics.Record(protocolId, PHASE_JSON, jsonTime);
+        }
+        return result;
     }
-    return ip.empty() ? "error=Failed to resolve hostname" : ip;
-}
 
-// Sends UDP query to game server and returns response
-std::string SendUDPQuery(const std::string& ip, int port, const std::string& query, int timeoutMs) {
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-        return "error=Winsock initialization failed";
-    }
+    // Set while GameServerQueryInit holds a Winsock reference for the lifetime of the library
+    std::atomic<bool> networkInitialized{ false };
+    std::mutex lifecycleMutex;
 
-    SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (sock == INVALID_SOCKET) {
-        WSACleanup();
-        return "error=Socket creation failed";
+    // Takes a Winsock reference; BSD sockets need no setup
+    bool StartNetwork() {
+#ifdef _WIN32
+        WSADATA wsaData;
+        return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#else
+        return true;
+#endif
     }
 
-    // Set receive timeout
-    DWORD timeout = timeoutMs;
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
-
-    sockaddr_in server;
-    server.sin_family = AF_INET;
-    server.sin_port = htons(static_cast<u_short>(port));
-    if (inet_pton(AF_INET, ip.c_str(), &server.sin_addr) <= 0) {
-        closesocket(sock);
+    void StopNetwork() {
+#ifdef _WIN32
         WSACleanup();
-        return "error=Invalid IP address";
+#endif
     }
 
-    if (sendto(sock, query.c_str(), static_cast<int>(query.size()), 0, (sockaddr*)&server, sizeof(server)) == SOCKET_ERROR) {
-        closesocket(sock);
-        WSACleanup();
-        return "error=Send failed";
+    // Switches a socket to non-blocking mode
+    void SetNonBlocking(SOCKET sock) {
+#ifdef _WIN32
+        u_long nonBlocking = 1;
+        ioctlsocket(sock, FIONBIO, &nonBlocking);
+#else
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+#endif
     }
 
-    char buffer[4096];
-    int addrLen = sizeof(server);
-    int bytesReceived = recvfrom(sock, buffer, sizeof(buffer) - 1, 0, (sockaddr*)&server, &addrLen);
-    if (bytesReceived == SOCKET_ERROR) {
-        closesocket(sock);
-        WSACleanup();
-        return "error=Receive failed";
+    // Limits how long a blocking receive waits (Winsock takes milliseconds, BSD sockets a timeval)
+    void SetReceiveTimeout(SOCKET sock, long ms) {
+#ifdef _WIN32
+        DWORD wait = static_cast<DWORD>(ms);
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&wait, sizeof(wait));
+#else
+        timeval wait = { ms / 1000, (ms % 1000) * 1000 };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait));
+#endif
     }
 
-    buffer[bytesReceived] = '\0';
-    std::string response(buffer);
-    closesocket(sock);
-    WSACleanup();
-    return response;
-}
-
-// Processes game server command and returns response
-extern "C" const char* ProcessGameServerCommand(int protocolId, bool raw, const char* ipOrHostname, int port, const char* command, const char* rconPassword) {
-    try {
+    // Holds Winsock for the duration of a call when the library has not been initialized explicitly
+    class NetworkScope {
+    public:
+        NetworkScope() {
+            if (networkInitialized) {
+                ok = true;
+                return;
+            }
+            ok = started = StartNetwork();
+        }
+        ~NetworkScope() {
+            if (started) StopNetwork();
+        }
+        NetworkScope(const NetworkScope&) = delete;
+        NetworkScope& operator=(const NetworkScope&) = delete;
+        bool ok = false;
+    private:
+        bool started = false;
+    };
+
+    // Opens a UDP socket configured for game server queries
+    SOCKET OpenQuerySocket() {
+        SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock != INVALID_SOCKET) {
+            int recvBufferSize = 64 * 1024;
+            setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char*)&recvBufferSize, sizeof(recvBufferSize));
+        }
+        return sock;
+    }
+
+    // Discards datagrams still queued on a socket (late replies to earlier, timed out queries)
+    void DrainSocket(SOCKET sock) {
+        char scratch[512];
+        for (;;) {
+            fd_set readSet;
+            FD_ZERO(&readSet);
+            FD_SET(sock, &readSet);
+            timeval tv = { 0, 0 };
+            if (select(static_cast<int>(sock) + 1, &readSet, nullptr, nullptr, &tv) <= 0) {
+                return;
+            }
+            if (recv(sock, scratch, sizeof(scratch), 0) == SOCKET_ERROR && WSAGetLastError() != WSAEMSGSIZE) {
+                return;
+            }
+        }
+    }
+
+    // Pool of pre-opened UDP sockets shared by all blocking queries while the library is initialized
+    class SocketPool {
+    public:
+        // Pre-opens sockets and starts handing them out; returns false if none could be opened
+        bool Start(int size) {
+            std::lock_guard<std::mutex> lock(mutex);
+            capacity = size > 0 ? static_cast<size_t>(size) : 0;
+            while (idle.size() < capacity) {
+                SOCKET sock = OpenQuerySocket();
+                if (sock == INVALID_SOCKET) {
+                    break;
+                }
+                idle.push_back(sock);
+            }
+            active = true;
+            return capacity == 0 || !idle.empty();
+        }
+
+        // Closes idle sockets; sockets still borrowed are closed when returned
+        void Stop() {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (SOCKET sock : idle) {
+                closesocket(sock);
+            }
+            idle.clear();
+            active = false;
+        }
+
+        // Borrows a socket, opening a new one if the pool is empty
+        SOCKET Acquire() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!idle.empty()) {
+                    SOCKET sock = idle.back();
+                    idle.pop_back();
+                    return sock;
+                }
+            }
+            return OpenQuerySocket();
+        }
+
+        // Returns a borrowed socket; broken sockets and overflow beyond the pool size are closed
+        void Release(SOCKET sock, bool reusable) {
+            if (reusable) {
+                DrainSocket(sock);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (active && idle.size() < capacity) {
+                    idle.push_back(sock);
+                    return;
+                }
+            }
+            closesocket(sock);
+        }
+
+        bool IsActive() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return active;
+        }
+
+    private:
+        std::mutex mutex;
+        std::vector<SOCKET> idle;
+        size_t capacity = 0;
+        bool active = false;
+    } socketPool;
+
+    // Borrows a query socket from the pool, or opens a private one when the library is not initialized
+    class ScopedQuerySocket {
+    public:
+        ScopedQuerySocket() {
+            if (!network.ok) {
+                return;
+            }
+            pooled = networkInitialized && socketPool.IsActive();
+            sock = pooled ? socketPool.Acquire() : OpenQuerySocket();
+        }
+        ~ScopedQuerySocket() {
+            if (sock == INVALID_SOCKET) {
+                return;
+            }
+            if (pooled) {
+                socketPool.Release(sock, reusable);
+            }
+            else {
+                closesocket(sock);
+            }
+        }
+        ScopedQuerySocket(const ScopedQuerySocket&) = delete;
+        ScopedQuerySocket& operator=(const ScopedQuerySocket&) = delete;
+        NetworkScope network;
+        SOCKET sock = INVALID_SOCKET;
+        bool reusable = true;   // Cleared when the socket hit an error and should not be pooled again
+    private:
+        bool pooled = false;
+    };
+
+    // Sanitizes command by removing semicolons and newlines
+    std::string SanitizeCommand(const std::string& command) {
+        std::string sanitized = command;
+        sanitized.erase(std::remove_if(sanitized.begin(), sanitized.end(),
+            [](char c) { return c == ';' || c == '\n' || c == '\r'; }), sanitized.end());
+        return sanitized;
+    }
+
+    // Returns the receive timeout for a command (map changes take longer to acknowledge)
+    int QueryTimeoutMs(const std::string& cmd) {
+        return cmd.find("rcon map ") == 0 ? 2000 : 1000;
+    }
+
+    // Whether multiplexed queries use sendmmsg/recvmmsg where the platform has them
+    std::atomic<bool> batchedIo{ true };
+
+    // Gap with no new packet after which a multi-packet rcon reply is considered complete
+    std::atomic<int> quietPeriodMs{ 100 };
+
+    // Returns true for commands whose reply may span several "print" packets
+    bool IsMultiPacketCommand(const std::string& cmd) {
+        return cmd.find("rcon ") == 0;
+    }
+
+    // Returns true for read-only queries that are safe to send again when a reply seems lost (never rcon)
+    bool IsIdempotentCommand(const std::string& cmd) {
+        return cmd == "getinfo" || cmd == "getstatus";
+    }
+
+    // How many times an idempotent query is resent before giving up on a reply
+    std::atomic<int> maxRetransmits{ 2 };
+
+    // Packs an IPv4 endpoint into one integer key
+    uint64_t EndpointKey(const sockaddr_in& addr) {
+        return (static_cast<uint64_t>(ntohl(addr.sin_addr.s_addr)) << 16) | ntohs(addr.sin_port);
+    }
+
+    // Key of a dotted IPv4 address and port, or 0 if the address does not parse
+    uint64_t EndpointKey(const std::string& ip, int port) {
+        sockaddr_in server = {};
+        server.sin_port = htons(static_cast<u_short>(port));
+        return inet_pton(AF_INET, ip.c_str(), &server.sin_addr) == 1 ? EndpointKey(server) : 0;
+    }
+
+    // Per-endpoint round-trip estimates used to pick retransmit and receive timeouts, computed as in
+    // TCP (RFC 6298): RTO = SRTT + 4 * RTTVAR, doubled on every unanswered transmission
+    class RttEstimator {
+    public:
+        static constexpr int kInitialRtoMs = 300;   // Used for endpoints with no samples yet
+        static constexpr int kMinRtoMs = 50;
+        static constexpr int kMaxRtoMs = 3000;
+
+        // Current retransmit timeout for an endpoint, including any backoff
+        std::chrono::milliseconds Rto(uint64_t key) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = estimates.find(key);
+            return std::chrono::milliseconds(it == estimates.end() ? kInitialRtoMs : it->second.rtoMs);
+        }
+
+        // Overall reply deadline: the command default, stretched for endpoints whose measured RTT needs it
+        int TimeoutMs(uint64_t key, int defaultMs) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = estimates.find(key);
+            if (it == estimates.end() || it->second.srttMs <= 0) {
+                return defaultMs;
+            }
+            int measured = static_cast<int>(2 * (it->second.srttMs + 4 * it->second.rttvarMs));
+            return (std::max)(defaultMs, (std::min)(measured, 4 * defaultMs));
+        }
+
+        // Records the round trip of a query answered without retransmission (Karn's rule)
+        void Sample(uint64_t key, Clock::duration rtt) {
+            double ms = std::chrono::duration<double, std::milli>(rtt).count();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (estimates.size() >= kMaxEndpoints && estimates.find(key) == estimates.end()) {
+                estimates.clear();
+            }
+            Estimate& estimate = estimates[key];
+            if (estimate.srttMs <= 0) {
+                estimate.srttMs = ms;
+                estimate.rttvarMs = ms / 2;
+            }
+            else {
+                estimate.rttvarMs = 0.75 * estimate.rttvarMs + 0.25 * std::abs(estimate.srttMs - ms);
+                estimate.srttMs = 0.875 * estimate.srttMs + 0.125 * ms;
+            }
+            estimate.rtoMs = Clamp(static_cast<int>(estimate.srttMs + (std::max)(1.0, 4 * estimate.rttvarMs)));
+        }
+
+        // Doubles an endpoint's timeout after a transmission went unanswered
+        void Backoff(uint64_t key) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (estimates.size() >= kMaxEndpoints && estimates.find(key) == estimates.end()) {
+                estimates.clear();
+            }
+            Estimate& estimate = estimates[key];
+            estimate.rtoMs = Clamp(estimate.rtoMs * 2);
+        }
+
+    private:
+        static constexpr size_t kMaxEndpoints = 65536;
+
+        struct Estimate {
+            double srttMs = 0;                  // 0 until the first sample
+            double rttvarMs = 0;
+            int rtoMs = kInitialRtoMs;
+        };
+
+        static int Clamp(int rtoMs) {
+            return (std::min)((std::max)(rtoMs, kMinRtoMs), kMaxRtoMs);
+        }
+
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Estimate> estimates;
+    } rttEstimator;
+
+    // Returns the length of an out-of-band header ("\xFF\xFF\xFF\xFF", an optional direction byte as sent by
+    // Medal of Honor, then the keyword) at the start of a packet, or 0 if the packet does not start with it
+    size_t ResponseHeaderLength(std::string_view packet, std::string_view keyword) {
+        static const std::string_view marker("\xFF\xFF\xFF\xFF", 4);
+        if (packet.substr(0, marker.size()) != marker) {
+            return 0;
+        }
+        size_t pos = marker.size();
+        if (pos < packet.size() && static_cast<unsigned char>(packet[pos]) < 0x20) {
+            ++pos;
+        }
+        return packet.substr(pos, keyword.size()) == keyword ? pos + keyword.size() : 0;
+    }
+
+    // Header keyword of the reply to a getstatus/getinfo query packet, used to discard late duplicates of
+    // earlier replies; empty for other queries, whose replies are not checked
+    std::string_view ExpectedReplyKeyword(std::string_view query) {
+        if (ResponseHeaderLength(query, "getstatus") > 0) return "statusResponse";
+        if (ResponseHeaderLength(query, "getinfo") > 0) return "infoResponse";
+        return {};
+    }
+
+    std::string ExchangeUDPQuery(const std::string& ip, int port, const std::string& query, int timeoutMs, int quietMs, int retransmits);
+
+    // Command default timeout, stretched for a server whose measured round trip needs longer
+    int AdaptiveTimeoutMs(const std::string& ip, int port, int defaultMs) {
+        sockaddr_in server = {};
+        server.sin_port = htons(static_cast<u_short>(port));
+        if (inet_pton(AF_INET, ip.c_str(), &server.sin_addr) != 1) {
+            return defaultMs;
+        }
+        return rttEstimator.TimeoutMs(EndpointKey(server), defaultMs);
+    }
+
+    // Appends a reply datagram to a response, dropping the "print" header repeated on every packet after the first
+    void AppendResponsePacket(std::string& response, const char* data, size_t length) {
+        std::string_view packet(data, strnlen(data, length));
+        if (!response.empty()) {
+            size_t header = ResponseHeaderLength(packet, "print");
+            if (header > 0 && header < packet.size() && packet[header] == '\n') {
+                ++header;
+            }
+            packet.remove_prefix(header);
+        }
+        response.append(packet.data(), packet.size());
+    }
+
+    // Appends a string to a JSON document with quotes and escaping in a single pass. Every control character
+    // is escaped; runs of ordinary characters are copied in one append.
+    void AppendJsonString(std::string& out, std::string_view input) {
+        static const char hex[] = "0123456789abcdef";
+        out += '"';
+        size_t runStart = 0;
+        for (size_t i = 0; i < input.size(); ++i) {
+            unsigned char c = static_cast<unsigned char>(input[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+            out.append(input.data() + runStart, i - runStart);
+            runStart = i + 1;
+            switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 0xF];
+                break;
+            }
+        }
+        out.append(input.data() + runStart, input.size() - runStart);
+        out += '"';
+    }
+
+    // Streaming JSON writer that escapes values straight into a growable output buffer; commas are inserted
+    // automatically between members and array elements
+    class JsonWriter {
+    public:
+        explicit JsonWriter(std::string& out) : out(out) {}
+
+        JsonWriter& BeginObject() { Separate(); out += '{'; needComma = false; return *this; }
+        JsonWriter& EndObject() { out += '}'; needComma = true; return *this; }
+        JsonWriter& BeginArray() { Separate(); out += '['; needComma = false; return *this; }
+        JsonWriter& EndArray() { out += ']'; needComma = true; return *this; }
+
+        JsonWriter& Key(std::string_view key) {
+            Separate();
+            AppendJsonString(out, key);
+            out += ':';
+            needComma = false;
+            return *this;
+        }
+
+        JsonWriter& String(std::string_view value) {
+            Separate();
+            AppendJsonString(out, value);
+            needComma = true;
+            return *this;
+        }
+
+        JsonWriter& Member(std::string_view key, std::string_view value) {
+            return Key(key).String(value);
+        }
+
+        JsonWriter& Bool(bool value) {
+            Separate();
+            out += value ? "true" : "false";
+            needComma = true;
+            return *this;
+        }
+
+        JsonWriter& Number(uint64_t value) {
+            Separate();
+            out += std::to_string(value);
+            needComma = true;
+            return *this;
+        }
+
+    private:
+        void Separate() {
+            if (needComma) out += ',';
+        }
+
+        std::string& out;
+        bool needComma = false;
+    };
+
+    // Server setting from a getstatus/getinfo response; both fields are slices of the received packet
+    using KeyValueView = std::pair<std::string_view, std::string_view>;
+    using KeyValueList = std::pmr::vector<KeyValueView>;
+
+    // Player line from a getstatus response; all fields are slices of the received packet (or literals)
+    struct StatusPlayer {
+        std::string_view slot;
+        std::string_view score;
+        std::string_view ping;
+        std::string_view name;
+    };
+    using StatusPlayerList = std::pmr::vector<StatusPlayer>;
+
+    bool IsSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    std::string_view Trim(std::string_view text) {
+        while (!text.empty() && IsSpace(text.front())) text.remove_prefix(1);
+        while (!text.empty() && IsSpace(text.back())) text.remove_suffix(1);
+        return text;
+    }
+
+    bool IsDigits(std::string_view text) {
+        return std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; });
+    }
+
+    // Accepts empty, unsigned or negative integers (scores can go below zero)
+    bool IsScore(std::string_view text) {
+        return IsDigits(text) || (text.size() > 1 && text[0] == '-' && IsDigits(text.substr(1)));
+    }
+
+    // Characters the status parsers split on, in the order of StructuralMasks::bits
+    enum StructuralChar {
+        CHAR_BACKSLASH,
+        CHAR_NEWLINE,
+        CHAR_QUOTE,
+        CHAR_SPACE,
+        CHAR_CARET,
+        CHAR_KINDS
+    };
+
+    // Bit i of bits[kind] is set when byte i of a 64-byte block is that character
+    struct StructuralMasks {
+        uint64_t bits[CHAR_KINDS];
+    };
+
+    // Instruction sets for classifying blocks, selectable through GSQ_OPTION_SIMD_LEVEL
+    enum SimdLevel {
+        SIMD_SCALAR,
+        SIMD_SSE2,
+        SIMD_AVX2
+    };
+
+    StructuralMasks ClassifyScalar(const char* block) {
+        StructuralMasks masks = {};
+        for (int i = 0; i < 64; ++i) {
+            uint64_t bit = uint64_t(1) << i;
+            switch (block[i]) {
+            case '\\': masks.bits[CHAR_BACKSLASH] |= bit; break;
+            case '\n': masks.bits[CHAR_NEWLINE] |= bit; break;
+            case '"': masks.bits[CHAR_QUOTE] |= bit; break;
+            case ' ': masks.bits[CHAR_SPACE] |= bit; break;
+            case '^': masks.bits[CHAR_CARET] |= bit; break;
+            }
+        }
+        return masks;
+    }
+
+#ifdef GSQ_X86
+    GSQ_TARGET("sse2") StructuralMasks ClassifySse2(const char* block) {
+        static const char targets[CHAR_KINDS] = { '\\', '\n', '"', ' ', '^' };
+        StructuralMasks masks = {};
+        for (int i = 0; i < 4; ++i) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+            for (int kind = 0; kind < CHAR_KINDS; ++kind) {
+                uint32_t found = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(targets[kind]))));
+                masks.bits[kind] |= uint64_t(found) << (16 * i);
+            }
+        }
+        return masks;
+    }
+
+    GSQ_TARGET("avx2") StructuralMasks ClassifyAvx2(const char* block) {
+        static const char targets[CHAR_KINDS] = { '\\', '\n', '"', ' ', '^' };
+        StructuralMasks masks = {};
+        for (int i = 0; i < 2; ++i) {
+            __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32 * i));
+            for (int kind = 0; kind < CHAR_KINDS; ++kind) {
+                uint32_t found = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(targets[kind]))));
+                masks.bits[kind] |= uint64_t(found) << (32 * i);
+            }
+        }
+        return masks;
+    }
+#endif
+
+    // Best instruction set this CPU and operating system support
+    SimdLevel DetectSimdLevel() {
+#if defined(GSQ_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+        __cpuid(info, 1);
+        bool sse2 = (info[3] & (1 << 26)) != 0;
+        bool osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+        if (osAvx && maxLeaf >= 7) {
+            __cpuidex(info, 7, 0);
+            if ((info[1] & (1 << 5)) != 0) {
+                return SIMD_AVX2;
+            }
+        }
+        return sse2 ? SIMD_SSE2 : SIMD_SCALAR;
+#elif defined(GSQ_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return SIMD_AVX2;
+        }
+        return __builtin_cpu_supports("sse2") ? SIMD_SSE2 : SIMD_SCALAR;
+#else
+        return SIMD_SCALAR;
+#endif
+    }
+
+    using ClassifyFn = StructuralMasks(*)(const char* block);
+
+    const SimdLevel supportedSimdLevel = DetectSimdLevel();
+
+    ClassifyFn ClassifierFor(int level) {
+#ifdef GSQ_X86
+        if (level >= SIMD_AVX2 && supportedSimdLevel >= SIMD_AVX2) {
+            return ClassifyAvx2;
+        }
+        if (level >= SIMD_SSE2 && supportedSimdLevel >= SIMD_SSE2) {
+            return ClassifySse2;
+        }
+#endif
+        return ClassifyScalar;
+    }
+
+    std::atomic<ClassifyFn> classifyBlock{ ClassifierFor(SIMD_AVX2) };
+
+    // Classifies the block at data, of which only length (at most 64) bytes may be read
+    StructuralMasks ClassifyPartial(const char* data, size_t length) {
+        if (length == 64) {
+            return classifyBlock.load(std::memory_order_relaxed)(data);
+        }
+        char padded[64] = {};
+        std::memcpy(padded, data, length);
+        return classifyBlock.load(std::memory_order_relaxed)(padded);
+    }
+
+    int LowestBit(uint64_t bits) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+        unsigned long index;
+        _BitScanForward64(&index, bits);
+        return static_cast<int>(index);
+#elif defined(_MSC_VER)
+        unsigned long index;
+        if (_BitScanForward(&index, static_cast<unsigned long>(bits))) {
+            return static_cast<int>(index);
+        }
+        _BitScanForward(&index, static_cast<unsigned long>(bits >> 32));
+        return static_cast<int>(index) + 32;
+#else
+        return __builtin_ctzll(bits);
+#endif
+    }
+
+    int BitCount(uint64_t bits) {
+        bits = bits - ((bits >> 1) & 0x5555555555555555ULL);
+        bits = (bits & 0x3333333333333333ULL) + ((bits >> 2) & 0x3333333333333333ULL);
+        bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return static_cast<int>((bits * 0x0101010101010101ULL) >> 56);
+    }
+
+    // Positions of every structural character in a buffer, found in one vectorized pass, so the parsers
+    // jump from delimiter to delimiter instead of testing each byte
+    class StructuralIndex {
+    public:
+        explicit StructuralIndex(std::string_view text) : text(text), blocks((text.size() + 63) / 64, ParseArena::Current()) {
+            for (size_t i = 0; i < blocks.size(); ++i) {
+                blocks[i] = ClassifyPartial(text.data() + i * 64, (std::min)(size_t(64), text.size() - i * 64));
+            }
+        }
+
+        std::string_view Text() const { return text; }
+
+        // Position of the first kind character at or after pos, or the text size if there is none
+        size_t Next(StructuralChar kind, size_t pos) const {
+            size_t block = pos / 64;
+            if (block >= blocks.size()) {
+                return text.size();
+            }
+            uint64_t bits = blocks[block].bits[kind] & (~uint64_t(0) << (pos % 64));
+            while (bits == 0) {
+                if (++block == blocks.size()) {
+                    return text.size();
+                }
+                bits = blocks[block].bits[kind];
+            }
+            return block * 64 + LowestBit(bits);
+        }
+
+        // Number of kind characters in [begin, end)
+        size_t Count(StructuralChar kind, size_t begin, size_t end) const {
+            size_t count = 0;
+            for (size_t block = begin / 64; block < blocks.size() && block * 64 < end; ++block) {
+                uint64_t bits = blocks[block].bits[kind];
+                if (block == begin / 64) bits &= ~uint64_t(0) << (begin % 64);
+                if (end - block * 64 < 64) bits &= (uint64_t(1) << (end - block * 64)) - 1;
+                count += BitCount(bits);
+            }
+            return count;
+        }
+
+    private:
+        std::string_view text;
+        std::pmr::vector<StructuralMasks> blocks;
+    };
+
+    // When set, player objects also carry the name with its color codes removed as "clean_name"
+    std::atomic<bool> cleanNames{ false };
+
+    // Removes Quake color codes from a name the way the engine does: a caret followed by any character
+    // other than another caret (or the end of the name) is dropped together with that character
+    std::string StripColorCodes(std::string_view name) {
+        std::string clean;
+        clean.reserve(name.size());
+        size_t copied = 0;
+        for (size_t base = 0; base < name.size(); base += 64) {
+            uint64_t carets = ClassifyPartial(name.data() + base, (std::min)(size_t(64), name.size() - base)).bits[CHAR_CARET];
+            while (carets != 0) {
+                size_t pos = base + LowestBit(carets);
+                carets &= carets - 1;
+                if (pos + 1 < name.size() && name[pos + 1] != '^') {
+                    clean.append(name.data() + copied, pos - copied);
+                    copied = pos + 2;
+                }
+            }
+        }
+        clean.append(name.data() + copied, name.size() - copied);
+        return clean;
+    }
+
+    // Calls fn(key, value) with slices of the packet for each setting on the \key\value\... line of a
+    // server response, in packet order
+    template <typename Fn>
+    void ForEachKeyValue(const StructuralIndex& index, Fn&& fn) {
+        std::string_view response = index.Text();
+        size_t pos = response.find_first_not_of('\n');
+        if (pos == std::string_view::npos) {
+            return;
+        }
+        size_t end = index.Next(CHAR_NEWLINE, pos);
+        while (pos < end && response[pos] == '\\') {
+            ++pos;
+            size_t next = index.Next(CHAR_BACKSLASH, pos);
+            if (next >= end) {
+                break;
+            }
+            std::string_view key = response.substr(pos, next - pos);
+            pos = next + 1;
+            next = (std::min)(index.Next(CHAR_BACKSLASH, pos), end);
+            if (!key.empty()) {
+                fn(key, response.substr(pos, next - pos));
+            }
+            pos = next;
+        }
+    }
+
+    // Parses the \key\value\... line of a server response into slices of the packet, sorted by key.
+    // When a key repeats, the last value wins.
+    KeyValueList ParseKeyValues(const StructuralIndex& index) {
+        std::string_view response = index.Text();
+        size_t pos = response.find_first_not_of('\n');
+        if (pos == std::string_view::npos) {
+            return {};
+        }
+        KeyValueList result(ParseArena::Current());
+        result.reserve(index.Count(CHAR_BACKSLASH, pos, index.Next(CHAR_NEWLINE, pos)) / 2);
+        ForEachKeyValue(index, [&result](std::string_view key, std::string_view value) {
+            result.emplace_back(key, value);
+        });
+
+        // Slices share one buffer, so their address breaks ties between duplicate keys in arrival order
+        std::sort(result.begin(), result.end(), [](const KeyValueView& a, const KeyValueView& b) {
+            return a.first != b.first ? a.first < b.first : a.first.data() < b.first.data();
+        });
+        auto last = std::unique(result.rbegin(), result.rend(), [](const KeyValueView& a, const KeyValueView& b) {
+            return a.first == b.first;
+        });
+        result.erase(result.begin(), last.base());
+        return result;
+    }
+
+    KeyValueList ParseKeyValues(std::string_view response) {
+        return ParseKeyValues(StructuralIndex(response));
+    }
+
+    // Value of a key in a list from ParseKeyValues, or an empty slice if the key is missing
+    std::string_view FindKeyValue(const KeyValueList& kv, std::string_view key) {
+        auto it = std::lower_bound(kv.begin(), kv.end(), key, [](const KeyValueView& pair, std::string_view k) { return pair.first < k; });
+        return it != kv.end() && it->first == key ? it->second : std::string_view();
+    }
+
+    // Player columns that appear in getstatus and rcon status replies
+    enum PlayerColumn {
+        COL_SLOT,
+        COL_SCORE,
+        COL_PING,
+        COL_NAME,
+        COL_LASTMSG,
+        COL_ADDRESS,
+        COL_QPORT,
+        COL_RATE,
+        COL_GUID,
+        COL_PLAYERID,
+        COL_STEAMID
+    };
+    constexpr const char* kColumnNames[] = { "slot", "score", "ping", "name", "lastmsg", "address", "qport", "rate", "guid", "playerid", "steamid" };
+    constexpr size_t kColumnCount = sizeof(kColumnNames) / sizeof(kColumnNames[0]);
+
+    // Left-to-right column order of a player table
+    struct ColumnLayout {
+        PlayerColumn columns[10];
+        size_t count;
+
+        constexpr size_t IndexOf(PlayerColumn column) const {
+            for (size_t i = 0; i < count; ++i) {
+                if (columns[i] == column) return i;
+            }
+            return count;
+        }
+    };
+
+    // Everything that distinguishes one Quake 3 engine protocol from another. Each supported game is a constexpr
+    // instance; the handler and parsers are templates instantiated per descriptor, so layout choices are made at
+    // compile time instead of by protocol ID checks on every line.
+    struct ProtocolDescriptor {
+        int id;
+        std::string_view queryPrefix;       // Out-of-band marker, plus the direction byte some games expect
+        bool supportsGetInfo;
+        ColumnLayout statusColumns;         // getstatus player lines; the name is the quoted last column
+        ColumnLayout rconColumns;           // rcon status player lines
+        ColumnLayout steamRconColumns;      // rcon status of Steam builds; count 0 if the game has none
+        bool colorResetAfterName;           // rcon status prints ^7 after each name to reset the color
+    };
+
+    constexpr ProtocolDescriptor kMedalOfHonor = {
+        1, { "\xFF\xFF\xFF\xFF\x02", 5 }, false,
+        { { COL_SLOT, COL_NAME }, 2 },
+        { { COL_SLOT, COL_SCORE, COL_PING, COL_NAME, COL_LASTMSG, COL_ADDRESS, COL_QPORT, COL_RATE }, 8 },
+        { {}, 0 },
+        false
+    };
+
+    constexpr ProtocolDescriptor kCallOfDuty = {
+        2, { "\xFF\xFF\xFF\xFF", 4 }, true,
+        { { COL_SCORE, COL_PING, COL_NAME }, 3 },
+        { { COL_SLOT, COL_SCORE, COL_PING, COL_GUID, COL_NAME, COL_LASTMSG, COL_ADDRESS, COL_QPORT, COL_RATE }, 9 },
+        { { COL_SLOT, COL_SCORE, COL_PING, COL_PLAYERID, COL_STEAMID, COL_NAME, COL_LASTMSG, COL_ADDRESS, COL_QPORT, COL_RATE }, 10 },
+        true
+    };
+
+    // Quake III Arena and the games built on its unmodified network code (Return to Castle Wolfenstein,
+    // Wolfenstein: Enemy Territory, Jedi Knight II)
+    constexpr ProtocolDescriptor kQuake3 = {
+        3, { "\xFF\xFF\xFF\xFF", 4 }, true,
+        { { COL_SCORE, COL_PING, COL_NAME }, 3 },
+        { { COL_SLOT, COL_SCORE, COL_PING, COL_NAME, COL_LASTMSG, COL_ADDRESS, COL_QPORT, COL_RATE }, 8 },
+        { {}, 0 },
+        true
+    };
+
+    // Parses player lines from a getstatus response into slices of the packet. Columns the protocol does
+    // not report stay "0".
+    template <const ProtocolDescriptor& D>
+    StatusPlayerList ParseGetStatusPlayers(const StructuralIndex& index) {
+        constexpr size_t wanted = D.statusColumns.count;
+        static_assert(D.statusColumns.IndexOf(COL_NAME) == wanted - 1, "the quoted name must be the last getstatus column");
+
+        std::string_view response = index.Text();
+        StatusPlayerList players(ParseArena::Current());
+        players.reserve(index.Count(CHAR_NEWLINE, 0, response.size()));
+        bool inKeyValues = true;
+        size_t lineStart = 0;
+
+        while (lineStart < response.size()) {
+            size_t lineEnd = index.Next(CHAR_NEWLINE, lineStart);
+            size_t begin = lineStart;
+            lineStart = lineEnd + 1;
+            if (begin == lineEnd) {
+                inKeyValues = false;
+                continue;
+            }
+            if (inKeyValues && response[begin] == '\\') {
+                continue;
+            }
+            inKeyValues = false;
+            while (begin < lineEnd && IsSpace(response[begin])) ++begin;
+            while (lineEnd > begin && IsSpace(response[lineEnd - 1])) --lineEnd;
+            if (begin == lineEnd) {
+                continue;
+            }
+
+            // Split on spaces outside quotes; quotes stay part of the token. Only the leading fields are needed.
+            std::string_view tokens[wanted];
+            size_t tokenCount = 0;
+            size_t i = begin;
+            while (i < lineEnd && tokenCount < wanted) {
+                while (i < lineEnd && response[i] == ' ') ++i;
+                size_t start = i;
+                // Jump to the next space, or past the closing quote when a quote comes first
+                while (i < lineEnd) {
+                    size_t space = (std::min)(index.Next(CHAR_SPACE, i), lineEnd);
+                    size_t quote = index.Next(CHAR_QUOTE, i);
+                    if (quote >= space) {
+                        i = space;
+                        break;
+                    }
+                    i = (std::min)(index.Next(CHAR_QUOTE, quote + 1), lineEnd - 1) + 1;
+                }
+                if (i > start) {
+                    tokens[tokenCount++] = response.substr(start, i - start);
+                }
+            }
+            if (tokenCount < wanted) {
+                continue;
+            }
+
+            std::string_view name = tokens[wanted - 1];
+            if (name.size() < 2 || name.front() != '"' || name.back() != '"') {
+                continue;
+            }
+            StatusPlayer player = { "0", "0", "0", name.substr(1, name.size() - 2) };
+            bool valid = true;
+            for (size_t column = 0; column + 1 < wanted; ++column) {
+                switch (D.statusColumns.columns[column]) {
+                case COL_SLOT: valid = valid && IsDigits(tokens[column]); player.slot = tokens[column]; break;
+                case COL_SCORE: valid = valid && IsScore(tokens[column]); player.score = tokens[column]; break;
+                case COL_PING: valid = valid && IsDigits(tokens[column]); player.ping = tokens[column]; break;
+                default: break;
+                }
+            }
+            if (valid) {
+                players.push_back(player);
+            }
+        }
+        return players;
+    }
+
+    // Player line from an rcon status response; fields are slices of the response, indexed by PlayerColumn
+    struct RconPlayer {
+        std::string_view fields[kColumnCount];
+        unsigned columns = 0;           // Bit per PlayerColumn the server's layout reports
+
+        bool Has(PlayerColumn column) const { return (columns >> column) & 1; }
+        std::string_view operator[](PlayerColumn column) const { return fields[column]; }
+    };
+    using RconPlayerList = std::pmr::vector<RconPlayer>;
+
+    // Position of a lowercase needle in text, ignoring the case of text, or npos
+    size_t FindIgnoreCase(std::string_view text, std::string_view needle) {
+        auto it = std::search(text.begin(), text.end(), needle.begin(), needle.end(),
+            [](char c, char n) { return std::tolower(static_cast<unsigned char>(c)) == n; });
+        return it == text.end() && !needle.empty() ? std::string_view::npos : static_cast<size_t>(it - text.begin());
+    }
+
+    // Parses player data from rcon status response into slices of the response
+    template <const ProtocolDescriptor& D>
+    RconPlayerList ParseRconStatusPlayers(std::string_view response) {
+        RconPlayerList players(ParseArena::Current());
+        StructuralIndex index(response);
+        std::pmr::vector<std::string_view> lines(ParseArena::Current());
+        lines.reserve(index.Count(CHAR_NEWLINE, 0, response.size()) + 1);
+        for (size_t start = 0; start < response.size();) {
+            size_t end = index.Next(CHAR_NEWLINE, start);
+            std::string_view line = Trim(response.substr(start, end - start));
+            if (!line.empty()) {
+                lines.push_back(line);
+            }
+            start = end + 1;
+        }
+        players.reserve(lines.size());
+        bool isSteam = false;
+
+        // Determine if server is Steam-based by checking for hostname or map
+        for (std::string_view line : lines) {
+            if (D.steamRconColumns.count == 0) {
+                break;
+            }
+            if (FindIgnoreCase(line, "hostname:") == 0) {
+                isSteam = true;
+                break;
+            }
+            else if (FindIgnoreCase(line, "map:") == 0) {
+                isSteam = false;
+                break;
+            }
+            else if (FindIgnoreCase(line, "num score ping playerid steamid name") != std::string_view::npos) {
+                isSteam = true;
+                break;
+            }
+            else if (FindIgnoreCase(line, "num score ping guid name") != std::string_view::npos) {
+                isSteam = false;
+                break;
+            }
+        }
+        const ColumnLayout& layout = isSteam ? D.steamRconColumns : D.rconColumns;
+        const size_t nameField = layout.IndexOf(COL_NAME);
+        const size_t lastField = layout.count - 1;
+
+        for (std::string_view line : lines) {
+            const size_t lineOffset = static_cast<size_t>(line.data() - response.data());
+            // Skip headers
+            if (line.find("map:") != std::string_view::npos ||
+                line.find("num score ping") != std::string_view::npos ||
+                line.find("----") != std::string_view::npos ||
+                line.find("hostname:") != std::string_view::npos ||
+                line.find("version :") != std::string_view::npos ||
+                line.find("udp/ip  :") != std::string_view::npos ||
+                line.find("os      :") != std::string_view::npos ||
+                line.find("type    :") != std::string_view::npos) {
+                continue;
+            }
+            // Tokenize space-separated fields; a field being read is the slice [tokenStart, i)
+            std::string_view tokens[kColumnCount];
+            size_t tokenCount = 0;
+            auto addToken = [&](std::string_view token) {
+                if (tokenCount < kColumnCount) tokens[tokenCount++] = token;
+            };
+            auto trimRight = [](std::string_view token) {
+                while (!token.empty() && token.back() == ' ') token.remove_suffix(1);
+                return token;
+            };
+            size_t tokenStart = std::string_view::npos;
+            size_t i = 0;
+            size_t fieldCount = 0;
+
+            while (i < line.size()) {
+                // Handle name field
+                if (fieldCount == nameField) {
+                    size_t nextField = i;
+                    size_t lastCaret7 = std::string_view::npos;
+                    // Find last ^7 before numeric lastmsg
+                    while (nextField < line.size()) {
+                        size_t numStart = nextField;
+                        while (numStart < line.size() && line[numStart] == ' ') numStart++;
+                        size_t numEnd = (std::min)(index.Next(CHAR_SPACE, lineOffset + numStart) - lineOffset, line.size());
+                        std::string_view maybeNumber = line.substr(numStart, numEnd - numStart);
+                        if (!maybeNumber.empty() && IsDigits(maybeNumber)) {
+                            break;
+                        }
+                        if (D.colorResetAfterName && numStart >= 2 && line[numStart - 2] == '^' && line[numStart - 1] == '7') {
+                            lastCaret7 = numStart - 2;
+                        }
+                        nextField = numEnd + 1;
+                    }
+                    if (D.colorResetAfterName && lastCaret7 != std::string_view::npos && lastCaret7 >= i) {
+                        nextField = lastCaret7 + 2;
+                        while (nextField < line.size() && line[nextField] == ' ') nextField++;
+                    }
+                    addToken(trimRight(line.substr(i, nextField - i)));
+                    tokenStart = std::string_view::npos;
+                    fieldCount++;
+                    i = nextField;
+                    while (i < line.size() && line[i] == ' ') i++;
+                    continue;
+                }
+                // Handle other fields
+                if (line[i] == ' ' && tokenStart != std::string_view::npos) {
+                    addToken(line.substr(tokenStart, i - tokenStart));
+                    tokenStart = std::string_view::npos;
+                    fieldCount++;
+                    i++;
+                    while (i < line.size() && line[i] == ' ') i++;
+                    continue;
+                }
+                // Capture last field
+                if (fieldCount == lastField) {
+                    std::string_view token = trimRight(line.substr(i));
+                    if (!token.empty()) {
+                        addToken(token);
+                    }
+                    break;
+                }
+                // Take the rest of the field in one step
+                size_t fieldEnd = (std::min)(index.Next(CHAR_SPACE, lineOffset + i) - lineOffset, line.size());
+                fieldEnd = (std::max)(fieldEnd, i + 1);
+                if (tokenStart == std::string_view::npos) {
+                    tokenStart = i;
+                }
+                i = fieldEnd;
+            }
+            if (tokenStart != std::string_view::npos) {
+                addToken(line.substr(tokenStart, i - tokenStart));
+            }
+            if (tokenCount < layout.count) {
+                continue;
+            }
+            RconPlayer player;
+            for (size_t column = 0; column < layout.count; ++column) {
+                player.fields[layout.columns[column]] = tokens[column];
+                player.columns |= 1u << layout.columns[column];
+            }
+            if (IsDigits(player[COL_SLOT]) && IsScore(player[COL_SCORE]) && IsDigits(player[COL_PING])) {
+                players.push_back(player);
+            }
+        }
+        return players;
+    }
+
+    // Hand the players of the observed reply to the player index and the history store. The overload taking
+    // the structural index looks the map up in its settings line, and the overloads taking text parse it first,
+    // for output modes that skip the players. All of them do nothing when no observed reply is being parsed or
+    // neither consumer is enabled.
+    void ObserveStatus(std::string_view map, const StatusPlayerList& players);
+    void ObserveStatus(const StructuralIndex& index, const StatusPlayerList& players);
+    void ObserveStatus(std::string_view body);
+    void ObserveRconStatus(const RconPlayerList& players);
+    void ObserveRconStatus(std::string_view text);
+
+    // Server settings and player columns a caller asked for. Everything else is skipped while parsing and
+    // never written out. Setting names are slices of the caller's field list.
+    struct Projection {
+        static constexpr size_t kCleanName = kColumnCount;  // Column index of clean_name, after the PlayerColumn values
+
+        explicit Projection(std::pmr::memory_resource* memory) : keys(memory), columns(memory), spec(memory) {}
+
+        std::pmr::vector<std::string_view> keys;    // Server settings, in output order
+        std::pmr::vector<size_t> columns;           // Player columns (PlayerColumn or kCleanName), in output order
+        bool playerCount = false;                   // Write "player_count"
+        std::pmr::string spec;                      // Normalized field list, part of the response cache key
+
+        bool WantsPlayers() const { return playerCount || !columns.empty(); }
+
+        // Projection applied to parses on this thread, or null for full output
+        static const Projection* Current() { return active; }
+
+    private:
+        friend class ProjectionScope;
+        static inline thread_local const Projection* active = nullptr;
+    };
+
+    // Applies a projection to every parse on this thread while it is alive
+    class ProjectionScope {
+    public:
+        explicit ProjectionScope(const Projection* projection) : previous(Projection::active) { Projection::active = projection; }
+        ~ProjectionScope() { Projection::active = previous; }
+        ProjectionScope(const ProjectionScope&) = delete;
+        ProjectionScope& operator=(const ProjectionScope&) = delete;
+
+    private:
+        const Projection* previous;
+    };
+
+    // Reads a comma-separated field list: server setting names, "players.<column>" for player columns and
+    // "players.count" for the player count. Returns false if the list is empty or names an unknown column.
+    bool ParseProjection(std::string_view fields, Projection& out) {
+        while (!fields.empty()) {
+            size_t comma = fields.find(',');
+            std::string_view field = Trim(fields.substr(0, comma));
+            fields = comma == std::string_view::npos ? std::string_view() : fields.substr(comma + 1);
+            if (field.empty()) {
+                continue;
+            }
+            if (field.compare(0, 8, "players.") == 0) {
+                std::string_view column = field.substr(8);
+                if (column == "count") {
+                    out.playerCount = true;
+                }
+                else if (column == "clean_name") {
+                    out.columns.push_back(Projection::kCleanName);
+                }
+                else {
+                    size_t index = 0;
+                    while (index < kColumnCount && column != kColumnNames[index]) ++index;
+                    if (index == kColumnCount) {
+                        return false;
+                    }
+                    out.columns.push_back(index);
+                }
+            }
+            else {
+                out.keys.push_back(field);
+            }
+            if (!out.spec.empty()) out.spec += ',';
+            out.spec.append(field.data(), field.size());
+        }
+        return !out.spec.empty();
+    }
+
+    // Writes the projected settings and player data of a getstatus/getinfo body. Only the settings line is
+    // indexed when no player data is wanted, and settings that were not asked for are skipped unstored.
+    template <const ProtocolDescriptor& D>
+    std::string ProjectedStatusToJson(std::string_view body, const Projection& projection) {
+        size_t first = body.find_first_not_of('\n');
+        size_t settingsEnd = first == std::string_view::npos ? body.size() : (std::min)(body.find('\n', first), body.size());
+        StructuralIndex index(projection.WantsPlayers() ? body : body.substr(0, settingsEnd));
+        if (!projection.WantsPlayers()) {
+            ObserveStatus(body);
+        }
+
+        JsonTimer timer;
+        std::string result = TakeSpareString();
+        JsonWriter json(result);
+        json.BeginObject();
+        if (!projection.keys.empty()) {
+            std::pmr::vector<const char*> values(projection.keys.size(), nullptr, ParseArena::Current());
+            std::pmr::vector<size_t> lengths(projection.keys.size(), 0, ParseArena::Current());
+            ForEachKeyValue(index, [&](std::string_view key, std::string_view value) {
+                for (size_t i = 0; i < projection.keys.size(); ++i) {
+                    if (projection.keys[i] == key) {
+                        values[i] = value.data();
+                        lengths[i] = value.size();
+                    }
+                }
+            });
+            json.Key("server").BeginObject();
+            for (size_t i = 0; i < projection.keys.size(); ++i) {
+                if (values[i]) json.Member(projection.keys[i], std::string_view(values[i], lengths[i]));
+            }
+            json.EndObject();
+        }
+        if (projection.WantsPlayers()) {
+            StatusPlayerList players = ParseGetStatusPlayers<D>(index);
+            ObserveStatus(index, players);
+            if (!projection.columns.empty()) {
+                json.Key("players").BeginArray();
+                for (const StatusPlayer& player : players) {
+                    json.BeginObject();
+                    for (size_t column : projection.columns) {
+                        switch (column) {
+                        case COL_SLOT: json.Member("slot", player.slot); break;
+                        case COL_SCORE: json.Member("score", player.score); break;
+                        case COL_PING: json.Member("ping", player.ping); break;
+                        case COL_NAME: json.Member("name", player.name); break;
+                        case Projection::kCleanName: json.Member("clean_name", StripColorCodes(player.name)); break;
+                        default: break;     // Not reported by getstatus
+                        }
+                    }
+                    json.EndObject();
+                }
+                json.EndArray();
+            }
+            if (projection.playerCount) {
+                json.Key("player_count").Number(players.size());
+            }
+        }
+        json.EndObject();
+        return result;
+    }
+
+    // Writes the projected columns and count of rcon status players
+    std::string ProjectedRconPlayersToJson(const RconPlayerList& players, const Projection& projection) {
+        JsonTimer timer;
+        std::string result = TakeSpareString();
+        JsonWriter json(result);
+        json.BeginObject();
+        if (!projection.columns.empty()) {
+            json.Key("players").BeginArray();
+            for (const RconPlayer& player : players) {
+                json.BeginObject();
+                for (size_t column : projection.columns) {
+                    if (column == Projection::kCleanName) {
+                        json.Member("clean_name", StripColorCodes(player[COL_NAME]));
+                    }
+                    else if (player.Has(static_cast<PlayerColumn>(column))) {
+                        json.Member(kColumnNames[column], player[static_cast<PlayerColumn>(column)]);
+                    }
+                }
+                json.EndObject();
+            }
+            json.EndArray();
+        }
+        if (projection.playerCount) {
+            json.Key("player_count").Number(players.size());
+        }
+        json.EndObject();
+        return result;
+    }
+
+    // Converts key-value pairs and player data to JSON format
+    std::string ToJson(const KeyValueList& kv, const StatusPlayerList& players) {
+        JsonTimer timer;
+        std::string result = TakeSpareString();
+        result.reserve(64 + kv.size() * 40 + players.size() * 72);
+        JsonWriter json(result);
+        json.BeginObject().Key("server").BeginObject();
+        for (const auto& pair : kv) {
+            json.Member(pair.first, pair.second);
+        }
+        json.EndObject().Key("players").BeginArray();
+        for (const auto& player : players) {
+            json.BeginObject()
+                .Member("slot", player.slot)
+                .Member("score", player.score)
+                .Member("ping", player.ping)
+                .Member("name", player.name);
+            if (cleanNames) {
+                json.Member("clean_name", StripColorCodes(player.name));
+            }
+            json.EndObject();
+        }
+        json.EndArray().EndObject();
+        return result;
+    }
+
+    // Converts rcon status player data to JSON format
+    std::string RconPlayersToJson(const RconPlayerList& players) {
+        JsonTimer timer;
+        static const PlayerColumn optionalFields[] = { COL_GUID, COL_PLAYERID, COL_STEAMID };
+        std::string result = TakeSpareString();
+        result.reserve(32 + players.size() * 160);
+        JsonWriter json(result);
+        json.BeginObject().Key("players").BeginArray();
+        for (const auto& player : players) {
+            json.BeginObject()
+                .Member("slot", player[COL_SLOT])
+                .Member("score", player[COL_SCORE])
+                .Member("ping", player[COL_PING])
+                .Member("name", player[COL_NAME]);
+            if (cleanNames) {
+                json.Member("clean_name", StripColorCodes(player[COL_NAME]));
+            }
+            json.Member("lastmsg", player[COL_LASTMSG])
+                .Member("address", player[COL_ADDRESS])
+                .Member("qport", player[COL_QPORT])
+                .Member("rate", player[COL_RATE]);
+            for (PlayerColumn field : optionalFields) {
+                if (player.Has(field)) json.Member(kColumnNames[field], player[field]);
+            }
+            json.EndObject();
+        }
+        json.EndArray().EndObject();
+        return result;
+    }
+
+    // Wraps a free-form rcon reply as {"response":"..."}
+    std::string RconTextToJson(std::string_view text) {
+        JsonTimer timer;
+        std::string result = TakeSpareString();
+        result.reserve(text.size() + 16);
+        JsonWriter(result).BeginObject().Member("response", text).EndObject();
+        return result;
+    }
+
+    // Reports a map change as {"status":"success","message":"Map changed to ..."}
+    std::string MapChangeToJson(std::string_view map) {
+        JsonTimer timer;
+        std::string result;
+        JsonWriter(result).BeginObject().Member("status", "success").Member("message", "Map changed to " + std::string(map)).EndObject();
+        return result;
+    }
+
+    // Handler for one Quake 3 engine protocol, specialized at compile time by its descriptor
+    template <const ProtocolDescriptor& D>
+    class Quake3Handler final : public ProtocolHandler {
+    public:
+        std::string BuildQuery(const std::string& cmd, const std::string& rconPassword, std::string& query) override {
+            query.assign(D.queryPrefix.data(), D.queryPrefix.size());
+            if (cmd == "getstatus" || (D.supportsGetInfo && cmd == "getinfo")) {
+                query += cmd;
+            }
+            else if (cmd.find("rcon ") == 0) {
+                query.append("rcon \"").append(rconPassword).append("\" ").append(cmd, 5, std::string::npos);
+            }
+            else {
+                query.clear();
+                return "error=Invalid command";
+            }
+            return "";
+        }
+
+        std::string ParseResponse(bool raw, const std::string& cmd, std::string response) override {
+            if (cmd.find("rcon map ") == 0) {
+                return MapChangeToJson(std::string_view(cmd).substr(9));
+            }
+            if (response.find("error=") == 0 || response.empty()) {
+                return response.empty() ? "error=Empty response from server" : response;
+            }
+
+            if (cmd == "getstatus" || (D.supportsGetInfo && cmd == "getinfo")) {
+                size_t header = ResponseHeaderLength(response, cmd == "getinfo" ? "infoResponse" : "statusResponse");
+                if (header == 0) {
+                    return "error=Invalid server response;raw=" + response;
+                }
+                std::string_view body = std::string_view(response).substr(header);
+                if (body.empty()) {
+                    return "error=Empty response after header removal;raw=";
+                }
+                if (raw) {
+                    ObserveStatus(body);
+                    return std::string(body);
+                }
+                std::string result;
+                if (const Projection* projection = Projection::Current()) {
+                    result = ProjectedStatusToJson<D>(body, *projection);
+                }
+                else {
+                    StructuralIndex index(body);
+                    KeyValueList settings = ParseKeyValues(index);
+                    StatusPlayerList players = ParseGetStatusPlayers<D>(index);
+                    ObserveStatus(FindKeyValue(settings, "mapname"), players);
+                    result = ToJson(settings, players);
+                }
+                KeepSpareString(std::move(response));
+                return result;
+            }
+            else if (cmd.find("rcon ") == 0) {
+                size_t header = ResponseHeaderLength(response, "print");
+                if (header == 0) {
+                    return "error=Invalid server response;raw=" + response;
+                }
+                response.erase(0, header);
+                if (response.empty()) {
+                    return "error=Empty response after header removal;raw=" + response;
+                }
+                if (cmd == "rcon status") {
+                    if (raw) {
+                        ObserveRconStatus(response);
+                        return response;
+                    }
+                    RconPlayerList players = ParseRconStatusPlayers<D>(response);
+                    ObserveRconStatus(players);
+                    const Projection* projection = Projection::Current();
+                    std::string result = projection ? ProjectedRconPlayersToJson(players, *projection) : RconPlayersToJson(players);
+                    KeepSpareString(std::move(response));
+                    return result;
+                }
+                else {
+                    response.erase(0, response.find_first_not_of("\n")); // Trim leading newlines
+                    if (raw) {
+                        return response;
+                    }
+                    std::string result = RconTextToJson(response);
+                    KeepSpareString(std::move(response));
+                    return result;
+                }
+            }
+            return "error=Unsupported command";
+        }
+    };
+
+    // Handler and parsers of a registered protocol, for callers that only know the protocol ID at run time
+    struct ProtocolEntry {
+        ProtocolHandler* handler = nullptr;
+        StatusPlayerList (*statusPlayers)(const StructuralIndex&) = nullptr;
+        RconPlayerList (*rconPlayers)(std::string_view) = nullptr;
+        bool statusSlots = false;   // getstatus player lines carry the client slot
+        bool statusPings = false;   // getstatus player lines carry the ping
+    };
+
+    // Dispatch table indexed by protocol ID
+    constexpr int kMaxProtocolId = 15;
+    ProtocolEntry protocolTable[kMaxProtocolId + 1];
+
+    template <const ProtocolDescriptor& D>
+    void RegisterProtocol() {
+        static_assert(D.id > 0 && D.id <= kMaxProtocolId, "protocol ID out of range");
+        static Quake3Handler<D> handler;
+        protocolTable[D.id] = { &handler, &ParseGetStatusPlayers<D>, &ParseRconStatusPlayers<D>,
+            D.statusColumns.IndexOf(COL_SLOT) < D.statusColumns.count, D.statusColumns.IndexOf(COL_PING) < D.statusColumns.count };
+    }
+
+    // Fills the dispatch table; adding a Quake 3 variant takes a descriptor and one line here
+    struct ProtocolInitializer {
+        ProtocolInitializer() {
+            RegisterProtocol<kMedalOfHonor>();
+            RegisterProtocol<kCallOfDuty>();
+            RegisterProtocol<kQuake3>();
+        }
+    } initializer;
+
+    // Returns the handler registered for a protocol ID, or null
+    ProtocolHandler* HandlerFor(int protocolId) {
+        return protocolId > 0 && protocolId <= kMaxProtocolId ? protocolTable[protocolId].handler : nullptr;
+    }
+
+    // Returns the ID a handler is registered under, or 0 if it is not registered
+    int ProtocolIdOf(const ProtocolHandler* handler) {
+        for (int id = 1; id <= kMaxProtocolId; ++id) {
+            if (protocolTable[id].handler == handler) {
+                return id;
+            }
+        }
+        return 0;
+    }
+
+    StatusPlayerList ParseGetStatusPlayers(const StructuralIndex& index, int protocolId) {
+        return HandlerFor(protocolId) ? protocolTable[protocolId].statusPlayers(index) : StatusPlayerList(ParseArena::Current());
+    }
+
+    StatusPlayerList ParseGetStatusPlayers(std::string_view response, int protocolId) {
+        return ParseGetStatusPlayers(StructuralIndex(response), protocolId);
+    }
+
+    RconPlayerList ParseRconStatusPlayers(std::string_view response, int protocolId) {
+        return HandlerFor(protocolId) ? protocolTable[protocolId].rconPlayers(response) : RconPlayerList(ParseArena::Current());
+    }
+}
+
+// Builds the query, sends it and parses the reply using the protocol-specific steps
+std::string ProtocolHandler::ProcessCommand(bool raw, const std::string& ip, int port, const std::string& command, const std::string& rconPassword) {
+    std::string query = TakeSpareString();
+    std::string cmd = SanitizeCommand(command);
+    std::string error = BuildQuery(cmd, rconPassword, query);
+    if (!error.empty()) {
+        return error;
+    }
+    int protocolId = ProtocolIdOf(this);
+    std::string response;
+    auto sent = Clock::now();
+    {
+        PhaseTimer timer(protocolId, PHASE_NETWORK);
+        response = ExchangeUDPQuery(ip, port, query, AdaptiveTimeoutMs(ip, port, QueryTimeoutMs(cmd)),
+            IsMultiPacketCommand(cmd) ? (std::max)(1, quietPeriodMs.load()) : 0, IsIdempotentCommand(cmd) ? maxRetransmits.load() : 0);
+    }
+    auto rtt = Clock::now() - sent;
+    KeepSpareString(std::move(query));
+    return TimedParse(this, protocolId, raw, cmd, std::move(response), EndpointKey(ip, port), rtt);
+}
+
+namespace {
+    // How long failed lookups are remembered before the hostname is tried again
+    std::atomic<int> dnsNegativeTtlMs{ 30000 };
+
+    // DNS cache with a shared-lock read path. Lookups for the same hostname are deduplicated, failures are
+    // cached for a shorter TTL, and entries used late in their 5-minute TTL are re-resolved in the background
+    // so frequently queried hostnames never wait on getaddrinfo.
+    class DnsCache {
+    public:
+        // Receives the address, or an "error=" string, of a lookup finished on the background thread
+        using ResolvedFn = std::function<void(const std::string& result)>;
+
+        ~DnsCache() { Stop(); }
+
+        std::string Resolve(const std::string& hostname) {
+            std::string result;
+            if (Cached(hostname, result)) {
+                return result;
+            }
+            ++metrics.dnsMisses;
+            return ResolveOnce(hostname);
+        }
+
+        // Answers from the cache without blocking: sets result to the address, or the cached failure, and
+        // returns true; returns false if the hostname has to be looked up
+        bool Cached(const std::string& hostname, std::string& result) {
+            // Numeric addresses need no lookup
+            in_addr numeric;
+            if (inet_pton(AF_INET, hostname.c_str(), &numeric) == 1) {
+                result = hostname;
+                return true;
+            }
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto it = entries.find(hostname);
+            if (it == entries.end()) {
+                return false;
+            }
+            DnsCacheEntry& entry = it->second;
+            auto age = std::chrono::steady_clock::now() - entry.timestamp;
+            if (!entry.ip.empty() && age < kTtl) {
+                ++metrics.dnsHits;
+                if (age >= kRefreshAhead && !entry.refreshing.exchange(true)) {
+                    ScheduleRefresh(hostname, nullptr);
+                }
+                result = entry.ip;
+                return true;
+            }
+            if (entry.ip.empty() && age < std::chrono::milliseconds(dnsNegativeTtlMs.load())) {
+                ++metrics.dnsHits;
+                result = "error=Failed to resolve hostname";
+                return true;
+            }
+            return false;
+        }
+
+        // Looks a hostname up on the background thread and passes the result to done there, so callers that
+        // must not block (the asynchronous reactor, the watch timer) never wait on getaddrinfo
+        void ResolveAsync(const std::string& hostname, ResolvedFn done) {
+            ++metrics.dnsMisses;
+            ScheduleRefresh(hostname, std::move(done));
+        }
+
+        // Stops the background thread; lookups still queued complete with "error=Cancelled"
+        void Stop() {
+            std::deque<Refresh> dropped;
+            {
+                std::lock_guard<std::mutex> lock(refreshMutex);
+                if (!refreshThread.joinable()) {
+                    return;
+                }
+                refreshStopping = true;
+            }
+            refreshWake.notify_all();
+            refreshThread.join();
+            {
+                std::lock_guard<std::mutex> lock(refreshMutex);
+                refreshStopping = false;
+                dropped.swap(refreshQueue);
+            }
+            for (Refresh& refresh : dropped) {
+                if (refresh.done) refresh.done("error=Cancelled");
+            }
+        }
+
+    private:
+        static constexpr std::chrono::minutes kTtl{ 5 };
+        static constexpr std::chrono::minutes kRefreshAhead{ 4 };
+
+        // DNS cache entry; an empty ip records a failed lookup
+        struct DnsCacheEntry {
+            std::string ip;
+            std::chrono::steady_clock::time_point timestamp;
+            std::atomic<bool> refreshing{ false };
+        };
+
+        struct Flight {
+            bool finished = false;
+            std::string result;
+        };
+
+        // Hostname queued for the background thread; done is set for a lookup a caller waits on, and empty
+        // for a refresh ahead of expiry
+        struct Refresh {
+            std::string hostname;
+            ResolvedFn done;
+        };
+
+        // Resolves synchronously; concurrent callers for the same hostname share one lookup
+        std::string ResolveOnce(const std::string& hostname) {
+            std::unique_lock<std::mutex> lock(flightMutex);
+            auto running = inFlight.find(hostname);
+            if (running != inFlight.end()) {
+                std::shared_ptr<Flight> flight = running->second;
+                flightDone.wait(lock, [&flight]() { return flight->finished; });
+                return flight->result;
+            }
+            auto flight = std::make_shared<Flight>();
+            inFlight[hostname] = flight;
+            lock.unlock();
+
+            std::string ip = Lookup(hostname);
+            if (ip.find("error=Winsock") != 0) {
+                Store(hostname, ip);
+            }
+
+            lock.lock();
+            flight->result = ip.empty() ? "error=Failed to resolve hostname" : ip;
+            flight->finished = true;
+            inFlight.erase(hostname);
+            lock.unlock();
+            flightDone.notify_all();
+            return flight->result;
+        }
+
+        void Store(const std::string& hostname, const std::string& ip) {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            DnsCacheEntry& entry = entries[hostname];
+            entry.ip = ip;
+            entry.timestamp = std::chrono::steady_clock::now();
+            entry.refreshing = false;
+        }
+
+        // Runs getaddrinfo without holding any cache lock; returns the first IPv4 address, or empty on failure
+        static std::string Lookup(const std::string& hostname) {
+            NetworkScope network;
+            if (!network.ok) {
+                return "error=Winsock initialization failed";
+            }
+
+            addrinfo hints = { 0 };
+            hints.ai_family = AF_INET;
+            hints.ai_socktype = SOCK_DGRAM;
+            addrinfo* result = nullptr;
+            if (getaddrinfo(hostname.c_str(), nullptr, &hints, &result) != 0) {
+                return "";
+            }
+
+            std::string ip;
+            for (addrinfo* ptr = result; ptr != nullptr; ptr = ptr->ai_next) {
+                char ipStr[INET_ADDRSTRLEN];
+                auto* sa = (sockaddr_in*)ptr->ai_addr;
+                inet_ntop(AF_INET, &sa->sin_addr, ipStr, sizeof(ipStr));
+                ip = ipStr;
+                break;
+            }
+            freeaddrinfo(result);
+            return ip;
+        }
+
+        // Queues a background lookup, starting the refresh thread on first use
+        void ScheduleRefresh(const std::string& hostname, ResolvedFn done) {
+            {
+                std::lock_guard<std::mutex> lock(refreshMutex);
+                refreshQueue.push_back({ hostname, std::move(done) });
+                if (!refreshThread.joinable()) {
+                    refreshThread = std::thread([this]() { RunRefresh(); });
+                }
+            }
+            refreshWake.notify_one();
+        }
+
+        void RunRefresh() {
+            std::unique_lock<std::mutex> lock(refreshMutex);
+            for (;;) {
+                refreshWake.wait(lock, [this]() { return refreshStopping || !refreshQueue.empty(); });
+                if (refreshStopping) {
+                    return;
+                }
+                Refresh refresh = std::move(refreshQueue.front());
+                refreshQueue.pop_front();
+                lock.unlock();
+
+                if (refresh.done) {
+                    std::string result = ResolveOnce(refresh.hostname);
+                    try {
+                        refresh.done(result);
+                    }
+                    catch (...) {
+                        // Exceptions must not unwind through the refresh thread
+                    }
+                    lock.lock();
+                    continue;
+                }
+                const std::string& hostname = refresh.hostname;
+                std::string ip = Lookup(hostname);
+                if (!ip.empty() && ip.find("error=") != 0) {
+                    Store(hostname, ip);
+                }
+                else {
+                    // Keep serving the last good address until it expires; a later use retries the refresh
+                    std::shared_lock<std::shared_mutex> readLock(mutex);
+                    auto it = entries.find(hostname);
+                    if (it != entries.end()) {
+                        it->second.refreshing = false;
+                    }
+                }
+                lock.lock();
+            }
+        }
+
+        std::shared_mutex mutex;
+        std::unordered_map<std::string, DnsCacheEntry> entries;
+
+        std::mutex flightMutex;
+        std::condition_variable flightDone;
+        std::unordered_map<std::string, std::shared_ptr<Flight>> inFlight;
+
+        std::mutex refreshMutex;
+        std::condition_variable refreshWake;
+        std::deque<Refresh> refreshQueue;
+        std::thread refreshThread;
+        bool refreshStopping = false;
+    } dnsCache;
+}
+
+// Resolves hostname to IP address with DNS caching
+std::string ResolveHostname(const std::string& hostname) {
+    return dnsCache.Resolve(hostname);
+}
+
+namespace {
+    // Sends a query and receives the reply; with quietMs > 0 keeps collecting packets until the line goes quiet.
+    // Up to retransmits extra copies are sent whenever the endpoint's retransmit timeout passes without a reply.
+    std::string ExchangeUDPQuery(const std::string& ip, int port, const std::string& query, int timeoutMs, int quietMs, int retransmits) {
+        ScopedQuerySocket scoped;
+        if (!scoped.network.ok) {
+            return "error=Winsock initialization failed";
+        }
+        SOCKET sock = scoped.sock;
+        if (sock == INVALID_SOCKET) {
+            return "error=Socket creation failed";
+        }
+
+        sockaddr_in server;
+        server.sin_family = AF_INET;
+        server.sin_port = htons(static_cast<u_short>(port));
+        if (inet_pton(AF_INET, ip.c_str(), &server.sin_addr) <= 0) {
+            return "error=Invalid IP address";
+        }
+        uint64_t key = EndpointKey(server);
+        std::string_view expected = ExpectedReplyKeyword(query);
+
+        ++metrics.queries;
+        int sends = 0;
+        Clock::time_point sentAt;
+        auto transmit = [&]() {
+            ++metrics.sendCalls;
+            if (sendto(sock, query.c_str(), static_cast<int>(query.size()), 0, (sockaddr*)&server, sizeof(server)) == SOCKET_ERROR) {
+                ++metrics.sendErrors;
+                scoped.reusable = false;
+                return false;
+            }
+            metrics.bytesOut += query.size();
+            sentAt = Clock::now();
+            ++sends;
+            return true;
+        };
+        if (!transmit()) {
+            return "error=Send failed";
+        }
+
+        // Pooled sockets are unconnected, so ignore datagrams that did not come from the queried server
+        char buffer[4096];
+        std::string response = TakeSpareString();
+        auto rto = rttEstimator.Rto(key);
+        auto deadline = sentAt + std::chrono::milliseconds(timeoutMs);
+        Clock::time_point lastPacketAt;
+        for (;;) {
+            auto now = Clock::now();
+            Clock::time_point wakeAt = deadline;
+            if (!response.empty()) {
+                wakeAt = (std::min)(deadline, lastPacketAt + std::chrono::milliseconds(quietMs));
+            }
+            else if (sends <= retransmits) {
+                wakeAt = (std::min)(deadline, sentAt + rto);
+            }
+            if (now >= wakeAt) {
+                // After the first packet this means the quiet period passed and the reply is complete
+                if (!response.empty()) {
+                    return response;
+                }
+                rttEstimator.Backoff(key);
+                if (now >= deadline) {
+                    ++metrics.timeouts;
+                    return "error=Receive failed";
+                }
+                rto = (std::min)(rto * 2, std::chrono::milliseconds(RttEstimator::kMaxRtoMs));
+                ++metrics.retransmits;
+                if (!transmit()) {
+                    return "error=Send failed";
+                }
+                continue;
+            }
+
+            SetReceiveTimeout(sock, static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(wakeAt - now).count()) + 1);
+            sockaddr_in from;
+            socklen_t addrLen = sizeof(from);
+            ++metrics.receiveCalls;
+            int bytesReceived = recvfrom(sock, buffer, sizeof(buffer) - 1, 0, (sockaddr*)&from, &addrLen);
+            if (bytesReceived == SOCKET_ERROR) {
+                int error = WSAGetLastError();
+                if (error == WSAETIMEDOUT || error == WSAEWOULDBLOCK) {
+                    continue;
+                }
+                if (response.empty()) {
+                    ++metrics.receiveErrors;
+                    return "error=Receive failed";
+                }
+                return response;
+            }
+            metrics.bytesIn += bytesReceived;
+            if (from.sin_addr.s_addr != server.sin_addr.s_addr || from.sin_port != server.sin_port) {
+                continue;
+            }
+            // A late duplicate answering an earlier query on this socket is not our reply
+            if (response.empty() && !expected.empty() && ResponseHeaderLength(std::string_view(buffer, bytesReceived), expected) == 0) {
+                continue;
+            }
+            lastPacketAt = Clock::now();
+            if (response.empty() && sends == 1) {
+                rttEstimator.Sample(key, lastPacketAt - sentAt);
+            }
+            AppendResponsePacket(response, buffer, static_cast<size_t>(bytesReceived));
+            if (quietMs <= 0) {
+                return response;
+            }
+        }
+    }
+}
+
+// Sends UDP query to game server and returns response
+std::string SendUDPQuery(const std::string& ip, int port, const std::string& query, int timeoutMs) {
+    return ExchangeUDPQuery(ip, port, query, timeoutMs, 0, 0);
+}
+
+// Sends UDP query and joins every reply packet until the server stops sending for quietMs
+std::string SendUDPQueryMultiPacket(const std::string& ip, int port, const std::string& query, int timeoutMs, int quietMs) {
+    return ExchangeUDPQuery(ip, port, query, timeoutMs, quietMs > 0 ? quietMs : 1, 0);
+}
+
+namespace {
+    // Drives many queries over one non-blocking UDP socket. Replies are matched to queries by source endpoint,
+    // and only the oldest query per endpoint is in flight so a reply can never be attributed to the wrong query.
+    class QueryMultiplexer {
+    public:
+        // A prepared query: protocol handler, packet, destination and the time by which it must complete
+        struct Query {
+            ProtocolHandler* handler = nullptr;
+            bool raw = false;
+            std::string cmd;
+            std::string query;
+            sockaddr_in server = {};
+            Clock::time_point deadline;
+            Clock::duration replyTimeout{};     // If set, the deadline is moved to this long after the packet is sent
+            Clock::duration minSpacing{};       // Least time between paced sends to the same endpoint
+            std::string_view expected;          // Reply keyword checked before the first packet is accepted; derived from the packet if empty
+            bool unparsed = false;              // Deliver the reply packets as received instead of the handler's result
+        };
+
+        // Receives each finished query: its id, whether the server replied, and the parsed result
+        using CompletionFn = std::function<void(uint64_t id, bool replied, const std::string& result)>;
+
+        explicit QueryMultiplexer(CompletionFn onComplete) : onComplete(std::move(onComplete)) {}
+        ~QueryMultiplexer() { Close(); }
+        QueryMultiplexer(const QueryMultiplexer&) = delete;
+        QueryMultiplexer& operator=(const QueryMultiplexer&) = delete;
+
+        // Opens the shared socket; Winsock must already be started by the caller
+        bool Open() {
+            sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+            if (sock == INVALID_SOCKET) {
+                return false;
+            }
+            SetNonBlocking(sock);
+            // Replies from hundreds of servers can arrive in a burst; give the kernel room to queue them
+            int recvBufferSize = 1 << 20;
+            setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char*)&recvBufferSize, sizeof(recvBufferSize));
+            // Bind up front so the socket has a known port that Wake() can send to
+            sockaddr_in local = {};
+            local.sin_family = AF_INET;
+            local.sin_addr.s_addr = htonl(INADDR_ANY);
+            socklen_t localLen = sizeof(local);
+            if (bind(sock, (sockaddr*)&local, sizeof(local)) == SOCKET_ERROR ||
+                getsockname(sock, (sockaddr*)&local, &localLen) == SOCKET_ERROR) {
+                Close();
+                return false;
+            }
+            wakeAddress = local;
+            inet_pton(AF_INET, "127.0.0.1", &wakeAddress.sin_addr);
+            return true;
+        }
+
+        void Close() {
+            if (sock != INVALID_SOCKET) {
+                closesocket(sock);
+                sock = INVALID_SOCKET;
+            }
+        }
+
+        // Queues a query; its packet goes out with the next Poll unless another query to the same endpoint is in flight
+        void Add(uint64_t id, Query query) {
+            Entry& entry = entries[id];
+            static_cast<Query&>(entry) = std::move(query);
+            entry.multiPacket = IsMultiPacketCommand(entry.cmd);
+            entry.retransmitsLeft = IsIdempotentCommand(entry.cmd) ? maxRetransmits.load() : 0;
+            if (entry.expected.empty()) {
+                entry.expected = ExpectedReplyKeyword(entry.query);
+            }
+            entry.protocolId = ProtocolIdOf(entry.handler);
+            entry.queuedAt = Clock::now();
+            SetTimer(id, entry, entry.deadline);
+            uint64_t key = EndpointKey(entry.server);
+            auto& queue = endpoints[key];
+            queue.push_back(id);
+            if (queue.size() == 1) {
+                SendFront(key);
+            }
+            Flush();
+        }
+
+        // Finishes a pending query with the given error; returns false if it already completed
+        bool Cancel(uint64_t id, const std::string& reason) {
+            if (entries.find(id) == entries.end()) {
+                return false;
+            }
+            Complete(id, reason);
+            Flush();
+            return true;
+        }
+
+        // Finishes every pending query with the given error
+        void CancelAll(const std::string& reason) {
+            while (!entries.empty()) {
+                Complete(entries.begin()->first, reason);
+            }
+            Flush();
+        }
+
+        // Interrupts a Poll() running on another thread
+        void Wake() {
+            if (sock != INVALID_SOCKET) {
+                sendto(sock, "", 0, 0, (sockaddr*)&wakeAddress, sizeof(wakeAddress));
+            }
+        }
+
+        // Waits for replies until wakeBy, the next query timer or a Wake(), then delivers finished queries.
+        // A caller-owned socket passed as watch is waited on too; returns true if it became readable.
+        bool Poll(Clock::time_point wakeBy, SOCKET watch = INVALID_SOCKET) {
+            auto now = Clock::now();
+            ExpireTimers(now);
+            SendQueued();
+            if (!timers.empty()) {
+                wakeBy = (std::min)(wakeBy, timers.begin()->first);
+            }
+            long waitMs = wakeBy > now ? static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(wakeBy - now).count()) + 1 : 0;
+            fd_set readSet;
+            FD_ZERO(&readSet);
+            FD_SET(sock, &readSet);
+            SOCKET highest = sock;
+            if (watch != INVALID_SOCKET) {
+                FD_SET(watch, &readSet);
+                highest = (std::max)(sock, watch);
+            }
+            timeval tv = { waitMs / 1000, (waitMs % 1000) * 1000 };
+            bool watchReadable = false;
+            if (completed.empty() && select(static_cast<int>(highest) + 1, &readSet, nullptr, nullptr, &tv) > 0) {
+                if (FD_ISSET(sock, &readSet)) {
+                    Receive();
+                }
+                watchReadable = watch != INVALID_SOCKET && FD_ISSET(watch, &readSet);
+            }
+            ExpireTimers(Clock::now());
+            SendQueued();
+            Flush();
+            return watchReadable;
+        }
+
+        size_t Pending() const { return entries.size(); }
+
+    private:
+        struct Entry : Query {
+            bool multiPacket = false;
+            int protocolId = 0;
+            int sends = 0;
+            int retransmitsLeft = 0;
+            Clock::duration rto{};              // Current retransmit timeout
+            Clock::time_point queuedAt;
+            Clock::time_point firstSentAt;
+            Clock::time_point sentAt;           // Latest transmission
+            bool inFlight = false;
+            bool replied = false;
+            std::string response;               // Packets collected so far
+            Clock::time_point timer;            // Deadline, or end of the quiet period while collecting
+        };
+
+        struct Completion {
+            uint64_t id;
+            bool replied;
+            std::string result;
+        };
+
+        void SetTimer(uint64_t id, Entry& entry, Clock::time_point at) {
+            timers.erase({ entry.timer, id });
+            entry.timer = at;
+            timers.insert({ at, id });
+        }
+
+        // Sends the front query of an endpoint queue, unless it has to wait out its pacing delay
+        void SendFront(uint64_t key) {
+            auto queueIt = endpoints.find(key);
+            if (queueIt == endpoints.end()) {
+                return;
+            }
+            uint64_t id = queueIt->second.front();
+            Entry& entry = entries[id];
+            if (entry.minSpacing > Clock::duration::zero()) {
+                // Hold paced queries until the endpoint's flood protection window has passed
+                auto last = lastPacedSend.find(key);
+                if (last != lastPacedSend.end() && Clock::now() < last->second + entry.minSpacing) {
+                    SetTimer(id, entry, (std::min)(entry.deadline, last->second + entry.minSpacing));
+                    return;
+                }
+            }
+            ++metrics.queries;
+            Transmit(id, entry);
+            entry.inFlight = true;
+            entry.firstSentAt = entry.sentAt;
+            entry.rto = rttEstimator.Rto(key);
+            if (entry.minSpacing > Clock::duration::zero()) {
+                lastPacedSend[key] = entry.sentAt;
+            }
+            if (entry.replyTimeout > Clock::duration::zero()) {
+                entry.deadline = entry.sentAt + entry.replyTimeout;
+                SetTimer(id, entry, entry.deadline);
+            }
+            if (entry.retransmitsLeft > 0) {
+                SetTimer(id, entry, (std::min)(entry.deadline, entry.sentAt + entry.rto));
+            }
+        }
+
+        // Queues a query's packet (or a resend of it) for the next SendQueued
+        void Transmit(uint64_t id, Entry& entry) {
+            outbox.push_back(id);
+            entry.sentAt = Clock::now();
+            ++entry.sends;
+        }
+
+        // Sends every queued packet; queries whose packet could not be sent fail, and the next query of their
+        // endpoint is queued in turn
+        void SendQueued() {
+            while (!outbox.empty()) {
+                std::vector<uint64_t> batch;
+                batch.swap(outbox);
+                // Queries cancelled or completed since their packet was queued are not sent
+                batch.erase(std::remove_if(batch.begin(), batch.end(), [this](uint64_t id) { return entries.find(id) == entries.end(); }), batch.end());
+                std::vector<uint64_t> failed;
+                for (size_t next = 0; next < batch.size();) {
+                    size_t sent = SendBatch(batch, next);
+                    if (sent == 0) {
+                        ++metrics.sendErrors;
+                        failed.push_back(batch[next++]);
+                    }
+                    next += sent;
+                }
+                for (uint64_t id : failed) {
+                    Complete(id, "error=Send failed");
+                }
+            }
+        }
+
+        // Sends packets starting at batch[first]: as many as one sendmmsg call takes, or a single sendto.
+        // Returns how many went out; 0 means batch[first] could not be sent.
+        size_t SendBatch(const std::vector<uint64_t>& batch, size_t first) {
+#ifdef GSQ_HAVE_MMSG
+            if (batchedIo) {
+                mmsghdr messages[kBatchSize];
+                iovec packets[kBatchSize];
+                unsigned count = static_cast<unsigned>((std::min)(batch.size() - first, kBatchSize));
+                for (unsigned i = 0; i < count; ++i) {
+                    Entry& entry = entries[batch[first + i]];
+                    packets[i] = { const_cast<char*>(entry.query.data()), entry.query.size() };
+                    messages[i] = {};
+                    messages[i].msg_hdr.msg_name = &entry.server;
+                    messages[i].msg_hdr.msg_namelen = sizeof(entry.server);
+                    messages[i].msg_hdr.msg_iov = &packets[i];
+                    messages[i].msg_hdr.msg_iovlen = 1;
+                }
+                int sent = SendRetrying([&]() { return sendmmsg(sock, messages, count, 0); });
+                if (sent <= 0) {
+                    return 0;
+                }
+                for (int i = 0; i < sent; ++i) {
+                    metrics.bytesOut += messages[i].msg_len;
+                }
+                return static_cast<size_t>(sent);
+            }
+#endif
+            Entry& entry = entries[batch[first]];
+            int sent = SendRetrying([&]() {
+                return static_cast<int>(sendto(sock, entry.query.c_str(), static_cast<int>(entry.query.size()), 0, (sockaddr*)&entry.server, sizeof(entry.server)));
+            });
+            if (sent == SOCKET_ERROR) {
+                return 0;
+            }
+            metrics.bytesOut += sent;
+            return 1;
+        }
+
+        // Runs a send call; if the send buffer is full, gives the kernel a moment to flush before retrying once
+        template <typename SendFn>
+        int SendRetrying(SendFn send) {
+            ++metrics.sendCalls;
+            int sent = send();
+            if (sent == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK) {
+                fd_set writeSet;
+                FD_ZERO(&writeSet);
+                FD_SET(sock, &writeSet);
+                timeval tv = { 0, 50 * 1000 };
+                select(static_cast<int>(sock) + 1, nullptr, &writeSet, nullptr, &tv);
+                ++metrics.sendCalls;
+                sent = send();
+            }
+            return sent;
+        }
+
+        // Removes a query and queues its parsed result; returns true if it was at the front of its endpoint queue
+        bool Finish(uint64_t id, const std::string& error) {
+            auto it = entries.find(id);
+            if (it == entries.end()) {
+                return false;
+            }
+            Entry entry = std::move(it->second);
+            entries.erase(it);
+            timers.erase({ entry.timer, id });
+            auto now = Clock::now();
+            if (entry.inFlight) {
+                metrics.Record(entry.protocolId, PHASE_NETWORK, now - entry.firstSentAt);
+            }
+            std::string response = entry.replied ? std::move(entry.response) : error;
+            if (!entry.unparsed) {
+                response = TimedParse(entry.handler, entry.protocolId, entry.raw, entry.cmd, std::move(response), EndpointKey(entry.server),
+                    entry.inFlight ? now - entry.firstSentAt : Clock::duration::zero());
+            }
+            completed.push_back({ id, entry.replied, std::move(response) });
+            metrics.Record(entry.protocolId, PHASE_TOTAL, Clock::now() - entry.queuedAt);
+
+            auto queueIt = endpoints.find(EndpointKey(entry.server));
+            if (queueIt == endpoints.end()) {
+                return false;
+            }
+            auto& queue = queueIt->second;
+            bool front = queue.front() == id;   // In flight, or waiting out its pacing delay
+            queue.erase(std::find(queue.begin(), queue.end(), id));
+            if (queue.empty()) {
+                endpoints.erase(queueIt);
+            }
+            return front;
+        }
+
+        // Finishes a query and sends the next query queued for the same endpoint
+        void Complete(uint64_t id, const std::string& error) {
+            auto it = entries.find(id);
+            if (it == entries.end()) {
+                return;
+            }
+            uint64_t key = EndpointKey(it->second.server);
+            if (Finish(id, error)) {
+                SendFront(key);
+            }
+        }
+
+        // Drains the queued datagrams and attaches each to the in-flight query of its endpoint
+        void Receive() {
+#ifdef GSQ_HAVE_MMSG
+            if (batchedIo) {
+                ReceiveBatches();
+                return;
+            }
+#endif
+            char buffer[kDatagramSize];
+            for (;;) {
+                sockaddr_in from;
+                socklen_t fromLen = sizeof(from);
+                ++metrics.receiveCalls;
+                int bytesReceived = static_cast<int>(recvfrom(sock, buffer, sizeof(buffer) - 1, 0, (sockaddr*)&from, &fromLen));
+                if (bytesReceived == SOCKET_ERROR) {
+                    int error = WSAGetLastError();
+                    if (error == WSAECONNRESET) {
+                        continue; // ICMP port unreachable from an earlier send; the query will time out
+                    }
+                    if (error != WSAEWOULDBLOCK) {
+                        ++metrics.receiveErrors;
+                    }
+                    return;
+                }
+                Accept(from, buffer, bytesReceived);
+            }
+        }
+
+#ifdef GSQ_HAVE_MMSG
+        // Receive() with up to kBatchSize datagrams per recvmmsg call; a short batch means the queue is empty
+        void ReceiveBatches() {
+            if (receiveBuffers.empty()) {
+                receiveBuffers.resize(kBatchSize * kDatagramSize);
+            }
+            mmsghdr messages[kBatchSize];
+            iovec buffers[kBatchSize];
+            sockaddr_in senders[kBatchSize];
+            for (;;) {
+                for (size_t i = 0; i < kBatchSize; ++i) {
+                    buffers[i] = { &receiveBuffers[i * kDatagramSize], kDatagramSize - 1 };
+                    messages[i] = {};
+                    messages[i].msg_hdr.msg_name = &senders[i];
+                    messages[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+                    messages[i].msg_hdr.msg_iov = &buffers[i];
+                    messages[i].msg_hdr.msg_iovlen = 1;
+                }
+                ++metrics.receiveCalls;
+                int count = recvmmsg(sock, messages, kBatchSize, MSG_DONTWAIT, nullptr);
+                if (count < 0) {
+                    if (errno == ECONNREFUSED) {
+                        continue;
+                    }
+                    if (errno != EWOULDBLOCK && errno != EAGAIN) {
+                        ++metrics.receiveErrors;
+                    }
+                    return;
+                }
+                for (int i = 0; i < count; ++i) {
+                    Accept(senders[i], &receiveBuffers[i * kDatagramSize], static_cast<int>(messages[i].msg_len));
+                }
+                if (static_cast<size_t>(count) < kBatchSize) {
+                    return;
+                }
+            }
+        }
+#endif
+
+        // Attaches a received datagram to the in-flight query of its endpoint
+        void Accept(const sockaddr_in& from, const char* data, int length) {
+            metrics.bytesIn += length;
+            auto match = endpoints.find(EndpointKey(from));
+            if (match == endpoints.end() || match->second.empty()) {
+                return; // Wake-up, unsolicited or late datagram
+            }
+            uint64_t id = match->second.front();
+            Entry& entry = entries[id];
+            if (!entry.inFlight) {
+                return;
+            }
+            if (!entry.replied) {
+                // A late duplicate answering an earlier query to this endpoint is not our reply
+                if (!entry.expected.empty() && ResponseHeaderLength(std::string_view(data, length), entry.expected) == 0) {
+                    return;
+                }
+                if (entry.sends == 1) {
+                    rttEstimator.Sample(match->first, Clock::now() - entry.sentAt);
+                }
+            }
+            entry.replied = true;
+            AppendResponsePacket(entry.response, data, static_cast<size_t>(length));
+            if (entry.multiPacket) {
+                SetTimer(id, entry, (std::min)(entry.deadline, Clock::now() + std::chrono::milliseconds(quietPeriodMs.load())));
+            }
+            else {
+                Complete(id, "");
+            }
+        }
+
+        // Completes queries whose deadline or quiet period has passed
+        void ExpireTimers(Clock::time_point now) {
+            while (!timers.empty() && timers.begin()->first <= now) {
+                uint64_t id = timers.begin()->second;
+                Entry& entry = entries[id];
+                if (!entry.inFlight && now < entry.deadline) {
+                    SendFront(EndpointKey(entry.server)); // Pacing delay of the endpoint's front query is over
+                    continue;
+                }
+                if (!entry.replied) {
+                    if (entry.inFlight) {
+                        rttEstimator.Backoff(EndpointKey(entry.server));
+                    }
+                    // Resend idempotent queries while retransmits and time remain
+                    if (entry.inFlight && entry.retransmitsLeft > 0 && now < entry.deadline) {
+                        --entry.retransmitsLeft;
+                        ++metrics.retransmits;
+                        entry.rto = (std::min)(entry.rto * 2, Clock::duration(std::chrono::milliseconds(RttEstimator::kMaxRtoMs)));
+                        Transmit(id, entry);
+                        SetTimer(id, entry, (std::min)(entry.deadline, entry.sentAt + entry.rto));
+                        continue;
+                    }
+                    ++metrics.timeouts;
+                }
+                Complete(id, "error=Receive failed");
+            }
+        }
+
+        // Delivers finished queries once internal state is consistent, so callbacks may safely add new work
+        void Flush() {
+            std::vector<Completion> ready;
+            ready.swap(completed);
+            for (const Completion& completion : ready) {
+                onComplete(completion.id, completion.replied, completion.result);
+            }
+        }
+
+        CompletionFn onComplete;
+        SOCKET sock = INVALID_SOCKET;
+        sockaddr_in wakeAddress = {};
+        std::map<uint64_t, Entry> entries;
+        std::map<uint64_t, std::deque<uint64_t>> endpoints;    // Endpoint -> query ids in submission order
+        std::unordered_map<uint64_t, Clock::time_point> lastPacedSend; // Endpoint -> latest paced send
+        std::set<std::pair<Clock::time_point, uint64_t>> timers;
+        std::vector<Completion> completed;
+        std::vector<uint64_t> outbox;           // Queries whose packet waits for the next SendQueued
+        static constexpr size_t kBatchSize = 64;
+        static constexpr size_t kDatagramSize = 4096;
+        std::vector<char> receiveBuffers;       // kBatchSize datagram slots for recvmmsg
+    };
+
+    // Validates a request and builds its packet, leaving the address to SetQueryAddress; returns an error string,
+    // or empty on success
+    std::string PrepareQueryPacket(int protocolId, bool raw, const char* ipOrHostname, int port, const char* command, const char* rconPassword, QueryMultiplexer::Query& out) {
         if (!ipOrHostname || !command) {
-            return _strdup("error=Null input parameters");
+            return "error=Null input parameters";
+        }
+        if (port < 1 || port > 65535) {
+            return "error=Invalid port";
+        }
+        ProtocolHandler* handler = HandlerFor(protocolId);
+        if (!handler) {
+            return "error=Invalid protocol ID";
+        }
+        out.cmd = SanitizeCommand(command);
+        if (out.cmd.empty()) {
+            return "error=Empty command";
+        }
+        std::string error = handler->BuildQuery(out.cmd, rconPassword ? rconPassword : "", out.query);
+        if (!error.empty()) {
+            return error;
+        }
+        out.server.sin_family = AF_INET;
+        out.server.sin_port = htons(static_cast<u_short>(port));
+        out.handler = handler;
+        out.raw = raw;
+        return "";
+    }
+
+    // Sets the address of a prepared query from a resolver result (an address or an "error=" string)
+    std::string SetQueryAddress(const std::string& ip, QueryMultiplexer::Query& out) {
+        if (ip.find("error=") == 0) {
+            return ip;
+        }
+        if (inet_pton(AF_INET, ip.c_str(), &out.server.sin_addr) <= 0) {
+            return "error=Invalid IP address";
+        }
+        return "";
+    }
+
+    // Validates a request, resolves its address and builds its packet; returns an error string, or empty on success
+    std::string PrepareQuery(int protocolId, bool raw, const char* ipOrHostname, int port, const char* command, const char* rconPassword, QueryMultiplexer::Query& out) {
+        std::string error = PrepareQueryPacket(protocolId, raw, ipOrHostname, port, command, rconPassword, out);
+        if (!error.empty()) {
+            return error;
+        }
+        std::string ip;
+        {
+            PhaseTimer timer(protocolId, PHASE_RESOLVE);
+            ip = ResolveHostname(ipOrHostname);
+        }
+        return SetQueryAddress(ip, out);
+    }
+
+    // Appends the servers listed in a getserversResponse packet to out, skipping any already in seen;
+    // returns true once the end-of-list marker has been received
+    bool ParseGetServersResponse(std::string_view packet, std::unordered_set<uint64_t>& seen, std::vector<sockaddr_in>& out) {
+        size_t pos = ResponseHeaderLength(packet, "getserversResponse");
+        if (pos == 0) {
+            return false;
+        }
+        // Each entry is '\' followed by a 4-byte address and a 2-byte port, both in network byte order
+        while (pos < packet.size()) {
+            if (packet[pos] != '\\') {
+                ++pos;
+                continue;
+            }
+            std::string_view rest = packet.substr(pos + 1);
+            if (rest.compare(0, 3, "EOT") == 0 || rest.compare(0, 3, "EOF") == 0) {
+                return true;
+            }
+            if (rest.size() < 6) {
+                break;
+            }
+            sockaddr_in server = {};
+            server.sin_family = AF_INET;
+            memcpy(&server.sin_addr, rest.data(), 4);
+            memcpy(&server.sin_port, rest.data() + 4, 2);
+            pos += 7;
+            if (server.sin_addr.s_addr == 0 || server.sin_port == 0) {
+                continue;
+            }
+            if (seen.insert(EndpointKey(server)).second) {
+                out.push_back(server);
+            }
+        }
+        return false;
+    }
+
+    // Background I/O thread that runs asynchronous queries on a shared multiplexer and invokes their callbacks
+    class AsyncReactor {
+    public:
+        ~AsyncReactor() { Stop(); }
+
+        // Hands a prepared query (or a validation error to report) to the reactor; returns its handle, or 0 on failure
+        uint64_t Submit(QueryMultiplexer::Query query, const std::string& error, GameServerQueryCallback callback, void* userData) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!EnsureStarted()) {
+                return 0;
+            }
+            uint64_t handle = nextHandle++;
+            callbacks[handle] = { callback, userData };
+            Enqueue({ handle, std::move(query), error });
+            return handle;
+        }
+
+        // As Submit for a query from PrepareQueryPacket whose address is still to be resolved. A hostname missing
+        // from the DNS cache is looked up on the cache's background thread, so neither the caller nor the
+        // reactor waits on getaddrinfo; the query joins the reactor once the address is known. The deadline is
+        // timeoutMs after submission, or the endpoint's round-trip based timeout (at most maxTimeoutMs if set)
+        // when timeoutMs is 0.
+        uint64_t SubmitUnresolved(QueryMultiplexer::Query query, const std::string& error, const std::string& host, int timeoutMs, int maxTimeoutMs,
+            GameServerQueryCallback callback, void* userData) {
+            auto submitted = Clock::now();
+            auto setDeadline = [submitted, timeoutMs, maxTimeoutMs](QueryMultiplexer::Query& ready) {
+                int ms = timeoutMs > 0 ? timeoutMs : rttEstimator.TimeoutMs(EndpointKey(ready.server), QueryTimeoutMs(ready.cmd));
+                ready.deadline = submitted + std::chrono::milliseconds(maxTimeoutMs > 0 ? (std::min)(ms, maxTimeoutMs) : ms);
+            };
+            std::string ip;
+            if (!error.empty() || dnsCache.Cached(host, ip)) {
+                std::string failure = error.empty() ? SetQueryAddress(ip, query) : error;
+                setDeadline(query);
+                return Submit(std::move(query), failure, callback, userData);
+            }
+            uint64_t handle;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!EnsureStarted()) {
+                    return 0;
+                }
+                handle = nextHandle++;
+                callbacks[handle] = { callback, userData };
+            }
+            auto shared = std::make_shared<QueryMultiplexer::Query>(std::move(query));
+            dnsCache.ResolveAsync(host, [this, handle, shared, setDeadline](const std::string& result) {
+                std::string failure = SetQueryAddress(result, *shared);
+                setDeadline(*shared);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    // Stop has already cancelled the query if the reactor is no longer running
+                    if (running && !stopping && callbacks.count(handle)) {
+                        Enqueue({ handle, std::move(*shared), failure });
+                        return;
+                    }
+                }
+                Deliver(handle, "error=Cancelled");
+            });
+            return handle;
+        }
+
+        // Requests cancellation; returns false if the handle is unknown or already completed
+        bool Cancel(uint64_t handle) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!running || callbacks.find(handle) == callbacks.end()) {
+                return false;
+            }
+            cancels.push_back(handle);
+            mux->Wake();
+            return true;
+        }
+
+        // Stops the thread; pending queries complete with "error=Cancelled"
+        void Stop() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!running) {
+                    return;
+                }
+                stopping = true;
+                mux->Wake();
+            }
+            thread.join();
+            std::map<uint64_t, Callback> resolving;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                mux.reset();
+                network.reset();
+                running = false;
+                stopping = false;
+                resolving.swap(callbacks);  // Only queries still waiting for their address are left
+            }
+            for (const auto& pending : resolving) {
+                try {
+                    pending.second.fn(pending.first, "error=Cancelled", pending.second.userData);
+                }
+                catch (...) {
+                }
+            }
+        }
+
+    private:
+        struct Submission {
+            uint64_t handle;
+            QueryMultiplexer::Query query;
+            std::string error;
+        };
+
+        struct Callback {
+            GameServerQueryCallback fn;
+            void* userData;
+        };
+
+        // Queues a submission for the reactor thread; caller holds the mutex
+        void Enqueue(Submission submission) {
+            incoming.push_back(std::move(submission));
+            // A wake-up is already on its way if earlier submissions are still waiting to be picked up
+            if (incoming.size() == 1) {
+                mux->Wake();
+            }
+        }
+
+        // Starts networking, the shared socket and the reactor thread on first use; caller holds the mutex
+        bool EnsureStarted() {
+            if (running) {
+                return !stopping;
+            }
+            network = std::make_unique<NetworkScope>();
+            mux = std::make_unique<QueryMultiplexer>([this](uint64_t id, bool, const std::string& result) { Deliver(id, result); });
+            if (!network->ok || !mux->Open()) {
+                mux.reset();
+                network.reset();
+                return false;
+            }
+            running = true;
+            thread = std::thread([this]() { Run(); });
+            return true;
+        }
+
+        void Run() {
+            for (;;) {
+                std::vector<Submission> submitted;
+                std::vector<uint64_t> cancelled;
+                bool stop;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    submitted.swap(incoming);
+                    cancelled.swap(cancels);
+                    stop = stopping;
+                }
+                for (Submission& submission : submitted) {
+                    if (stop || !submission.error.empty()) {
+                        Deliver(submission.handle, stop ? "error=Cancelled" : submission.error);
+                    }
+                    else {
+                        mux->Add(submission.handle, std::move(submission.query));
+                    }
+                }
+                for (uint64_t handle : cancelled) {
+                    mux->Cancel(handle, "error=Cancelled");
+                }
+                if (stop) {
+                    mux->CancelAll("error=Cancelled");
+                    return;
+                }
+                mux->Poll(Clock::now() + std::chrono::seconds(1));
+            }
+        }
+
+        // Invokes and forgets the callback registered for a handle
+        void Deliver(uint64_t handle, const std::string& result) {
+            Callback callback = {};
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = callbacks.find(handle);
+                if (it == callbacks.end()) {
+                    return;
+                }
+                callback = it->second;
+                callbacks.erase(it);
+            }
+            try {
+                callback.fn(handle, result.c_str(), callback.userData);
+            }
+            catch (...) {
+                // Exceptions must not unwind through the reactor thread
+            }
+        }
+
+        std::mutex mutex;
+        std::thread thread;
+        bool running = false;
+        bool stopping = false;
+        std::unique_ptr<NetworkScope> network;  // Holds Winsock while the reactor runs
+        std::unique_ptr<QueryMultiplexer> mux;
+        std::vector<Submission> incoming;
+        std::vector<uint64_t> cancels;
+        std::map<uint64_t, Callback> callbacks; // Pending handles and their callbacks
+        uint64_t nextHandle = 1;
+    } asyncReactor;
+}
+
+namespace {
+    // Polls registered servers on their own intervals. A hashed timer wheel spreads the polls out: each watch
+    // starts at a random point within its interval and every later poll is jittered by up to 5% of it, so
+    // thousands of watches produce steady traffic instead of bursts. Due polls are handed to the asynchronous
+    // reactor, so all I/O runs on its single socket and thread while this thread only keeps time.
+    class WatchScheduler {
+    public:
+        ~WatchScheduler() { Stop(); }
+
+        struct Watch {
+            int protocolId;
+            bool raw;
+            std::string host;
+            int port;
+            std::string command;
+            std::string rconPassword;
+            int intervalMs;
+            GameServerWatchCallback callback;
+            void* userData;
+            bool paused = false;
+            bool inFlight = false;              // A poll is running; the next one is skipped until it completes
+            bool staggered = true;              // First poll at a random point of the interval rather than after a full one
+        };
+
+        // Registers a watch and schedules its first poll; returns its handle, or 0 if the thread could not start
+        uint64_t Add(Watch watch) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!EnsureStarted()) {
+                return 0;
+            }
+            uint64_t handle = nextHandle++;
+            uint64_t intervalTicks = IntervalTicks(watch.intervalMs);
+            Schedule(handle, currentTick + (watch.staggered ? 1 + std::uniform_int_distribution<uint64_t>(0, intervalTicks - 1)(random) : intervalTicks));
+            watches.emplace(handle, std::move(watch));
+            return handle;
+        }
+
+        // Removes a watch. Unless called from its own callback, waits for a callback already running to return,
+        // so userData may be released afterwards.
+        bool Remove(uint64_t handle) {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (watches.erase(handle) == 0) {
+                return false;
+            }
+            delivered.wait(lock, [this, handle]() { return delivering != handle || deliveringThread == std::this_thread::get_id(); });
+            return true;
+        }
+
+        // Suspends or resumes polling; a poll already running still reports its result
+        bool Pause(uint64_t handle, bool paused) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = watches.find(handle);
+            if (it == watches.end()) {
+                return false;
+            }
+            it->second.paused = paused;
+            return true;
+        }
+
+        // Stops the timer thread and forgets every watch
+        void Stop() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!thread.joinable()) {
+                    return;
+                }
+                stopping = true;
+            }
+            tick.notify_all();
+            thread.join();
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = false;
+            watches.clear();
+            for (auto& slot : wheel) slot.clear();
+        }
+
+        // Reactor callback for a watch poll; userData carries the watch handle
+        static void OnResult(GameServerQueryHandle, const char* response, void* userData);
+
+    private:
+        static constexpr std::chrono::milliseconds kTick{ 10 };
+        static constexpr size_t kSlots = 1024;  // One revolution is ~10 s; later timers wait in their slot for whole turns
+
+        struct Timer {
+            uint64_t handle;
+            uint64_t dueTick;
+        };
+
+        static uint64_t IntervalTicks(int intervalMs) {
+            return (std::max)(static_cast<uint64_t>(1), static_cast<uint64_t>(intervalMs / kTick.count()));
+        }
+
+        void Schedule(uint64_t handle, uint64_t dueTick) {
+            wheel[dueTick % kSlots].push_back({ handle, dueTick });
+        }
+
+        // Starts the timer thread on first use; caller holds the mutex
+        bool EnsureStarted() {
+            if (thread.joinable()) {
+                return !stopping;
+            }
+            epoch = Clock::now();
+            currentTick = 0;
+            try {
+                thread = std::thread([this]() { Run(); });
+            }
+            catch (...) {
+                return false;
+            }
+            return true;
+        }
+
+        struct Dispatch {
+            uint64_t handle;
+            Watch watch;
+        };
+
+        void Run() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!stopping) {
+                tick.wait_until(lock, epoch + kTick * (currentTick + 1), [this]() { return stopping; });
+                if (stopping) {
+                    break;
+                }
+                // Catch up on every tick that has passed, so a late wake-up delays polls but never drops them
+                uint64_t nowTick = static_cast<uint64_t>((Clock::now() - epoch) / kTick);
+                std::vector<Dispatch> due;
+                while (currentTick < nowTick) {
+                    ++currentTick;
+                    Advance(due);
+                }
+                if (due.empty()) {
+                    continue;
+                }
+                lock.unlock();
+                for (Dispatch& dispatch : due) {
+                    Submit(dispatch);
+                }
+                lock.lock();
+            }
+        }
+
+        // Fires the timers of the current slot and reschedules their watches; caller holds the mutex
+        void Advance(std::vector<Dispatch>& due) {
+            std::vector<Timer> timers;
+            timers.swap(wheel[currentTick % kSlots]);
+            for (const Timer& timer : timers) {
+                if (timer.dueTick > currentTick) {
+                    Schedule(timer.handle, timer.dueTick);
+                    continue;
+                }
+                auto it = watches.find(timer.handle);
+                if (it == watches.end()) {
+                    continue;   // Removed; its timer simply lapses
+                }
+                Watch& watch = it->second;
+                uint64_t intervalTicks = IntervalTicks(watch.intervalMs);
+                int64_t jitter = static_cast<int64_t>(intervalTicks / 20);
+                int64_t offset = jitter > 0 ? std::uniform_int_distribution<int64_t>(-jitter, jitter)(random) : 0;
+                Schedule(timer.handle, (std::max)(currentTick + 1, timer.dueTick + intervalTicks + offset));
+                if (!watch.paused && !watch.inFlight) {
+                    watch.inFlight = true;
+                    due.push_back({ timer.handle, watch });
+                }
+            }
+        }
+
+        // Hands one poll to the reactor; a request that cannot be queued is reported straight away. The hostname
+        // is resolved by the reactor (from the DNS cache, or on its background thread), never on this thread, so
+        // a slow or dead hostname cannot hold up the other watches.
+        void Submit(Dispatch& dispatch) {
+            const Watch& watch = dispatch.watch;
+            try {
+                QueryMultiplexer::Query query;
+                std::string error = PrepareQueryPacket(watch.protocolId, watch.raw, watch.host.c_str(), watch.port, watch.command.c_str(), watch.rconPassword.c_str(), query);
+                void* token = reinterpret_cast<void*>(static_cast<uintptr_t>(dispatch.handle));
+                if (asyncReactor.SubmitUnresolved(std::move(query), error, watch.host, 0, watch.intervalMs, &WatchScheduler::OnResult, token) != 0) {
+                    return;
+                }
+            }
+            catch (...) {
+            }
+            Deliver(dispatch.handle, "error=Async reactor unavailable");
+        }
+
+        void Deliver(uint64_t handle, const char* response) {
+            GameServerWatchCallback callback;
+            void* userData;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = watches.find(handle);
+                if (it == watches.end()) {
+                    return;
+                }
+                it->second.inFlight = false;
+                callback = it->second.callback;
+                userData = it->second.userData;
+                delivering = handle;
+                deliveringThread = std::this_thread::get_id();
+            }
+            try {
+                callback(handle, response, userData);
+            }
+            catch (...) {
+                // Exceptions must not unwind through the reactor thread
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                delivering = 0;
+            }
+            delivered.notify_all();
+        }
+
+        std::mutex mutex;
+        std::condition_variable tick;
+        std::condition_variable delivered;
+        std::thread thread;
+        bool stopping = false;
+        Clock::time_point epoch;
+        uint64_t currentTick = 0;
+        std::vector<std::vector<Timer>> wheel = std::vector<std::vector<Timer>>(kSlots);
+        std::unordered_map<uint64_t, Watch> watches;
+        uint64_t nextHandle = 1;
+        uint64_t delivering = 0;                // Watch whose callback is running, or 0
+        std::thread::id deliveringThread;
+        std::mt19937_64 random{ std::random_device{}() };
+    } watchScheduler;
+
+    void WatchScheduler::OnResult(GameServerQueryHandle, const char* response, void* userData) {
+        watchScheduler.Deliver(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(userData)), response);
+    }
+}
+
+namespace {
+    // Lifetime of cached query results in milliseconds; 0 disables the cache
+    std::atomic<int> cacheTtlMs{ 0 };
+
+    // Short-lived cache of query results. Concurrent identical queries share one in-flight round trip
+    // (single flight): the first caller queries the server and the others wait for its result.
+    class ResponseCache {
+    public:
+        template <typename QueryFn>
+        std::string Get(const std::string& key, int ttlMs, QueryFn query) {
+            std::unique_lock<std::mutex> lock(mutex);
+            auto cached = entries.find(key);
+            if (cached != entries.end() && cached->second.expires > Clock::now()) {
+                ++hits;
+                return cached->second.result;
+            }
+            auto running = inFlight.find(key);
+            if (running != inFlight.end()) {
+                std::shared_ptr<Flight> flight = running->second;
+                ++coalesced;
+                done.wait(lock, [&flight]() { return flight->finished; });
+                return flight->result;
+            }
+            ++misses;
+            auto flight = std::make_shared<Flight>();
+            inFlight[key] = flight;
+            lock.unlock();
+
+            std::string result;
+            try {
+                result = query();
+            }
+            catch (...) {
+                result = "error=Unexpected exception";
+            }
+
+            lock.lock();
+            flight->result = result;
+            flight->finished = true;
+            inFlight.erase(key);
+            // Errors (timeouts, bad passwords) are shared with waiting callers but never cached
+            if (result.find("error=") != 0) {
+                auto now = Clock::now();
+                entries[key] = { result, now + std::chrono::milliseconds(ttlMs) };
+                if (entries.size() >= sweepAt) {
+                    for (auto it = entries.begin(); it != entries.end();) {
+                        it = it->second.expires <= now ? entries.erase(it) : std::next(it);
+                    }
+                    sweepAt = (std::max)(static_cast<size_t>(1024), entries.size() * 2);
+                }
+            }
+            lock.unlock();
+            done.notify_all();
+            return result;
+        }
+
+        void Clear() {
+            std::lock_guard<std::mutex> lock(mutex);
+            entries.clear();
+        }
+
+        std::atomic<unsigned long long> hits{ 0 };
+        std::atomic<unsigned long long> misses{ 0 };
+        std::atomic<unsigned long long> coalesced{ 0 };
+
+    private:
+        struct Entry {
+            std::string result;
+            Clock::time_point expires;
+        };
+
+        struct Flight {
+            bool finished = false;
+            std::string result;
+        };
+
+        std::mutex mutex;
+        std::condition_variable done;
+        std::unordered_map<std::string, Entry> entries;
+        std::unordered_map<std::string, std::shared_ptr<Flight>> inFlight;
+        size_t sweepAt = 1024;
+    } responseCache;
+
+    // Validates, resolves and runs a single blocking command; errors are returned as "error=" strings.
+    // resolvedIp, if given, receives the address the command was sent to.
+    std::string RunGameServerCommand(int protocolId, bool raw, const char* ipOrHostname, int port, const char* command, const char* rconPassword,
+        std::string* resolvedIp = nullptr) {
+        try {
+            if (!ipOrHostname || !command) {
+                return "error=Null input parameters";
+            }
+            if (port < 1 || port > 65535) {
+                return "error=Invalid port";
+            }
+            ProtocolHandler* handler = HandlerFor(protocolId);
+            if (!handler) {
+                return "error=Invalid protocol ID";
+            }
+            PhaseTimer total(protocolId, PHASE_TOTAL);
+
+            std::string ip;
+            {
+                PhaseTimer timer(protocolId, PHASE_RESOLVE);
+                ip = ResolveHostname(ipOrHostname);
+            }
+            if (ip.find("error=") == 0) {
+                return ip;
+            }
+            if (resolvedIp) {
+                *resolvedIp = ip;
+            }
+
+            std::string cmd = SanitizeCommand(command);
+            if (cmd.empty()) {
+                return "error=Empty command";
+            }
+
+            std::string rcon = rconPassword ? rconPassword : "";
+            int ttlMs = cacheTtlMs;
+            if (ttlMs <= 0 || cmd.find("rcon ") == 0) {
+                return handler->ProcessCommand(raw, ip, port, cmd, rcon);
+            }
+            std::string key = std::to_string(protocolId) + '|' + ip + '|' + std::to_string(port) + '|' + (raw ? "raw|" : "json|") + cmd;
+            if (const Projection* projection = Projection::Current()) {
+                key.append("|fields=").append(projection->spec);
+            }
+            return responseCache.Get(key, ttlMs, [&]() { return handler->ProcessCommand(raw, ip, port, cmd, rcon); });
+        }
+        catch (...) {
+            return "error=Unexpected exception";
+        }
+    }
+}
+
+namespace {
+    // A player in a delta snapshot: identity key plus fields in output order
+    struct DeltaPlayer {
+        std::string key;
+        std::vector<std::pair<std::string, std::string>> fields;
+    };
+
+    // Last parsed state of one server, with cvars and players sorted by key
+    struct DeltaSnapshot {
+        std::vector<std::pair<std::string, std::string>> cvars;
+        std::vector<DeltaPlayer> players;
+    };
+
+    // Builds a snapshot from a raw getstatus/getinfo body. Players are keyed by slot plus name when the
+    // status lines carry the client slot (Medal of Honor), and otherwise by name, numbering repeated names
+    // in the order they are listed.
+    DeltaSnapshot SnapshotFromStatus(std::string_view body, int protocolId) {
+        ParseArena arena;
+        DeltaSnapshot snapshot;
+        for (const auto& pair : ParseKeyValues(body)) {
+            snapshot.cvars.emplace_back(std::string(pair.first), std::string(pair.second));
+        }
+        bool slots = HandlerFor(protocolId) && protocolTable[protocolId].statusSlots;
+        std::unordered_map<std::string_view, int> seen;
+        for (const StatusPlayer& player : ParseGetStatusPlayers(body, protocolId)) {
+            DeltaPlayer entry;
+            if (slots) {
+                entry.key = "slot:" + std::string(player.slot) + "\x1F" + std::string(player.name);
+            }
+            else {
+                int occurrence = seen[player.name]++;
+                entry.key = std::string(player.name) + (occurrence > 0 ? "\x1F" + std::to_string(occurrence) : "");
+            }
+            entry.fields = { { "slot", std::string(player.slot) }, { "score", std::string(player.score) },
+                { "ping", std::string(player.ping) }, { "name", std::string(player.name) } };
+            if (cleanNames) {
+                entry.fields.emplace_back("clean_name", StripColorCodes(player.name));
+            }
+            snapshot.players.push_back(std::move(entry));
+        }
+        std::sort(snapshot.players.begin(), snapshot.players.end(), [](const DeltaPlayer& a, const DeltaPlayer& b) { return a.key < b.key; });
+        return snapshot;
+    }
+
+    // Builds a snapshot from rcon status text; players are keyed by steamid or guid when the server reports
+    // a non-zero one, and by slot plus name otherwise
+    DeltaSnapshot SnapshotFromRconStatus(const std::string& text, int protocolId) {
+        ParseArena arena;
+        DeltaSnapshot snapshot;
+        for (const RconPlayer& player : ParseRconStatusPlayers(text, protocolId)) {
+            DeltaPlayer entry;
+            if (player.Has(COL_STEAMID) && !player[COL_STEAMID].empty() && player[COL_STEAMID] != "0") {
+                entry.key = "steamid:" + std::string(player[COL_STEAMID]);
+            }
+            else if (player.Has(COL_GUID) && !player[COL_GUID].empty() && player[COL_GUID] != "0") {
+                entry.key = "guid:" + std::string(player[COL_GUID]);
+            }
+            else {
+                entry.key = "slot:" + std::string(player[COL_SLOT]) + "\x1F" + std::string(player[COL_NAME]);
+            }
+            for (size_t column = 0; column < kColumnCount; ++column) {
+                PlayerColumn field = static_cast<PlayerColumn>(column);
+                if (player.Has(field)) {
+                    entry.fields.emplace_back(kColumnNames[field], std::string(player[field]));
+                }
+                if (cleanNames && field == COL_NAME && player.Has(field)) {
+                    entry.fields.emplace_back("clean_name", StripColorCodes(player[field]));
+                }
+            }
+            snapshot.players.push_back(std::move(entry));
+        }
+        std::sort(snapshot.players.begin(), snapshot.players.end(), [](const DeltaPlayer& a, const DeltaPlayer& b) { return a.key < b.key; });
+        return snapshot;
+    }
+
+    void WritePlayer(JsonWriter& json, const DeltaPlayer& player) {
+        json.BeginObject();
+        for (const auto& field : player.fields) {
+            json.Member(field.first, field.second);
+        }
+        json.EndObject();
+    }
+
+    // Fields that differ between two states of a player; lastmsg changes on every poll and is ignored
+    std::vector<std::string_view> ChangedFields(const DeltaPlayer& before, const DeltaPlayer& after) {
+        std::vector<std::string_view> changed;
+        for (const auto& field : after.fields) {
+            if (field.first == "lastmsg") {
+                continue;
+            }
+            auto old = std::find_if(before.fields.begin(), before.fields.end(), [&field](const auto& f) { return f.first == field.first; });
+            if (old == before.fields.end() || old->second != field.second) {
+                changed.push_back(field.first);
+            }
+        }
+        return changed;
+    }
+
+    // Writes the changes from one snapshot to the next as JSON; "{}" when nothing changed
+    std::string DeltaToJson(const DeltaSnapshot* before, const DeltaSnapshot& after) {
+        JsonTimer timer;
+        static const DeltaSnapshot empty;
+        const DeltaSnapshot& previous = before ? *before : empty;
+        std::string result;
+        JsonWriter json(result);
+        json.BeginObject();
+        if (!before) {
+            json.Key("full").Bool(true);
+        }
+
+        // Server cvars: changed or added values, then removed names
+        std::vector<std::string_view> removed;
+        bool open = false;
+        auto old = previous.cvars.begin();
+        for (const auto& cvar : after.cvars) {
+            while (old != previous.cvars.end() && old->first < cvar.first) {
+                removed.push_back((old++)->first);
+            }
+            bool same = old != previous.cvars.end() && old->first == cvar.first && old->second == cvar.second;
+            if (old != previous.cvars.end() && old->first == cvar.first) {
+                ++old;
+            }
+            if (!same) {
+                if (!open) {
+                    json.Key("server").BeginObject();
+                    open = true;
+                }
+                json.Member(cvar.first, cvar.second);
+            }
+        }
+        for (; old != previous.cvars.end(); ++old) {
+            removed.push_back(old->first);
+        }
+        if (open) {
+            json.EndObject();
+        }
+        if (!removed.empty()) {
+            json.Key("removed").BeginArray();
+            for (std::string_view name : removed) json.String(name);
+            json.EndArray();
+        }
+
+        // Players: merge both sorted lists by key
+        std::vector<const DeltaPlayer*> joined, left;
+        std::vector<std::pair<const DeltaPlayer*, std::vector<std::string_view>>> updated;
+        auto prior = previous.players.begin();
+        for (const DeltaPlayer& player : after.players) {
+            while (prior != previous.players.end() && prior->key < player.key) {
+                left.push_back(&*prior++);
+            }
+            if (prior != previous.players.end() && prior->key == player.key) {
+                auto changed = ChangedFields(*prior++, player);
+                if (!changed.empty()) {
+                    updated.emplace_back(&player, std::move(changed));
+                }
+            }
+            else {
+                joined.push_back(&player);
+            }
+        }
+        for (; prior != previous.players.end(); ++prior) {
+            left.push_back(&*prior);
+        }
+        if (!joined.empty()) {
+            json.Key("joined").BeginArray();
+            for (const DeltaPlayer* player : joined) WritePlayer(json, *player);
+            json.EndArray();
+        }
+        if (!left.empty()) {
+            json.Key("left").BeginArray();
+            for (const DeltaPlayer* player : left) WritePlayer(json, *player);
+            json.EndArray();
+        }
+        if (!updated.empty()) {
+            json.Key("updated").BeginArray();
+            for (const auto& entry : updated) {
+                json.BeginObject();
+                for (const auto& field : entry.first->fields) {
+                    json.Member(field.first, field.second);
+                }
+                json.Key("changed").BeginArray();
+                for (std::string_view field : entry.second) json.String(field);
+                json.EndArray().EndObject();
+            }
+            json.EndArray();
+        }
+        json.EndObject();
+        return result;
+    }
+
+    // Last snapshot per protocol, endpoint and command for delta queries
+    std::mutex deltaMutex;
+    std::unordered_map<std::string, DeltaSnapshot> deltaSnapshots;
+
+    std::string RunGameServerDelta(int protocolId, const char* ipOrHostname, int port, const char* command, const char* rconPassword) {
+        try {
+            if (!ipOrHostname || !command) {
+                return "error=Null input parameters";
+            }
+            std::string cmd = SanitizeCommand(command);
+            if (cmd != "getstatus" && cmd != "getinfo" && cmd != "rcon status") {
+                return "error=Unsupported command for delta mode";
+            }
+            // The raw reply goes through the same path as any query (DNS, cache, retransmits, metrics); the
+            // snapshot is keyed by the address it was sent to, so the hostname is not resolved a second time
+            std::string ip;
+            std::string body = RunGameServerCommand(protocolId, true, ipOrHostname, port, cmd.c_str(), rconPassword, &ip);
+            if (body.find("error=") == 0) {
+                return body;
+            }
+            DeltaSnapshot snapshot = cmd == "rcon status" ? SnapshotFromRconStatus(body, protocolId) : SnapshotFromStatus(body, protocolId);
+
+            std::string key = std::to_string(protocolId) + '|' + ip + '|' + std::to_string(port) + '|' + cmd;
+            std::lock_guard<std::mutex> lock(deltaMutex);
+            auto it = deltaSnapshots.find(key);
+            std::string result = DeltaToJson(it == deltaSnapshots.end() ? nullptr : &it->second, snapshot);
+            deltaSnapshots[key] = std::move(snapshot);
+            return result;
+        }
+        catch (...) {
+            return "error=Unexpected exception";
+        }
+    }
+}
+
+namespace {
+    // Where each tracked player was last seen, fed by the getstatus and rcon status replies parsed while
+    // GSQ_OPTION_PLAYER_INDEX is on. Each server's entry is replaced by its latest reply, so a player who
+    // leaves drops out on that server's next poll. Names are indexed by the words and trigrams of their
+    // color-stripped, lowercased form; guid, steamid and address (with and without port) are indexed whole.
+    class PlayerIndex {
+    public:
+        // A player as listed in one reply
+        struct Sighting {
+            std::string name;
+            std::string folded;     // Color codes removed and ASCII lowercased
+            std::string slot;
+            std::string guid;
+            std::string steamid;
+            std::string address;
+        };
+
+        // Replaces the players recorded for a server. getstatus lists no identifiers, so its players keep
+        // the slot, guid, steamid and address an earlier rcon status reported under the same name.
+        void Update(uint64_t server, int protocolId, std::vector<Sighting>& sightings, bool rcon) {
+            int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            auto found = serverIds.find(server);
+            if (found == serverIds.end()) {
+                found = serverIds.emplace(server, static_cast<uint32_t>(servers.size())).first;
+                servers.push_back({ server, protocolId, {} });
+            }
+            uint32_t serverId = found->second;
+            servers[serverId].protocolId = protocolId;
+            std::vector<uint32_t> previous = std::move(servers[serverId].players);
+            std::vector<uint32_t> current;
+            current.reserve(sightings.size());
+
+            // Match each player to the first unmatched record of the same name, so repeated names pair up in order
+            for (Sighting& sighting : sightings) {
+                auto match = std::find_if(previous.begin(), previous.end(), [&](uint32_t id) {
+                    return id != kNone && records[id].folded == sighting.folded;
+                });
+                if (match == previous.end()) {
+                    current.push_back(Insert(serverId, std::move(sighting), now));
+                    continue;
+                }
+                uint32_t id = *match;
+                *match = kNone;
+                Record& record = records[id];
+                if (!rcon) {
+                    if (sighting.slot.empty()) sighting.slot = record.slot;
+                    sighting.guid = record.guid;
+                    sighting.steamid = record.steamid;
+                    sighting.address = record.address;
+                }
+                if (sighting.guid != record.guid || sighting.steamid != record.steamid || sighting.address != record.address) {
+                    Retire(id);
+                    current.push_back(Insert(serverId, std::move(sighting), now));
+                    continue;
+                }
+                record.name = std::move(sighting.name);
+                record.slot = std::move(sighting.slot);
+                record.lastSeen = now;
+                current.push_back(id);
+            }
+            for (uint32_t id : previous) {
+                if (id != kNone) Retire(id);
+            }
+            servers[serverId].players = std::move(current);
+            if (retired > kCompactAfter && retired > records.size() - retired) {
+                Compact();
+            }
+        }
+
+        // Writes the players matching a query as a JSON array, most recently seen first
+        std::string Find(std::string_view text, int match, size_t limit) {
+            std::string query = Fold(text);
+            std::string_view trimmed = Trim(query);
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            std::vector<uint32_t> ids;
+            if (!trimmed.empty()) {
+                ids = match == GSQ_PLAYER_MATCH_SUBSTRING ? Contains(trimmed) : Terms(trimmed, match == GSQ_PLAYER_MATCH_PREFIX);
+            }
+            ids.erase(std::remove_if(ids.begin(), ids.end(), [&](uint32_t id) { return !records[id].alive; }), ids.end());
+            auto newer = [&](uint32_t a, uint32_t b) { return records[a].lastSeen > records[b].lastSeen; };
+            if (ids.size() > limit) {
+                std::partial_sort(ids.begin(), ids.begin() + limit, ids.end(), newer);
+                ids.resize(limit);
+            }
+            else {
+                std::sort(ids.begin(), ids.end(), newer);
+            }
+
+            std::string result;
+            JsonWriter json(result);
+            json.BeginArray();
+            for (uint32_t id : ids) {
+                const Record& record = records[id];
+                const Server& server = servers[record.server];
+                char endpoint[32];
+                snprintf(endpoint, sizeof(endpoint), "%u.%u.%u.%u:%u", static_cast<unsigned>(server.endpoint >> 40) & 0xFF,
+                    static_cast<unsigned>(server.endpoint >> 32) & 0xFF, static_cast<unsigned>(server.endpoint >> 24) & 0xFF,
+                    static_cast<unsigned>(server.endpoint >> 16) & 0xFF, static_cast<unsigned>(server.endpoint & 0xFFFF));
+                json.BeginObject().Member("server", endpoint).Key("protocol").Number(static_cast<uint64_t>(server.protocolId));
+                if (!record.slot.empty()) json.Member("slot", record.slot);
+                json.Member("name", record.name).Member("clean_name", StripColorCodes(record.name));
+                if (!record.guid.empty()) json.Member("guid", record.guid);
+                if (!record.steamid.empty()) json.Member("steamid", record.steamid);
+                if (!record.address.empty()) json.Member("address", record.address);
+                json.Key("last_seen").Number(static_cast<uint64_t>(record.lastSeen)).EndObject();
+            }
+            json.EndArray();
+            return result;
+        }
+
+        void Clear() {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            records.clear();
+            servers.clear();
+            serverIds.clear();
+            terms.clear();
+            identifiers.clear();
+            trigrams.clear();
+            retired = 0;
+        }
+
+        // Color codes removed and ASCII letters lowercased
+        static std::string Fold(std::string_view name) {
+            std::string folded = StripColorCodes(name);
+            for (char& c : folded) {
+                c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+            return folded;
+        }
+
+    private:
+        using TermMap = std::map<std::string, std::vector<uint32_t>, std::less<>>;
+
+        static constexpr uint32_t kNone = UINT32_MAX;
+        static constexpr size_t kCompactAfter = 4096;   // Retired records tolerated before postings are rebuilt
+
+        struct Record {
+            uint32_t server;
+            bool alive;
+            int64_t lastSeen;       // Unix time in milliseconds
+            std::string name;
+            std::string folded;
+            std::string slot;
+            std::string guid;
+            std::string steamid;
+            std::string address;
+        };
+
+        struct Server {
+            uint64_t endpoint;      // EndpointKey of the server
+            int protocolId;
+            std::vector<uint32_t> players;
+        };
+
+        // Name tokens are runs of letters and digits; bytes above ASCII count as letters so UTF-8 names stay whole
+        static bool IsTokenChar(char c) {
+            return std::isalnum(static_cast<unsigned char>(c)) || static_cast<unsigned char>(c) >= 0x80;
+        }
+
+        template <typename Fn>
+        static void ForEachToken(std::string_view text, Fn&& fn) {
+            for (size_t i = 0; i < text.size();) {
+                while (i < text.size() && !IsTokenChar(text[i])) ++i;
+                size_t start = i;
+                while (i < text.size() && IsTokenChar(text[i])) ++i;
+                if (i > start) fn(text.substr(start, i - start));
+            }
+        }
+
+        static uint32_t Trigram(std::string_view text, size_t i) {
+            return (static_cast<uint32_t>(static_cast<unsigned char>(text[i])) << 16) |
+                (static_cast<uint32_t>(static_cast<unsigned char>(text[i + 1])) << 8) | static_cast<unsigned char>(text[i + 2]);
+        }
+
+        // Adds id to a posting list once; ids are assigned in increasing order, so lists stay sorted
+        static void Post(std::vector<uint32_t>& postings, uint32_t id) {
+            if (postings.empty() || postings.back() != id) postings.push_back(id);
+        }
+
+        void AddPostings(uint32_t id) {
+            const Record& record = records[id];
+            ForEachToken(record.folded, [&](std::string_view token) {
+                Post(terms[std::string(token)], id);
+            });
+            for (const std::string* identifier : { &record.guid, &record.steamid, &record.address }) {
+                if (!identifier->empty() && *identifier != "0") {
+                    Post(identifiers[Fold(*identifier)], id);
+                }
+            }
+            size_t colon = record.address.rfind(':');
+            if (colon != std::string::npos && colon > 0) {
+                Post(identifiers[Fold(std::string_view(record.address).substr(0, colon))], id);
+            }
+            for (size_t i = 0; i + 3 <= record.folded.size(); ++i) {
+                Post(trigrams[Trigram(record.folded, i)], id);
+            }
+        }
+
+        uint32_t Insert(uint32_t server, Sighting&& sighting, int64_t now) {
+            uint32_t id = static_cast<uint32_t>(records.size());
+            records.push_back({ server, true, now, std::move(sighting.name), std::move(sighting.folded), std::move(sighting.slot),
+                std::move(sighting.guid), std::move(sighting.steamid), std::move(sighting.address) });
+            AddPostings(id);
+            return id;
+        }
+
+        // Posting lists keep a retired id until the next compaction; lookups skip it
+        void Retire(uint32_t id) {
+            records[id] = Record{ records[id].server, false, 0, {}, {}, {}, {}, {}, {} };
+            ++retired;
+        }
+
+        // Drops retired records, renumbers the rest and rebuilds every posting list
+        void Compact() {
+            std::vector<uint32_t> renumbered(records.size(), kNone);
+            std::vector<Record> live;
+            live.reserve(records.size() - retired);
+            for (uint32_t id = 0; id < records.size(); ++id) {
+                if (records[id].alive) {
+                    renumbered[id] = static_cast<uint32_t>(live.size());
+                    live.push_back(std::move(records[id]));
+                }
+            }
+            records = std::move(live);
+            retired = 0;
+            for (Server& server : servers) {
+                for (uint32_t& id : server.players) id = renumbered[id];
+            }
+            terms.clear();
+            identifiers.clear();
+            trigrams.clear();
+            for (uint32_t id = 0; id < records.size(); ++id) {
+                AddPostings(id);
+            }
+        }
+
+        // Ids present in every list: each id of the shortest list is looked up in the others
+        static std::vector<uint32_t> IntersectAll(std::vector<const std::vector<uint32_t>*>& lists) {
+            std::vector<uint32_t> ids;
+            if (lists.empty()) {
+                return ids;
+            }
+            std::sort(lists.begin(), lists.end(), [](const auto* a, const auto* b) { return a->size() < b->size(); });
+            for (uint32_t id : *lists[0]) {
+                if (std::all_of(lists.begin() + 1, lists.end(), [id](const auto* list) { return std::binary_search(list->begin(), list->end(), id); })) {
+                    ids.push_back(id);
+                }
+            }
+            return ids;
+        }
+
+        // Posting list of one term, or the sorted union of the lists of every term starting with it (built in
+        // expanded); null when nothing matches
+        static const std::vector<uint32_t>* TermPostings(const TermMap& map, std::string_view term, bool prefix, std::vector<uint32_t>& expanded) {
+            if (!prefix) {
+                auto it = map.find(term);
+                return it == map.end() ? nullptr : &it->second;
+            }
+            expanded.clear();
+            for (auto it = map.lower_bound(term); it != map.end() && it->first.compare(0, term.size(), term) == 0; ++it) {
+                expanded.insert(expanded.end(), it->second.begin(), it->second.end());
+            }
+            std::sort(expanded.begin(), expanded.end());
+            expanded.erase(std::unique(expanded.begin(), expanded.end()), expanded.end());
+            return expanded.empty() ? nullptr : &expanded;
+        }
+
+        // Records with the query as an identifier, or with every word of the query among their name words, the
+        // last one as a prefix when prefix is set
+        std::vector<uint32_t> Terms(std::string_view query, bool prefix) const {
+            std::vector<uint32_t> ids, expanded;
+            if (const std::vector<uint32_t>* postings = TermPostings(identifiers, query, prefix, expanded)) {
+                ids = *postings;
+            }
+            std::vector<std::string_view> tokens;
+            ForEachToken(query, [&](std::string_view token) { tokens.push_back(token); });
+            std::vector<const std::vector<uint32_t>*> lists;
+            for (size_t i = 0; i < tokens.size(); ++i) {
+                const std::vector<uint32_t>* postings = TermPostings(terms, tokens[i], prefix && i + 1 == tokens.size(), expanded);
+                if (!postings) {
+                    return ids;
+                }
+                lists.push_back(postings);
+            }
+            if (lists.empty()) {
+                return ids;
+            }
+            std::vector<uint32_t> all = IntersectAll(lists);
+            ids.insert(ids.end(), all.begin(), all.end());
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+            return ids;
+        }
+
+        // Records whose folded name contains the query: candidates share all of its trigrams, then each is checked
+        std::vector<uint32_t> Contains(std::string_view query) const {
+            std::vector<uint32_t> ids;
+            if (query.size() < 3) {
+                for (uint32_t id = 0; id < records.size(); ++id) {
+                    if (records[id].alive && records[id].folded.find(query) != std::string::npos) ids.push_back(id);
+                }
+                return ids;
+            }
+            std::vector<const std::vector<uint32_t>*> lists;
+            for (size_t i = 0; i + 3 <= query.size(); ++i) {
+                auto it = trigrams.find(Trigram(query, i));
+                if (it == trigrams.end()) {
+                    return ids;
+                }
+                lists.push_back(&it->second);
+            }
+            ids = IntersectAll(lists);
+            ids.erase(std::remove_if(ids.begin(), ids.end(), [&](uint32_t id) {
+                return records[id].folded.find(query) == std::string::npos;
+            }), ids.end());
+            return ids;
+        }
+
+        std::shared_mutex mutex;
+        std::vector<Record> records;    // Indexed by id; retired records stay until compaction
+        size_t retired = 0;
+        std::vector<Server> servers;
+        std::unordered_map<uint64_t, uint32_t> serverIds;
+        TermMap terms;          // Name words
+        TermMap identifiers;    // guid, steamid, address and address without port
+        std::unordered_map<uint32_t, std::vector<uint32_t>> trigrams;   // Three-byte windows of folded names
+    } playerIndex;
+
+    // Set by GSQ_OPTION_PLAYER_INDEX
+    std::atomic<bool> playerIndexEnabled{ false };
+
+    // Read-write mapping of a whole file, grown to at least the requested size
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        ~MappedFile() { Close(); }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Maps the file; create makes a missing file and grows a short one to minimumSize
+        bool Open(const std::string& path, size_t minimumSize, bool create) {
+#ifdef _WIN32
+            file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                create ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) {
+                return false;
+            }
+            LARGE_INTEGER current;
+            if (!GetFileSizeEx(file, &current)) {
+                Close();
+                return false;
+            }
+            size = static_cast<size_t>(current.QuadPart);
+            if (size < minimumSize) {
+                LARGE_INTEGER wanted;
+                wanted.QuadPart = static_cast<LONGLONG>(minimumSize);
+                if (!create || !SetFilePointerEx(file, wanted, nullptr, FILE_BEGIN) || !SetEndOfFile(file)) {
+                    Close();
+                    return false;
+                }
+                size = minimumSize;
+            }
+            if (size == 0) {
+                Close();
+                return false;
+            }
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+            data = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0) : nullptr;
+#else
+            fd = open(path.c_str(), O_RDWR | (create ? O_CREAT : 0), 0644);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat info;
+            if (fstat(fd, &info) != 0) {
+                Close();
+                return false;
+            }
+            size = static_cast<size_t>(info.st_size);
+            if (size < minimumSize) {
+                if (!create || ftruncate(fd, static_cast<off_t>(minimumSize)) != 0) {
+                    Close();
+                    return false;
+                }
+                size = minimumSize;
+            }
+            if (size == 0) {
+                Close();
+                return false;
+            }
+            data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (data == MAP_FAILED) {
+                data = nullptr;
+            }
+#endif
+            if (!data) {
+                Close();
+                return false;
+            }
+            return true;
+        }
+
+        void Close() {
+#ifdef _WIN32
+            if (data) UnmapViewOfFile(data);
+            if (mapping) CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+            mapping = nullptr;
+            file = INVALID_HANDLE_VALUE;
+#else
+            if (data) munmap(data, size);
+            if (fd >= 0) close(fd);
+            fd = -1;
+#endif
+            data = nullptr;
+            size = 0;
+        }
+
+        void* Data() const { return data; }
+        size_t Size() const { return size; }
+
+    private:
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#else
+        int fd = -1;
+#endif
+        void* data = nullptr;
+        size_t size = 0;
+    };
+
+    // Map names of history samples interned to small IDs. The names are kept in a text file, one per line, so
+    // IDs survive a restart; ID 0 is an empty or missing mapname.
+    class NameTable {
+    public:
+        ~NameTable() { Close(); }
+
+        bool Open(const std::string& path) {
+            std::lock_guard<std::mutex> lock(mutex);
+            names.assign(1, std::string());
+            ids.clear();
+            if (std::FILE* existing = std::fopen(path.c_str(), "rb")) {
+                std::string name;
+                for (int c; (c = std::fgetc(existing)) != EOF;) {
+                    if (c != '\n') {
+                        name += static_cast<char>(c);
+                        continue;
+                    }
+                    ids.emplace(name, static_cast<uint32_t>(names.size()));
+                    names.push_back(std::move(name));
+                    name.clear();
+                }
+                std::fclose(existing);
+            }
+            file = std::fopen(path.c_str(), "ab");
+            return file != nullptr;
+        }
+
+        void Close() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (file) std::fclose(file);
+            file = nullptr;
+        }
+
+        uint32_t Intern(std::string_view name) {
+            if (name.empty()) {
+                return 0;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            std::string key(name);
+            auto it = ids.find(key);
+            if (it != ids.end()) {
+                return it->second;
+            }
+            if (!file || key.find('\n') != std::string::npos) {
+                return 0;
+            }
+            std::fwrite(key.data(), 1, key.size(), file);
+            std::fputc('\n', file);
+            std::fflush(file);
+            uint32_t id = static_cast<uint32_t>(names.size());
+            ids.emplace(key, id);
+            names.push_back(std::move(key));
+            return id;
+        }
+
+        bool Name(uint32_t id, std::string& name) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (id >= names.size()) {
+                return false;
+            }
+            name = names[id];
+            return true;
+        }
+
+    private:
+        std::mutex mutex;
+        std::vector<std::string> names;
+        std::unordered_map<std::string, uint32_t> ids;
+        std::FILE* file = nullptr;
+    };
+
+    // One server's history: a memory-mapped ring of fixed-width samples stored column by column after a
+    // one-page header, so a range of one column is a contiguous array (two when it wraps)
+    class HistoryRing {
+    public:
+        static constexpr size_t kHeaderSize = 4096;
+
+        static size_t FileSize(uint32_t capacity) {
+            return kHeaderSize + static_cast<size_t>(capacity) * (sizeof(int64_t) + 2 * sizeof(uint32_t) + 2 * sizeof(uint16_t));
+        }
+
+        // Maps the server's ring file; a new file is laid out for capacity samples.
+        // An existing file is opened at its current size, so it keeps its own capacity.
+        bool Open(const std::string& path, uint64_t endpoint, int protocolId, uint32_t capacity, bool create) {
+            if (!file.Open(path, kHeaderSize, create)) {
+                return false;
+            }
+            header = static_cast<Header*>(file.Data());
+            if (header->capacity == 0 && std::all_of(header->magic, header->magic + sizeof(header->magic), [](char c) { return c == 0; })) {
+                file.Close();
+                if (!create || !file.Open(path, FileSize(capacity), true)) {
+                    return false;
+                }
+                header = static_cast<Header*>(file.Data());
+                std::memcpy(header->magic, kMagic, sizeof(header->magic));
+                header->capacity = capacity;
+                header->protocolId = static_cast<uint32_t>(protocolId);
+                header->endpoint = endpoint;
+            }
+            if (std::memcmp(header->magic, kMagic, sizeof(header->magic)) != 0 || header->capacity == 0 ||
+                FileSize(header->capacity) > file.Size()) {
+                file.Close();
+                return false;
+            }
+            char* base = static_cast<char*>(file.Data()) + kHeaderSize;
+            size_t count = header->capacity;
+            timestamps = reinterpret_cast<int64_t*>(base);
+            mapIds = reinterpret_cast<uint32_t*>(timestamps + count);
+            rttMicros = mapIds + count;
+            players = reinterpret_cast<uint16_t*>(rttMicros + count);
+            averagePing = players + count;
+            return true;
+        }
+
+        // Writes one sample over the oldest and then publishes it by advancing the write count. Timestamps never
+        // go backwards, so ranges can be found by binary search.
+        void Append(int64_t timestamp, uint16_t playerCount, std::string_view map, NameTable& names, uint16_t ping, uint32_t rtt) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (map != lastMap) {
+                lastMap.assign(map.data(), map.size());
+                lastMapId = names.Intern(map);
+            }
+            uint64_t written = header->written;
+            size_t slot = static_cast<size_t>(written % header->capacity);
+            timestamps[slot] = (std::max)(timestamp, written ? header->lastTimestamp : timestamp);
+            players[slot] = playerCount;
+            mapIds[slot] = lastMapId;
+            averagePing[slot] = ping;
+            rttMicros[slot] = rtt;
+            header->lastTimestamp = timestamps[slot];
+            header->written = written + 1;
+        }
+
+        // Points spans at the samples taken between from and to (inclusive), oldest first; returns the span count
+        int Read(int64_t from, int64_t to, GameServerHistorySpan* spans) {
+            std::lock_guard<std::mutex> lock(mutex);
+            uint64_t written = header->written;
+            size_t capacity = header->capacity;
+            size_t count = static_cast<size_t>((std::min)(written, static_cast<uint64_t>(capacity)));
+            size_t oldest = written > capacity ? static_cast<size_t>(written % capacity) : 0;
+            auto at = [&](size_t i) { return timestamps[(oldest + i) % capacity]; };
+            size_t lo = 0, hi = count;
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (at(mid) < from) lo = mid + 1; else hi = mid;
+            }
+            size_t first = lo;
+            hi = count;
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (at(mid) <= to) lo = mid + 1; else hi = mid;
+            }
+            size_t end = lo;
+
+            int used = 0;
+            while (first < end) {
+                size_t physical = (oldest + first) % capacity;
+                size_t length = (std::min)(end - first, capacity - physical);
+                GameServerHistorySpan& span = spans[used++];
+                span.count = static_cast<int>(length);
+                span.timestamps = reinterpret_cast<const long long*>(timestamps + physical);
+                span.players = players + physical;
+                span.mapIds = mapIds + physical;
+                span.averagePing = averagePing + physical;
+                span.rttMicros = rttMicros + physical;
+                first += length;
+            }
+            return used;
+        }
+
+    private:
+        static constexpr char kMagic[8] = { 'G', 'S', 'Q', 'H', 'I', 'S', 'T', '1' };
+
+        struct Header {
+            char magic[8];
+            uint32_t capacity;          // Samples the ring holds
+            uint32_t protocolId;
+            uint64_t endpoint;          // EndpointKey of the server
+            uint64_t written;           // Samples appended since the file was created; the next goes to written % capacity
+            int64_t lastTimestamp;
+        };
+
+        MappedFile file;
+        Header* header = nullptr;
+        int64_t* timestamps = nullptr;  // Unix time in milliseconds
+        uint32_t* mapIds = nullptr;
+        uint32_t* rttMicros = nullptr;
+        uint16_t* players = nullptr;
+        uint16_t* averagePing = nullptr;
+        std::mutex mutex;
+        std::string lastMap;            // Map of the previous sample, so steady polls skip the string table
+        uint32_t lastMapId = 0;
+    };
+
+    // Optional sink that keeps a ring file per server in one directory, fed by every getstatus reply from a
+    // server while it is open
+    class HistoryStore {
+    public:
+        bool Enabled() const { return enabled.load(std::memory_order_relaxed); }
+
+        // Closes any open store, then starts one in directory with rings of capacity samples for new servers
+        bool Open(const std::string& path, uint32_t ringCapacity) {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            CloseLocked();
+            std::error_code error;
+            std::filesystem::create_directories(path, error);
+            if (!names.Open(path + "/maps.txt")) {
+                return false;
+            }
+            directory = path;
+            capacity = ringCapacity;
+            enabled = true;
+            return true;
+        }
+
+        void Close() {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            CloseLocked();
+        }
+
+        void Append(uint64_t server, int protocolId, size_t playerCount, std::string_view map, uint16_t ping, Clock::duration rtt) {
+            int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            uint32_t micros = static_cast<uint32_t>((std::min)(static_cast<int64_t>(UINT32_MAX),
+                static_cast<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(rtt).count())));
+            uint16_t count = static_cast<uint16_t>((std::min)(playerCount, size_t(UINT16_MAX)));
+            WithRing(server, protocolId, true, [&](HistoryRing& ring) { ring.Append(now, count, map, names, ping, micros); });
+        }
+
+        // Spans of a server's samples between from and to; returns the span count, or -1 if no store is open
+        int Read(uint64_t server, int64_t from, int64_t to, GameServerHistorySpan* spans) {
+            int used = -1;
+            if (!WithRing(server, 0, false, [&](HistoryRing& ring) { used = ring.Read(from, to, spans); })) {
+                return Enabled() ? 0 : -1;
+            }
+            return used;
+        }
+
+        bool MapName(uint32_t id, std::string& name) {
+            return names.Name(id, name);
+        }
+
+    private:
+        void CloseLocked() {
+            enabled = false;
+            rings.clear();
+            names.Close();
+        }
+
+        // Runs fn on the server's ring under the shared lock, opening the ring file on first use. Reads only
+        // open existing files; returns false if there is no usable ring.
+        template <typename Fn>
+        bool WithRing(uint64_t server, int protocolId, bool create, Fn&& fn) {
+            {
+                std::shared_lock<std::shared_mutex> lock(mutex);
+                auto it = rings.find(server);
+                if (it != rings.end()) {
+                    if (!it->second) return false;
+                    fn(*it->second);
+                    return true;
+                }
+                if (!Enabled()) return false;
+            }
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            if (!Enabled()) {
+                return false;
+            }
+            auto it = rings.find(server);
+            if (it == rings.end()) {
+                char name[48];
+                snprintf(name, sizeof(name), "/%u.%u.%u.%u_%u.gsqh", static_cast<unsigned>(server >> 40) & 0xFF,
+                    static_cast<unsigned>(server >> 32) & 0xFF, static_cast<unsigned>(server >> 24) & 0xFF,
+                    static_cast<unsigned>(server >> 16) & 0xFF, static_cast<unsigned>(server & 0xFFFF));
+                auto ring = std::make_unique<HistoryRing>();
+                bool opened = ring->Open(directory + name, server, protocolId, capacity, create);
+                // A failed write-side open is remembered so a bad file is not retried on every poll
+                if (!opened && !create) {
+                    return false;
+                }
+                it = rings.insert_or_assign(server, opened ? std::move(ring) : nullptr).first;
+            }
+            if (!it->second) {
+                return false;
+            }
+            fn(*it->second);
+            return true;
+        }
+
+        std::shared_mutex mutex;    // Guards the ring table; each ring serializes its own appends
+        std::atomic<bool> enabled{ false };
+        std::string directory;
+        uint32_t capacity = 0;
+        std::unordered_map<uint64_t, std::unique_ptr<HistoryRing>> rings;
+        NameTable names;
+    } historyStore;
+
+    // Averages a server's samples into buckets of bucketMs starting at from; empty buckets are left out.
+    // Returns the number of buckets written, or -1 if no store is open.
+    int DownsampleHistory(uint64_t server, int64_t from, int64_t to, int64_t bucketMs, GameServerHistoryBucket* buckets, int maxBuckets) {
+        GameServerHistorySpan spans[2];
+        int used = historyStore.Read(server, from, to, spans);
+        if (used < 0) {
+            return -1;
+        }
+        int written = 0;
+        double players = 0, ping = 0, rtt = 0;
+        int pinged = 0;
+        GameServerHistoryBucket* bucket = nullptr;
+        auto finish = [&]() {
+            if (bucket) {
+                bucket->averagePlayers = static_cast<float>(players / bucket->samples);
+                bucket->averagePing = pinged ? static_cast<float>(ping / pinged) : -1.0f;
+                bucket->averageRttMs = static_cast<float>(rtt / bucket->samples / 1000.0);
+            }
+        };
+        for (int s = 0; s < used; ++s) {
+            const GameServerHistorySpan& span = spans[s];
+            for (int i = 0; i < span.count; ++i) {
+                long long start = from + (span.timestamps[i] - from) / bucketMs * bucketMs;
+                if (!bucket || bucket->start != start) {
+                    finish();
+                    if (written == maxBuckets) {
+                        return written;
+                    }
+                    bucket = &buckets[written++];
+                    *bucket = GameServerHistoryBucket();
+                    bucket->start = start;
+                    bucket->minPlayers = span.players[i];
+                    players = ping = rtt = 0;
+                    pinged = 0;
+                }
+                ++bucket->samples;
+                bucket->minPlayers = (std::min)(bucket->minPlayers, static_cast<int>(span.players[i]));
+                bucket->maxPlayers = (std::max)(bucket->maxPlayers, static_cast<int>(span.players[i]));
+                bucket->mapId = span.mapIds[i];
+                players += span.players[i];
+                if (span.averagePing[i] != GSQ_HISTORY_NO_PING) {
+                    ping += span.averagePing[i];
+                    ++pinged;
+                }
+                rtt += span.rttMicros[i];
+            }
+        }
+        finish();
+        return written;
+    }
+
+    void ObserveStatus(std::string_view map, const StatusPlayerList& players) {
+        ReplyObservation* observation = ReplyObservation::Current();
+        if (!observation || observation->rcon) {
+            return;
+        }
+        int protocolId = observation->protocolId;
+        if (historyStore.Enabled()) {
+            uint16_t ping = GSQ_HISTORY_NO_PING;
+            if (protocolTable[protocolId].statusPings) {
+                uint64_t pingTotal = 0;
+                for (const StatusPlayer& player : players) {
+                    unsigned value = 0;
+                    std::from_chars(player.ping.data(), player.ping.data() + player.ping.size(), value);
+                    pingTotal += value;
+                }
+                ping = players.empty() ? 0 : static_cast<uint16_t>((std::min)(pingTotal / players.size(), uint64_t(GSQ_HISTORY_NO_PING - 1)));
+            }
+            historyStore.Append(observation->server, protocolId, players.size(), map, ping, observation->rtt);
+        }
+        if (playerIndexEnabled) {
+            bool slots = protocolTable[protocolId].statusSlots;
+            std::vector<PlayerIndex::Sighting> sightings;
+            sightings.reserve(players.size());
+            for (const StatusPlayer& player : players) {
+                PlayerIndex::Sighting& sighting = sightings.emplace_back();
+                sighting.name = player.name;
+                sighting.folded = PlayerIndex::Fold(player.name);
+                if (slots) sighting.slot = player.slot;
+            }
+            playerIndex.Update(observation->server, protocolId, sightings, false);
+        }
+    }
+
+    void ObserveStatus(const StructuralIndex& index, const StatusPlayerList& players) {
+        ReplyObservation* observation = ReplyObservation::Current();
+        if (!observation || observation->rcon) {
+            return;
+        }
+        std::string_view map;
+        if (historyStore.Enabled()) {
+            ForEachKeyValue(index, [&map](std::string_view key, std::string_view value) {
+                if (key == "mapname") map = value;
+            });
+        }
+        ObserveStatus(map, players);
+    }
+
+    void ObserveStatus(std::string_view body) {
+        ReplyObservation* observation = ReplyObservation::Current();
+        if (observation && !observation->rcon && (playerIndexEnabled || historyStore.Enabled())) {
+            StructuralIndex index(body);
+            ObserveStatus(index, ParseGetStatusPlayers(index, observation->protocolId));
+        }
+    }
+
+    void ObserveRconStatus(const RconPlayerList& players) {
+        ReplyObservation* observation = ReplyObservation::Current();
+        if (!observation || !observation->rcon || !playerIndexEnabled) {
+            return;
+        }
+        std::vector<PlayerIndex::Sighting> sightings;
+        sightings.reserve(players.size());
+        for (const RconPlayer& player : players) {
+            PlayerIndex::Sighting& sighting = sightings.emplace_back();
+            sighting.name = player[COL_NAME];
+            sighting.folded = PlayerIndex::Fold(player[COL_NAME]);
+            sighting.slot = player[COL_SLOT];
+            if (player.Has(COL_GUID)) sighting.guid = player[COL_GUID];
+            if (player.Has(COL_STEAMID)) sighting.steamid = player[COL_STEAMID];
+            if (player.Has(COL_ADDRESS)) sighting.address = player[COL_ADDRESS];
+        }
+        playerIndex.Update(observation->server, observation->protocolId, sightings, true);
+    }
+
+    void ObserveRconStatus(std::string_view text) {
+        ReplyObservation* observation = ReplyObservation::Current();
+        if (observation && observation->rcon && playerIndexEnabled) {
+            ObserveRconStatus(ParseRconStatusPlayers(text, observation->protocolId));
+        }
+    }
+}
+
+namespace {
+    // Player fields gathered before a typed result is laid out; the views point into the parsed reply
+    struct PlayerRecord {
+        int slot = 0;
+        int score = 0;
+        int ping = 0;
+        int lastmsg = 0;
+        int qport = 0;
+        int rate = 0;
+        std::string_view name;
+        std::string cleanName;
+        std::string_view address;
+        std::string_view guid;
+        std::string_view playerid;
+        std::string_view steamid;
+    };
+
+    // Converts a numeric field; empty or malformed text becomes 0
+    int ToInt(std::string_view text) {
+        int value = 0;
+        std::from_chars(text.data(), text.data() + text.size(), value);
+        return value;
+    }
+
+    // Maps an error message (without "error=") to its result code
+    int ErrorCode(std::string_view message) {
+        static const std::pair<const char*, int> codes[] = {
+            { "Null input parameters", GSQ_RESULT_INVALID_ARGUMENT },
+            { "Invalid protocol ID", GSQ_RESULT_INVALID_ARGUMENT },
+            { "Invalid port", GSQ_RESULT_INVALID_ARGUMENT },
+            { "Invalid IP address", GSQ_RESULT_INVALID_ARGUMENT },
+            { "Empty command", GSQ_RESULT_INVALID_ARGUMENT },
+            { "Invalid field list", GSQ_RESULT_INVALID_ARGUMENT },
+            { "Invalid player lookup", GSQ_RESULT_INVALID_ARGUMENT },
+            { "Invalid command", GSQ_RESULT_UNSUPPORTED_COMMAND },
+            { "Unsupported command", GSQ_RESULT_UNSUPPORTED_COMMAND },
+            { "Failed to resolve hostname", GSQ_RESULT_RESOLVE_FAILED },
+            { "Winsock initialization failed", GSQ_RESULT_NETWORK_ERROR },
+            { "Socket creation failed", GSQ_RESULT_NETWORK_ERROR },
+            { "Send failed", GSQ_RESULT_NETWORK_ERROR },
+            { "Receive failed", GSQ_RESULT_TIMEOUT },
+            { "Invalid server response", GSQ_RESULT_INVALID_RESPONSE },
+            { "Empty response", GSQ_RESULT_INVALID_RESPONSE },
+            { "Cancelled", GSQ_RESULT_DROPPED },
+        };
+        for (const auto& code : codes) {
+            if (message.compare(0, std::strlen(code.first), code.first) == 0) {
+                return code.second;
+            }
+        }
+        return GSQ_RESULT_INTERNAL_ERROR;
+    }
+
+    // Whether an rcon reply is the server refusing the password
+    bool IsRconRejection(std::string_view text) {
+        text = Trim(text);
+        return text.compare(0, 16, "Bad rconpassword") == 0 || text.compare(0, 19, "No rconpassword set") == 0;
+    }
+
+    // Lays out a typed result in one malloc block: the header, the key/value and player arrays, then every string
+    GameServerResult* BuildResult(int status, std::string_view error, std::string_view text, const KeyValueList& info, const std::vector<PlayerRecord>& players) {
+        size_t stringBytes = error.size() + text.size() + 2;
+        for (const auto& pair : info) {
+            stringBytes += pair.first.size() + pair.second.size() + 2;
+        }
+        for (const PlayerRecord& player : players) {
+            stringBytes += player.name.size() + player.cleanName.size() + player.address.size() +
+                player.guid.size() + player.playerid.size() + player.steamid.size() + 6;
+        }
+        const size_t infoOffset = sizeof(GameServerResult);
+        const size_t playersOffset = infoOffset + info.size() * sizeof(GameServerKeyValue);
+        const size_t stringsOffset = playersOffset + players.size() * sizeof(GameServerPlayer);
+        char* block = static_cast<char*>(malloc(stringsOffset + stringBytes));
+        if (!block) {
+            return nullptr;
+        }
+        char* next = block + stringsOffset;
+        auto store = [&next](std::string_view value) {
+            const char* stored = next;
+            if (!value.empty()) {
+                std::memcpy(next, value.data(), value.size());
+                next += value.size();
+            }
+            *next++ = '\0';
+            return stored;
+        };
+
+        auto* result = reinterpret_cast<GameServerResult*>(block);
+        auto* serverInfo = reinterpret_cast<GameServerKeyValue*>(block + infoOffset);
+        auto* records = reinterpret_cast<GameServerPlayer*>(block + playersOffset);
+        result->status = status;
+        result->error = store(error);
+        result->text = store(text);
+        result->serverInfoCount = static_cast<int>(info.size());
+        result->serverInfo = serverInfo;
+        result->playerCount = static_cast<int>(players.size());
+        result->players = records;
+        for (size_t i = 0; i < info.size(); ++i) {
+            serverInfo[i].key = store(info[i].first);
+            serverInfo[i].value = store(info[i].second);
+        }
+        for (size_t i = 0; i < players.size(); ++i) {
+            const PlayerRecord& player = players[i];
+            GameServerPlayer& record = records[i];
+            record.slot = player.slot;
+            record.score = player.score;
+            record.ping = player.ping;
+            record.lastmsg = player.lastmsg;
+            record.qport = player.qport;
+            record.rate = player.rate;
+            record.name = store(player.name);
+            record.cleanName = store(player.cleanName);
+            record.address = store(player.address);
+            record.guid = store(player.guid);
+            record.playerid = store(player.playerid);
+            record.steamid = store(player.steamid);
+        }
+        return result;
+    }
+
+    GameServerResult* ErrorResult(int status, std::string_view message) {
+        return BuildResult(status, message, {}, {}, {});
+    }
+
+    // Converts the raw output of a command (or its "error=" string) into a typed result
+    GameServerResult* TypedResult(int protocolId, const std::string& cmd, const std::string& raw) {
+        ParseArena arena;
+        if (raw.compare(0, 6, "error=") == 0) {
+            std::string_view message = std::string_view(raw).substr(6);
+            message = message.substr(0, message.find(';'));    // Drop the ";raw=" attachment
+            return ErrorResult(ErrorCode(message), message);
+        }
+        if (cmd == "getstatus" || cmd == "getinfo") {
+            StructuralIndex index(raw);
+            StatusPlayerList players = ParseGetStatusPlayers(index, protocolId);
+            std::vector<PlayerRecord> records(players.size());
+            for (size_t i = 0; i < players.size(); ++i) {
+                records[i].slot = ToInt(players[i].slot);
+                records[i].score = ToInt(players[i].score);
+                records[i].ping = ToInt(players[i].ping);
+                records[i].name = players[i].name;
+                records[i].cleanName = StripColorCodes(players[i].name);
+            }
+            return BuildResult(GSQ_RESULT_OK, {}, {}, ParseKeyValues(index), records);
+        }
+        if (IsRconRejection(raw)) {
+            return BuildResult(GSQ_RESULT_BAD_RCON_PASSWORD, "Bad rcon password", Trim(raw), {}, {});
+        }
+        if (cmd == "rcon status") {
+            RconPlayerList players = ParseRconStatusPlayers(raw, protocolId);
+            std::vector<PlayerRecord> records(players.size());
+            for (size_t i = 0; i < players.size(); ++i) {
+                const RconPlayer& player = players[i];
+                PlayerRecord& record = records[i];
+                record.slot = ToInt(player[COL_SLOT]);
+                record.score = ToInt(player[COL_SCORE]);
+                record.ping = ToInt(player[COL_PING]);
+                record.lastmsg = ToInt(player[COL_LASTMSG]);
+                record.qport = ToInt(player[COL_QPORT]);
+                record.rate = ToInt(player[COL_RATE]);
+                record.name = player[COL_NAME];
+                record.cleanName = StripColorCodes(record.name);
+                record.address = player[COL_ADDRESS];
+                record.guid = player[COL_GUID];
+                record.playerid = player[COL_PLAYERID];
+                record.steamid = player[COL_STEAMID];
+            }
+            return BuildResult(GSQ_RESULT_OK, {}, {}, {}, records);
+        }
+        if (cmd.compare(0, 9, "rcon map ") == 0) {
+            return BuildResult(GSQ_RESULT_OK, {}, "Map changed to " + cmd.substr(9), {}, {});
+        }
+        return BuildResult(GSQ_RESULT_OK, {}, raw, {}, {});
+    }
+
+    // Parses a captured packet the way the protocol handler parses a received one
+    std::string ParseCapturedResponse(int protocolId, bool raw, const char* command, const char* response) {
+        if (!command || !response) {
+            return "error=Null input parameters";
+        }
+        ProtocolHandler* handler = HandlerFor(protocolId);
+        if (!handler) {
+            return "error=Invalid protocol ID";
+        }
+        std::string cmd = SanitizeCommand(command);
+        if (cmd.empty()) {
+            return "error=Empty command";
+        }
+        std::string packet = TakeSpareString();
+        packet.assign(response);
+        return TimedParse(handler, protocolId, raw, cmd, std::move(packet), 0, Clock::duration::zero());
+    }
+}
+
+namespace {
+    // Console command as an rcon command; the "rcon " prefix is optional for callers
+    std::string RconCommand(const char* command) {
+        std::string rconCommand(Trim(command));
+        if (rconCommand.compare(0, 5, "rcon ") != 0) {
+            rconCommand.insert(0, "rcon ");
+        }
+        return rconCommand;
+    }
+
+    // Per-server rcon command queues on the asynchronous reactor. Each server is one multiplexer endpoint queue,
+    // so its commands go out one at a time in submission order and every "print" reply belongs to the command in
+    // flight; the multiplexer holds each command back until the server's minimum interval since the previous
+    // one has passed. Queues of different servers are independent, so a fleet-wide burst runs in parallel at
+    // the pace each server allows.
+    class RconQueue {
+    public:
+        static constexpr int kMaxQueuedPerServer = 256;
+
+        // Outcomes are delivered through this object, so the reactor must stop before it is destroyed
+        ~RconQueue() { asyncReactor.Stop(); }
+
+        uint64_t Submit(int protocolId, const char* ipOrHostname, int port, const char* command, const char* rconPassword,
+            int minIntervalMs, int timeoutMs, GameServerRconCallback callback, void* userData) {
+            QueryMultiplexer::Query query;
+            std::string error = PrepareQuery(protocolId, true, ipOrHostname, port, RconCommand(command).c_str(), rconPassword, query);
+            auto pending = std::make_unique<Pending>(Pending{ callback, userData, EndpointKey(query.server), error.empty() });
+            if (pending->counted) {
+                query.deadline = Clock::time_point::max();  // Waiting in the queue never times out; the reply deadline starts at the send
+                query.replyTimeout = std::chrono::milliseconds(timeoutMs > 0 ? timeoutMs : rttEstimator.TimeoutMs(pending->endpoint, QueryTimeoutMs(query.cmd)));
+                query.minSpacing = std::chrono::milliseconds(minIntervalMs);
+                query.expected = "print";
+                query.unparsed = true;
+                std::lock_guard<std::mutex> lock(mutex);
+                int& count = queued[pending->endpoint];
+                if (count >= kMaxQueuedPerServer) {
+                    return 0;
+                }
+                ++count;
+            }
+            uint64_t handle = asyncReactor.Submit(std::move(query), error, OnResult, pending.get());
+            if (!handle) {
+                Release(*pending);
+                return 0;
+            }
+            pending.release();
+            return handle;
+        }
+
+    private:
+        struct Pending {
+            GameServerRconCallback callback;
+            void* userData;
+            uint64_t endpoint;
+            bool counted;                       // Holds a place in the endpoint's queue limit
+        };
+
+        void Release(const Pending& pending) {
+            if (!pending.counted) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = queued.find(pending.endpoint);
+            if (it != queued.end() && --it->second == 0) {
+                queued.erase(it);
+            }
+        }
+
+        // Reactor callback; the response is the reply packets as received or an "error=" string
+        static void OnResult(GameServerQueryHandle handle, const char* response, void* userData);
+
+        std::mutex mutex;
+        std::unordered_map<uint64_t, int> queued;  // Endpoint -> commands submitted and not yet completed
+    } rconQueue;
+
+    // Sends an rcon packet from a throwaway socket without waiting for the reply, which is discarded with the
+    // socket instead of lingering in a pooled one; returns a GameServerResultCode
+    int SendRconDatagram(int protocolId, const char* ipOrHostname, int port, const char* command, const char* rconPassword) {
+        NetworkScope network;
+        if (!network.ok) {
+            return GSQ_RESULT_NETWORK_ERROR;
+        }
+        QueryMultiplexer::Query query;
+        std::string error = PrepareQuery(protocolId, true, ipOrHostname, port, RconCommand(command).c_str(), rconPassword, query);
+        if (!error.empty()) {
+            return ErrorCode(std::string_view(error).substr(6));
+        }
+        SOCKET sock = OpenQuerySocket();
+        if (sock == INVALID_SOCKET) {
+            return GSQ_RESULT_NETWORK_ERROR;
+        }
+        ++metrics.queries;
+        ++metrics.sendCalls;
+        int sent = sendto(sock, query.query.c_str(), static_cast<int>(query.query.size()), 0, (sockaddr*)&query.server, sizeof(query.server));
+        closesocket(sock);
+        if (sent == SOCKET_ERROR) {
+            ++metrics.sendErrors;
+            return GSQ_RESULT_NETWORK_ERROR;
+        }
+        metrics.bytesOut += sent;
+        return GSQ_RESULT_OK;
+    }
+
+    // Server setting a write is expected to change: "map"/"devmap <name>" set mapname and
+    // "set"/"seta"/"sets <cvar> <value>" set the cvar. Returns false for other commands.
+    bool ImpliedSetting(const std::string& cmd, std::string& key, std::string& value) {
+        std::string_view args = Trim(std::string_view(cmd).substr(5));
+        std::string_view verb = args.substr(0, args.find(' '));
+        std::string_view rest = Trim(args.substr(verb.size()));
+        if (rest.empty()) {
+            return false;
+        }
+        if (verb == "map" || verb == "devmap") {
+            key = "mapname";
+            value = std::string(rest);
+            return true;
+        }
+        if (verb == "set" || verb == "seta" || verb == "sets") {
+            std::string_view name = rest.substr(0, rest.find(' '));
+            std::string_view setting = Trim(rest.substr(name.size()));
+            if (setting.size() >= 2 && setting.front() == '"' && setting.back() == '"') {
+                setting = setting.substr(1, setting.size() - 2);
+            }
+            if (setting.empty()) {
+                return false;
+            }
+            key = std::string(name);
+            value = std::string(setting);
+            return true;
+        }
+        return false;
+    }
+
+    // Confirms rcon writes by polling getstatus on the watch scheduler until a server setting has the expected
+    // value or the deadline passes. Each verification is a temporary watch that removes itself when it reports.
+    class WriteVerifier {
+    public:
+        // Polls report into this object, so their watches must be removed before it is destroyed
+        ~WriteVerifier() {
+            std::vector<uint64_t> handles;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (const auto& entry : pending) handles.push_back(entry.first);
+            }
+            for (uint64_t handle : handles) {
+                watchScheduler.Remove(handle);
+            }
+        }
+
+        struct Verification {
+            std::string key;
+            std::string expected;
+            Clock::time_point deadline;
+            GameServerVerifyCallback callback;
+            void* userData;
+            std::string observed;               // Latest value the server reported
+        };
+
+        bool Add(int protocolId, const char* ipOrHostname, int port, int pollIntervalMs, Verification verification) {
+            std::lock_guard<std::mutex> lock(mutex);
+            WatchScheduler::Watch watch = { protocolId, true, ipOrHostname, port, "getstatus", "", pollIntervalMs, OnPoll, this };
+            watch.staggered = false;            // The first poll gives the server one interval to apply the change
+            uint64_t handle = watchScheduler.Add(std::move(watch));
+            if (handle == 0) {
+                return false;
+            }
+            pending.emplace(handle, std::move(verification));
+            return true;
+        }
+
+        // Reports every unfinished verification as dropped
+        void DropAll() {
+            std::unordered_map<uint64_t, Verification> dropped;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                dropped.swap(pending);
+            }
+            for (auto& entry : dropped) {
+                watchScheduler.Remove(entry.first);
+                Report(entry.second, GSQ_RESULT_DROPPED);
+            }
+        }
+
+    private:
+        static void OnPoll(GameServerWatchHandle handle, const char* response, void* userData) {
+            static_cast<WriteVerifier*>(userData)->Check(handle, response);
+        }
+
+        void Check(uint64_t handle, std::string_view response) {
+            Verification verification;
+            int status;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = pending.find(handle);
+                if (it == pending.end()) {
+                    return;                     // Being dropped
+                }
+                if (response.compare(0, 6, "error=") != 0) {
+                    for (const KeyValueView& setting : ParseKeyValues(response)) {
+                        if (EqualsIgnoreCase(setting.first, it->second.key)) {
+                            it->second.observed = std::string(setting.second);
+                            break;
+                        }
+                    }
+                }
+                if (EqualsIgnoreCase(it->second.observed, it->second.expected)) {
+                    status = GSQ_RESULT_OK;
+                }
+                else if (Clock::now() >= it->second.deadline) {
+                    status = GSQ_RESULT_TIMEOUT;
+                }
+                else {
+                    return;
+                }
+                verification = std::move(it->second);
+                pending.erase(it);
+            }
+            watchScheduler.Remove(handle);
+            Report(verification, status);
+        }
+
+        static void Report(const Verification& verification, int status) {
+            try {
+                verification.callback(status, verification.observed.c_str(), verification.userData);
+            }
+            catch (...) {
+                // Exceptions must not unwind through the reactor thread
+            }
+        }
+
+        static bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+            return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+                [](char x, char y) { return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y)); });
+        }
+
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Verification> pending;    // Watch handle -> verification
+    } writeVerifier;
+
+    // Splits a target list into one contiguous shard per worker thread. Each worker owns a multiplexer, and with it
+    // a socket, receive buffers and the handler parsing of its replies. It takes targets from the front of its own
+    // shard and, once that runs dry, steals the back half of the fullest other shard.
+    class ShardedScan {
+    public:
+        ShardedScan(const GameServerQueryRequest* targets, int count, int threads, int timeoutMs, GameServerListCallback callback, void* userData)
+            : targets(targets), count(static_cast<size_t>(count)), timeout(std::chrono::milliseconds(timeoutMs)), callback(callback), userData(userData) {
+            size_t workers = threads > 0 ? static_cast<size_t>(threads) : (std::max)(1u, std::thread::hardware_concurrency());
+            workers = (std::min)({ workers, kMaxWorkers, (std::max)(size_t(1), this->count) });
+            for (size_t i = 0; i < workers; ++i) {
+                auto shard = std::make_unique<Shard>();
+                shard->begin = this->count * i / workers;
+                shard->end = this->count * (i + 1) / workers;
+                shards.push_back(std::move(shard));
+            }
+        }
+
+        // Runs the workers to completion; returns the number of targets that replied
+        int Run() {
+            std::vector<std::thread> workers;
+            for (size_t i = 1; i < shards.size(); ++i) {
+                workers.emplace_back(&ShardedScan::Work, this, i);
+            }
+            Work(0);
+            for (auto& worker : workers) {
+                worker.join();
+            }
+            return replies;
+        }
+
+    private:
+        static constexpr size_t kMaxWorkers = 64;
+        static constexpr size_t kWindow = 256;     // Queries a worker keeps queued in its multiplexer
+        static constexpr size_t kChunk = 32;       // Targets a worker takes from its shard at a time
+
+        struct Shard {
+            std::mutex mutex;
+            size_t begin = 0;
+            size_t end = 0;
+        };
+
+        // Hands out the next chunk of the worker's shard, refilling the shard by stealing when it is empty
+        bool Take(size_t self, size_t& begin, size_t& end) {
+            for (;;) {
+                {
+                    Shard& own = *shards[self];
+                    std::lock_guard<std::mutex> lock(own.mutex);
+                    if (own.begin < own.end) {
+                        begin = own.begin;
+                        end = own.begin = (std::min)(own.end, own.begin + kChunk);
+                        return true;
+                    }
+                }
+                size_t victim = self;
+                size_t most = 0;
+                for (size_t i = 0; i < shards.size(); ++i) {
+                    std::lock_guard<std::mutex> lock(shards[i]->mutex);
+                    if (shards[i]->end - shards[i]->begin > most) {
+                        most = shards[i]->end - shards[i]->begin;
+                        victim = i;
+                    }
+                }
+                if (most == 0) {
+                    return false;
+                }
+                size_t stolenBegin, stolenEnd;
+                {
+                    std::lock_guard<std::mutex> lock(shards[victim]->mutex);
+                    Shard& shard = *shards[victim];
+                    if (shard.begin == shard.end) {
+                        continue;   // Drained while we looked; pick again
+                    }
+                    stolenEnd = shard.end;
+                    stolenBegin = shard.end = shard.end - (shard.end - shard.begin + 1) / 2;
+                }
+                ++metrics.scanSteals;
+                std::lock_guard<std::mutex> lock(shards[self]->mutex);
+                shards[self]->begin = stolenBegin;
+                shards[self]->end = stolenEnd;
+            }
+        }
+
+        void Work(size_t self) {
+            QueryMultiplexer mux([this](uint64_t id, bool replied, const std::string& result) {
+                if (replied) ++replies;
+                callback(static_cast<int>(id), result.c_str(), userData);
+            });
+            bool open = mux.Open();
+            size_t next = 0, last = 0;
+            for (;;) {
+                // With no socket the worker still drains targets, failing each, so every target is reported once
+                while (!open || mux.Pending() < kWindow) {
+                    if (next == last && !Take(self, next, last)) {
+                        break;
+                    }
+                    size_t i = next++;
+                    const GameServerQueryRequest& target = targets[i];
+                    QueryMultiplexer::Query query;
+                    std::string error = PrepareQuery(target.protocolId, target.raw, target.ipOrHostname, target.port, target.command, target.rconPassword, query);
+                    if (error.empty() && !open) {
+                        error = "error=Socket creation failed";
+                    }
+                    if (!error.empty()) {
+                        callback(static_cast<int>(i), error.c_str(), userData);
+                        continue;
+                    }
+                    query.deadline = Clock::now() + timeout;
+                    mux.Add(i, std::move(query));
+                }
+                if (mux.Pending() == 0) {
+                    break;
+                }
+                mux.Poll(Clock::now() + timeout);
+            }
+        }
+
+        const GameServerQueryRequest* targets;
+        size_t count;
+        Clock::duration timeout;
+        GameServerListCallback callback;
+        void* userData;
+        std::vector<std::unique_ptr<Shard>> shards;
+        std::atomic<int> replies{ 0 };
+    };
+
+    void RconQueue::OnResult(GameServerQueryHandle handle, const char* response, void* userData) {
+        std::unique_ptr<Pending> pending(static_cast<Pending*>(userData));
+        rconQueue.Release(*pending);
+        std::string_view text(response);
+        int status = GSQ_RESULT_OK;
+        std::string output;
+        if (text.compare(0, 6, "error=") == 0) {
+            text.remove_prefix(6);
+            status = ErrorCode(text);
+            output = text;
+        }
+        else {
+            size_t header = ResponseHeaderLength(text, "print");
+            if (header > 0 && header < text.size() && text[header] == '\n') {
+                ++header;
+            }
+            output = text.substr(header);
+            if (IsRconRejection(output)) {
+                status = GSQ_RESULT_BAD_RCON_PASSWORD;
+            }
         }
-        if (port < 1 || port > 65535) {
-            return _strdup("error=Invalid port");
+        pending->callback(handle, status, output.c_str(), pending->userData);
+    }
+}
+
+// Processes game server command and returns response
+extern "C" const char* ProcessGameServerCommand(int protocolId, bool raw, const char* ipOrHostname, int port, const char* command, const char* rconPassword) {
+    std::string result = RunGameServerCommand(protocolId, raw, ipOrHostname, port, command, rconPassword);
+    const char* copy = responsePool.Copy(result);
+    KeepSpareString(std::move(result));
+    return copy;
+}
+
+// Processes game server command and writes the response into a caller-provided buffer
+extern "C" bool ProcessGameServerCommandInto(int protocolId, bool raw, const char* ipOrHostname, int port, const char* command, const char* rconPassword,
+    char* buf, size_t cap, size_t* needed) {
+    std::string result = RunGameServerCommand(protocolId, raw, ipOrHostname, port, command, rconPassword);
+    if (needed) {
+        *needed = result.size() + 1;
+    }
+    if (!buf || cap < result.size() + 1) {
+        if (buf && cap > 0) buf[0] = '\0';
+        return false;
+    }
+    memcpy(buf, result.c_str(), result.size() + 1);
+    KeepSpareString(std::move(result));
+    return true;
+}
+
+// Executes a command and writes only the requested settings and player fields
+extern "C" const char* ProcessGameServerCommandFields(int protocolId, const char* ipOrHostname, int port, const char* command, const char* rconPassword,
+    const char* fields) {
+    try {
+        ParseArena arena;   // Holds the projection for the whole call; parses nest inside it
+        Projection projection(ParseArena::Current());
+        if (!fields || !ParseProjection(fields, projection)) {
+            return responsePool.Copy("error=Invalid field list");
+        }
+        ProjectionScope scope(&projection);
+        std::string result = RunGameServerCommand(protocolId, false, ipOrHostname, port, command, rconPassword);
+        const char* copy = responsePool.Copy(result);
+        KeepSpareString(std::move(result));
+        return copy;
+    }
+    catch (...) {
+        return responsePool.Copy("error=Unexpected exception");
+    }
+}
+
+// Parses a captured server response the way ProcessGameServerCommandFields would, without network I/O
+extern "C" const char* ParseGameServerResponseFields(int protocolId, const char* command, const char* response, const char* fields) {
+    try {
+        ParseArena arena;   // Holds the projection for the whole call; parses nest inside it
+        Projection projection(ParseArena::Current());
+        if (!fields || !ParseProjection(fields, projection)) {
+            return responsePool.Copy("error=Invalid field list");
+        }
+        ProjectionScope scope(&projection);
+        std::string result = ParseCapturedResponse(protocolId, false, command, response);
+        const char* copy = responsePool.Copy(result);
+        KeepSpareString(std::move(result));
+        return copy;
+    }
+    catch (...) {
+        return responsePool.Copy("error=Unexpected exception");
+    }
+}
+
+// Parses a captured server response exactly as ProcessGameServerCommand would, without network I/O
+extern "C" const char* ParseGameServerResponse(int protocolId, bool raw, const char* command, const char* response) {
+    try {
+        std::string result = ParseCapturedResponse(protocolId, raw, command, response);
+        const char* copy = responsePool.Copy(result);
+        KeepSpareString(std::move(result));
+        return copy;
+    }
+    catch (...) {
+        return responsePool.Copy("error=Unexpected exception");
+    }
+}
+
+// Processes game server command and returns typed records
+extern "C" const GameServerResult* ProcessGameServerCommandTyped(int protocolId, const char* ipOrHostname, int port, const char* command, const char* rconPassword) {
+    try {
+        std::string raw = RunGameServerCommand(protocolId, true, ipOrHostname, port, command, rconPassword);
+        return TypedResult(protocolId, command ? SanitizeCommand(command) : std::string(), raw);
+    }
+    catch (...) {
+        return ErrorResult(GSQ_RESULT_INTERNAL_ERROR, "Unexpected exception");
+    }
+}
+
+// Parses a captured response into typed records
+extern "C" const GameServerResult* ParseGameServerResponseTyped(int protocolId, const char* command, const char* response) {
+    try {
+        std::string raw = ParseCapturedResponse(protocolId, true, command, response);
+        return TypedResult(protocolId, command ? SanitizeCommand(command) : std::string(), raw);
+    }
+    catch (...) {
+        return ErrorResult(GSQ_RESULT_INTERNAL_ERROR, "Unexpected exception");
+    }
+}
+
+// Frees a typed result; its arrays and strings share the same block
+extern "C" void FreeGameServerResult(const GameServerResult* result) {
+    free(const_cast<GameServerResult*>(result));
+}
+
+// Queries a server and returns only what changed since the previous delta query for it
+extern "C" const char* ProcessGameServerCommandDelta(int protocolId, const char* ipOrHostname, int port, const char* command, const char* rconPassword) {
+    return responsePool.Copy(RunGameServerDelta(protocolId, ipOrHostname, port, command, rconPassword));
+}
+
+// Forgets every stored delta snapshot
+extern "C" void ResetGameServerDeltaState() {
+    std::lock_guard<std::mutex> lock(deltaMutex);
+    deltaSnapshots.clear();
+}
+
+// Sends a batch of queries from one non-blocking socket and matches replies by source address
+extern "C" int ProcessGameServerCommandBatch(const GameServerQueryRequest* requests, int count, int timeoutMs, const char** results) {
+    if (!requests || !results || count < 0) {
+        return -1;
+    }
+    for (int i = 0; i < count; ++i) {
+        results[i] = nullptr;
+    }
+
+    int replies = 0;
+    try {
+        NetworkScope network;
+        QueryMultiplexer mux([&](uint64_t id, bool replied, const std::string& result) {
+            results[id] = responsePool.Copy(result);
+            if (replied) ++replies;
+        });
+        auto deadline = Clock::now() + std::chrono::milliseconds(timeoutMs > 0 ? timeoutMs : 0);
+        std::vector<std::pair<int, QueryMultiplexer::Query>> prepared;
+        for (int i = 0; i < count; ++i) {
+            const GameServerQueryRequest& req = requests[i];
+            QueryMultiplexer::Query query;
+            std::string error = PrepareQuery(req.protocolId, req.raw, req.ipOrHostname, req.port, req.command, req.rconPassword, query);
+            if (!error.empty()) {
+                results[i] = responsePool.Copy(error);
+                continue;
+            }
+            query.deadline = deadline;
+            prepared.emplace_back(i, std::move(query));
+        }
+
+        if (!prepared.empty()) {
+            const char* failure = !network.ok ? "error=Winsock initialization failed" : !mux.Open() ? "error=Socket creation failed" : nullptr;
+            if (failure) {
+                for (auto& entry : prepared) results[entry.first] = responsePool.Copy(failure);
+                return 0;
+            }
+            for (auto& entry : prepared) {
+                mux.Add(static_cast<uint64_t>(entry.first), std::move(entry.second));
+            }
+            while (mux.Pending() > 0) {
+                mux.Poll(deadline);
+            }
+        }
+    }
+    catch (...) {
+        for (int i = 0; i < count; ++i) {
+            if (!results[i]) results[i] = responsePool.Copy("error=Unexpected exception");
+        }
+    }
+    return replies;
+}
+
+// Queues a query on the background reactor and reports the result through the callback
+extern "C" GameServerQueryHandle ProcessGameServerCommandAsync(int protocolId, bool raw, const char* ipOrHostname, int port, const char* command, const char* rconPassword,
+    int timeoutMs, GameServerQueryCallback callback, void* userData) {
+    if (!callback) {
+        return 0;
+    }
+    try {
+        QueryMultiplexer::Query query;
+        std::string error = PrepareQueryPacket(protocolId, raw, ipOrHostname, port, command, rconPassword, query);
+        return asyncReactor.SubmitUnresolved(std::move(query), error, ipOrHostname ? ipOrHostname : "", (std::max)(timeoutMs, 0), 0, callback, userData);
+    }
+    catch (...) {
+        return 0;
+    }
+}
+
+// Queues an rcon command on the server's paced queue
+extern "C" GameServerQueryHandle QueueGameServerRcon(int protocolId, const char* ipOrHostname, int port, const char* command, const char* rconPassword,
+    int minIntervalMs, int timeoutMs, GameServerRconCallback callback, void* userData) {
+    if (!command || !callback || minIntervalMs < 0) {
+        return 0;
+    }
+    try {
+        return rconQueue.Submit(protocolId, ipOrHostname, port, command, rconPassword, minIntervalMs, timeoutMs, callback, userData);
+    }
+    catch (...) {
+        return 0;
+    }
+}
+
+// Sends an rcon command without waiting for its reply
+extern "C" int SendGameServerRcon(int protocolId, const char* ipOrHostname, int port, const char* command, const char* rconPassword) {
+    if (!command) {
+        return GSQ_RESULT_INVALID_ARGUMENT;
+    }
+    try {
+        return SendRconDatagram(protocolId, ipOrHostname, port, command, rconPassword);
+    }
+    catch (...) {
+        return GSQ_RESULT_INTERNAL_ERROR;
+    }
+}
+
+// Sends an rcon command without waiting for its reply, then confirms its effect through getstatus polls
+extern "C" int SendGameServerRconVerified(int protocolId, const char* ipOrHostname, int port, const char* command, const char* rconPassword,
+    const char* key, const char* expectedValue, int pollIntervalMs, int timeoutMs, GameServerVerifyCallback callback, void* userData) {
+    if (!command || !callback || (key == nullptr) != (expectedValue == nullptr) || pollIntervalMs < 100 || timeoutMs < pollIntervalMs) {
+        return GSQ_RESULT_INVALID_ARGUMENT;
+    }
+    try {
+        WriteVerifier::Verification verification = { key ? key : "", expectedValue ? expectedValue : "", {}, callback, userData, "" };
+        if (!key && !ImpliedSetting(SanitizeCommand(RconCommand(command)), verification.key, verification.expected)) {
+            return GSQ_RESULT_INVALID_ARGUMENT;
+        }
+        int status = SendRconDatagram(protocolId, ipOrHostname, port, command, rconPassword);
+        if (status != GSQ_RESULT_OK) {
+            return status;
+        }
+        verification.deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+        return writeVerifier.Add(protocolId, ipOrHostname, port, pollIntervalMs, std::move(verification)) ? GSQ_RESULT_OK : GSQ_RESULT_NETWORK_ERROR;
+    }
+    catch (...) {
+        return GSQ_RESULT_INTERNAL_ERROR;
+    }
+}
+
+// Cancels a pending asynchronous query
+extern "C" bool CancelGameServerCommand(GameServerQueryHandle handle) {
+    return asyncReactor.Cancel(handle);
+}
+
+// Streams a master server's list into a paced getinfo/getstatus sweep on one multiplexer
+extern "C" int ScanGameServers(int protocolId, bool raw, const char* masterHostname, int masterPort, int protocolVersion, const char* command,
+    int queriesPerSecond, int timeoutMs, GameServerScanCallback callback, void* userData) {
+    if (!masterHostname || !command || !callback || masterPort < 1 || masterPort > 65535 || queriesPerSecond < 0 || timeoutMs <= 0) {
+        return -1;
+    }
+    ProtocolHandler* handler = HandlerFor(protocolId);
+    std::string cmd = SanitizeCommand(command);
+    if (!handler || (cmd != "getinfo" && cmd != "getstatus")) {
+        return -1;
+    }
+
+    int replies = 0;
+    SOCKET masterSock = INVALID_SOCKET;
+    try {
+        QueryMultiplexer::Query prototype;
+        prototype.handler = handler;
+        prototype.raw = raw;
+        prototype.cmd = cmd;
+        if (!prototype.handler->BuildQuery(cmd, "", prototype.query).empty()) {
+            return -1;
+        }
+
+        NetworkScope network;
+        std::string masterIp = ResolveHostname(masterHostname);
+        sockaddr_in master = {};
+        master.sin_family = AF_INET;
+        master.sin_port = htons(static_cast<u_short>(masterPort));
+        if (!network.ok || masterIp.find("error=") == 0 || inet_pton(AF_INET, masterIp.c_str(), &master.sin_addr) <= 0) {
+            return -1;
+        }
+
+        std::vector<sockaddr_in> servers;   // Indexed by query id
+        QueryMultiplexer mux([&](uint64_t id, bool replied, const std::string& result) {
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &servers[id].sin_addr, ip, sizeof(ip));
+            if (replied) ++replies;
+            callback(ip, ntohs(servers[id].sin_port), result.c_str(), userData);
+        });
+        if (!mux.Open()) {
+            return -1;
+        }
+
+        // The master list arrives on its own socket so its packets never mix with server replies
+        masterSock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (masterSock == INVALID_SOCKET) {
+            return -1;
+        }
+        SetNonBlocking(masterSock);
+        std::string request = "\xFF\xFF\xFF\xFFgetservers " + std::to_string(protocolVersion) + " full empty";
+        if (sendto(masterSock, request.c_str(), static_cast<int>(request.size()), 0, (sockaddr*)&master, sizeof(master)) == SOCKET_ERROR) {
+            closesocket(masterSock);
+            return -1;
+        }
+
+        const auto timeout = std::chrono::milliseconds(timeoutMs);
+        const auto interval = queriesPerSecond > 0 ? std::chrono::microseconds(1000000 / queriesPerSecond) : std::chrono::microseconds(0);
+        std::unordered_set<uint64_t> seen;
+        size_t nextServer = 0;                              // First listed server not yet queried
+        bool masterDone = false;
+        bool masterReplied = false;
+        auto masterDeadline = Clock::now() + timeout;
+        auto nextSend = Clock::now();
+
+        for (;;) {
+            auto now = Clock::now();
+            // Send whatever the rate allows; a late wake-up may catch up by a few sends but never bursts further
+            while (nextServer < servers.size() && nextSend <= now) {
+                QueryMultiplexer::Query query = prototype;
+                query.server = servers[nextServer];
+                query.deadline = now + timeout;
+                mux.Add(nextServer++, std::move(query));
+                nextSend = (std::max)(nextSend, now - 10 * interval) + interval;
+            }
+            if (!masterDone && now >= masterDeadline) {
+                masterDone = true;
+            }
+            if (masterDone && nextServer == servers.size() && mux.Pending() == 0) {
+                break;
+            }
+
+            auto wakeBy = now + timeout;
+            if (nextServer < servers.size()) {
+                wakeBy = (std::min)(wakeBy, nextSend);
+            }
+            if (!masterDone) {
+                wakeBy = (std::min)(wakeBy, masterDeadline);
+            }
+            if (!mux.Poll(wakeBy, masterDone ? INVALID_SOCKET : masterSock)) {
+                continue;
+            }
+
+            char buffer[4096];
+            for (;;) {
+                sockaddr_in from;
+                socklen_t fromLen = sizeof(from);
+                int bytesReceived = recvfrom(masterSock, buffer, sizeof(buffer), 0, (sockaddr*)&from, &fromLen);
+                if (bytesReceived == SOCKET_ERROR) {
+                    if (WSAGetLastError() == WSAECONNRESET) {
+                        continue;
+                    }
+                    break;
+                }
+                if (from.sin_addr.s_addr != master.sin_addr.s_addr || from.sin_port != master.sin_port) {
+                    continue;
+                }
+                masterReplied = true;
+                masterDeadline = Clock::now() + timeout;
+                if (ParseGetServersResponse(std::string_view(buffer, bytesReceived), seen, servers)) {
+                    masterDone = true;
+                }
+            }
+        }
+        closesocket(masterSock);
+        if (!masterReplied) {
+            return -1;
+        }
+    }
+    catch (...) {
+        if (masterSock != INVALID_SOCKET) {
+            closesocket(masterSock);
+        }
+        return -1;
+    }
+    return replies;
+}
+
+// Queries a fixed target list from several worker threads, each with its own socket, and reports every target once
+extern "C" int ScanGameServerList(const GameServerQueryRequest* targets, int count, int threads, int timeoutMs,
+    GameServerListCallback callback, void* userData) {
+    if (!targets || count < 0 || threads < 0 || timeoutMs <= 0 || !callback) {
+        return -1;
+    }
+    try {
+        NetworkScope network;
+        if (!network.ok) {
+            for (int i = 0; i < count; ++i) callback(i, "error=Winsock initialization failed", userData);
+            return 0;
+        }
+        return ShardedScan(targets, count, threads, timeoutMs, callback, userData).Run();
+    }
+    catch (...) {
+        return -1;
+    }
+}
+
+// Starts polling a server on an interval
+extern "C" GameServerWatchHandle AddGameServerWatch(int protocolId, bool raw, const char* ipOrHostname, int port, const char* command, const char* rconPassword,
+    int intervalMs, GameServerWatchCallback callback, void* userData) {
+    if (!ipOrHostname || !command || !callback || intervalMs < 100) {
+        return 0;
+    }
+    try {
+        return watchScheduler.Add({ protocolId, raw, ipOrHostname, port, command, rconPassword ? rconPassword : "", intervalMs, callback, userData });
+    }
+    catch (...) {
+        return 0;
+    }
+}
+
+// Stops polling a server
+extern "C" bool RemoveGameServerWatch(GameServerWatchHandle handle) {
+    return watchScheduler.Remove(handle);
+}
+
+// Suspends or resumes polling a server
+extern "C" bool PauseGameServerWatch(GameServerWatchHandle handle, bool paused) {
+    return watchScheduler.Pause(handle, paused);
+}
+
+// Updates a tunable library setting
+extern "C" bool SetGameServerQueryOption(int option, int value) {
+    if (value < 0) {
+        return false;
+    }
+    switch (option) {
+    case GSQ_OPTION_QUIET_PERIOD_MS:
+        quietPeriodMs = value;
+        return true;
+    case GSQ_OPTION_DNS_NEGATIVE_TTL_MS:
+        dnsNegativeTtlMs = value;
+        return true;
+    case GSQ_OPTION_MAX_RETRANSMITS:
+        maxRetransmits = value;
+        return true;
+    case GSQ_OPTION_CLEAN_NAMES:
+        if (value > 1) {
+            return false;
+        }
+        cleanNames = value == 1;
+        responseCache.Clear();  // Cached results were built with the previous setting
+        return true;
+    case GSQ_OPTION_SIMD_LEVEL:
+        if (value > SIMD_AVX2) {
+            return false;
+        }
+        classifyBlock = ClassifierFor(value);
+        return true;
+    case GSQ_OPTION_BATCHED_IO:
+        if (value > 1) {
+            return false;
+        }
+        batchedIo = value == 1;
+        return true;
+    case GSQ_OPTION_PLAYER_INDEX:
+        if (value > 1) {
+            return false;
+        }
+        playerIndexEnabled = value == 1;
+        if (value == 0) {
+            playerIndex.Clear();
+        }
+        return true;
+    case GSQ_OPTION_CACHE_TTL_MS:
+        cacheTtlMs = value;
+        if (value == 0) {
+            responseCache.Clear();
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+namespace {
+    // Counters reported by GetGameServerQueryStats, in output order
+    std::vector<std::pair<const char*, uint64_t>> MetricCounterValues() {
+        return {
+            { "queries", metrics.queries }, { "retransmits", metrics.retransmits }, { "timeouts", metrics.timeouts },
+            { "send_errors", metrics.sendErrors }, { "receive_errors", metrics.receiveErrors },
+            { "send_calls", metrics.sendCalls }, { "receive_calls", metrics.receiveCalls },
+            { "scan_steals", metrics.scanSteals },
+            { "pool_reused", metrics.poolReused }, { "pool_allocated", metrics.poolAllocated }, { "arena_spills", metrics.arenaSpills },
+            { "bytes_out", metrics.bytesOut }, { "bytes_in", metrics.bytesIn },
+            { "dns_hits", metrics.dnsHits }, { "dns_misses", metrics.dnsMisses },
+            { "cache_hits", responseCache.hits }, { "cache_misses", responseCache.misses },
+            { "cache_coalesced", responseCache.coalesced },
+        };
+    }
+
+    // Snapshot as {"counters":{...},"latency":[{"phase","protocol","count","sum_ns","buckets":{"<le us>":n,...,"+Inf":n}}]};
+    // only histograms with samples are listed, and bucket counts are per bucket, not cumulative
+    std::string MetricsToJson() {
+        std::string result;
+        JsonWriter json(result);
+        json.BeginObject().Key("counters").BeginObject();
+        for (const auto& counter : MetricCounterValues()) {
+            json.Key(counter.first).Number(counter.second);
+        }
+        json.EndObject().Key("latency").BeginArray();
+        for (int protocolId = 0; protocolId < QueryMetrics::kProtocolSlots; ++protocolId) {
+            for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+                const LatencyHistogram& histogram = metrics.Histogram(protocolId, static_cast<MetricPhase>(phase));
+                if (histogram.count == 0) {
+                    continue;
+                }
+                json.BeginObject().Member("phase", kPhaseNames[phase]).Key("protocol").Number(protocolId)
+                    .Key("count").Number(histogram.count).Key("sum_ns").Number(histogram.sumNanos).Key("buckets").BeginObject();
+                for (int bucket = 0; bucket < LatencyHistogram::kBuckets; ++bucket) {
+                    uint64_t count = histogram.buckets[bucket];
+                    if (count > 0) {
+                        json.Key(bucket == LatencyHistogram::kBuckets - 1 ? "+Inf" : std::to_string(uint64_t(1) << bucket)).Number(count);
+                    }
+                }
+                json.EndObject().EndObject();
+            }
+        }
+        json.EndArray().EndObject();
+        return result;
+    }
+
+    // Snapshot in the Prometheus text exposition format
+    std::string MetricsToPrometheus() {
+        std::string result;
+        for (const auto& counter : MetricCounterValues()) {
+            result += std::string("# TYPE gsq_") + counter.first + "_total counter\ngsq_" + counter.first + "_total " + std::to_string(counter.second) + "\n";
+        }
+        result += "# TYPE gsq_phase_duration_seconds histogram\n";
+        char line[160];
+        for (int protocolId = 0; protocolId < QueryMetrics::kProtocolSlots; ++protocolId) {
+            for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+                const LatencyHistogram& histogram = metrics.Histogram(protocolId, static_cast<MetricPhase>(phase));
+                if (histogram.count == 0) {
+                    continue;
+                }
+                uint64_t cumulative = 0;
+                for (int bucket = 0; bucket < LatencyHistogram::kBuckets; ++bucket) {
+                    cumulative += histogram.buckets[bucket];
+                    if (bucket == LatencyHistogram::kBuckets - 1) {
+                        snprintf(line, sizeof(line), "gsq_phase_duration_seconds_bucket{phase=\"%s\",protocol=\"%d\",le=\"+Inf\"} %llu\n",
+                            kPhaseNames[phase], protocolId, static_cast<unsigned long long>(cumulative));
+                    }
+                    else {
+                        snprintf(line, sizeof(line), "gsq_phase_duration_seconds_bucket{phase=\"%s\",protocol=\"%d\",le=\"%g\"} %llu\n",
+                            kPhaseNames[phase], protocolId, static_cast<double>(uint64_t(1) << bucket) / 1e6, static_cast<unsigned long long>(cumulative));
+                    }
+                    result += line;
+                }
+                snprintf(line, sizeof(line), "gsq_phase_duration_seconds_sum{phase=\"%s\",protocol=\"%d\"} %.9f\n",
+                    kPhaseNames[phase], protocolId, static_cast<double>(histogram.sumNanos) / 1e9);
+                result += line;
+                snprintf(line, sizeof(line), "gsq_phase_duration_seconds_count{phase=\"%s\",protocol=\"%d\"} %llu\n",
+                    kPhaseNames[phase], protocolId, static_cast<unsigned long long>(histogram.count.load()));
+                result += line;
+            }
         }
-        auto it = protocolRegistry.find(protocolId);
-        if (it == protocolRegistry.end()) {
-            return _strdup("error=Invalid protocol ID");
+        return result;
+    }
+}
+
+// Writes a metrics snapshot into a caller-provided buffer
+extern "C" bool GetGameServerQueryStats(int format, char* buf, size_t cap, size_t* needed) {
+    std::string snapshot;
+    try {
+        if (format == GSQ_STATS_JSON) {
+            snapshot = MetricsToJson();
+        }
+        else if (format == GSQ_STATS_PROMETHEUS) {
+            snapshot = MetricsToPrometheus();
+        }
+        else {
+            snapshot = "error=Invalid stats format";
+        }
+    }
+    catch (...) {
+        snapshot = "error=Unexpected exception";
+    }
+    if (needed) {
+        *needed = snapshot.size() + 1;
+    }
+    if (!buf || cap < snapshot.size() + 1) {
+        return false;
+    }
+    memcpy(buf, snapshot.c_str(), snapshot.size() + 1);
+    return snapshot.find("error=") != 0;
+}
+
+// Clears every metrics counter and histogram, including the response cache counters
+extern "C" void ResetGameServerQueryStats() {
+    metrics.Reset();
+    responseCache.hits = 0;
+    responseCache.misses = 0;
+    responseCache.coalesced = 0;
+}
+
+// Reports response cache counters
+extern "C" void GetGameServerQueryCacheStats(unsigned long long* hits, unsigned long long* misses, unsigned long long* coalesced) {
+    if (hits) *hits = responseCache.hits;
+    if (misses) *misses = responseCache.misses;
+    if (coalesced) *coalesced = responseCache.coalesced;
+}
+
+// Initializes networking once and pre-opens the shared socket pool
+extern "C" bool GameServerQueryInit(int socketPoolSize) {
+    std::lock_guard<std::mutex> lock(lifecycleMutex);
+    if (networkInitialized) {
+        return true;
+    }
+    if (!StartNetwork()) {
+        return false;
+    }
+    if (!socketPool.Start(socketPoolSize)) {
+        socketPool.Stop();
+        StopNetwork();
+        return false;
+    }
+    networkInitialized = true;
+    return true;
+}
+
+// Stops the background threads, then closes pooled sockets and releases the Winsock reference taken by
+// GameServerQueryInit. The threads start on first use, so they are stopped even if Init was never called.
+extern "C" void GameServerQueryShutdown() {
+    std::lock_guard<std::mutex> lock(lifecycleMutex);
+    writeVerifier.DropAll();
+    watchScheduler.Stop();
+    asyncReactor.Stop();
+    dnsCache.Stop();
+    if (!networkInitialized) {
+        return;
+    }
+    networkInitialized = false;
+    socketPool.Stop();
+    StopNetwork();
+}
+
+// Looks up players recorded in the player index
+extern "C" const char* FindGameServerPlayer(const char* query, int match, int maxResults) {
+    try {
+        if (!query) {
+            return responsePool.Copy("error=Null input parameters");
+        }
+        if (match < GSQ_PLAYER_MATCH_EXACT || match > GSQ_PLAYER_MATCH_SUBSTRING || maxResults < 1) {
+            return responsePool.Copy("error=Invalid player lookup");
+        }
+        return responsePool.Copy(playerIndex.Find(query, match, static_cast<size_t>(maxResults)));
+    }
+    catch (...) {
+        return responsePool.Copy("error=Unexpected exception");
+    }
+}
+
+// Empties the player index
+extern "C" void ClearGameServerPlayerIndex() {
+    playerIndex.Clear();
+}
+
+// Starts or stops recording getstatus samples to per-server ring files
+extern "C" bool OpenGameServerHistory(const char* directory, int samplesPerServer) {
+    try {
+        if (!directory) {
+            historyStore.Close();
+            return true;
         }
+        if (!*directory || samplesPerServer < 1) {
+            return false;
+        }
+        return historyStore.Open(directory, static_cast<uint32_t>(samplesPerServer));
+    }
+    catch (...) {
+        return false;
+    }
+}
 
+namespace {
+    // Endpoint key of a server named by the caller, or 0 if it cannot be resolved
+    uint64_t HistoryServer(const char* ipOrHostname, int port) {
+        if (!ipOrHostname || port < 1 || port > 65535) {
+            return 0;
+        }
         std::string ip = ResolveHostname(ipOrHostname);
-        if (ip.find("error=") == 0) {
-            return _strdup(ip.c_str());
+        return ip.find("error=") == 0 ? 0 : EndpointKey(ip, port);
+    }
+}
+
+// Points spans at a server's recorded samples in a time range
+extern "C" int ReadGameServerHistory(const char* ipOrHostname, int port, long long fromMs, long long toMs, GameServerHistorySpan* spans) {
+    try {
+        uint64_t server = HistoryServer(ipOrHostname, port);
+        if (!spans || server == 0) {
+            return -1;
         }
+        int used = historyStore.Read(server, fromMs, toMs, spans);
+        for (int i = (std::max)(used, 0); i < 2; ++i) {
+            spans[i] = GameServerHistorySpan();
+        }
+        return used < 0 ? -1 : spans[0].count + spans[1].count;
+    }
+    catch (...) {
+        return -1;
+    }
+}
 
-        std::string cmd = SanitizeCommand(command);
-        if (cmd.empty()) {
-            return _strdup("error=Empty command");
+// Averages a server's recorded samples into fixed-width time buckets
+extern "C" int DownsampleGameServerHistory(const char* ipOrHostname, int port, long long fromMs, long long toMs, long long bucketMs,
+    GameServerHistoryBucket* buckets, int maxBuckets) {
+    try {
+        uint64_t server = HistoryServer(ipOrHostname, port);
+        if (!buckets || server == 0 || bucketMs < 1 || maxBuckets < 1) {
+            return -1;
         }
+        return DownsampleHistory(server, fromMs, toMs, bucketMs, buckets, maxBuckets);
+    }
+    catch (...) {
+        return -1;
+    }
+}
 
-        std::string rcon = rconPassword ? rconPassword : "";
-        std::string result = it->second->ProcessCommand(raw, ip, port, cmd, rcon);
-        return _strdup(result.c_str());
+// Returns the map name behind a history map ID
+extern "C" const char* GetGameServerHistoryMapName(int mapId) {
+    try {
+        std::string name;
+        if (mapId < 0 || !historyStore.MapName(static_cast<uint32_t>(mapId), name)) {
+            return nullptr;
+        }
+        return responsePool.Copy(name);
     }
     catch (...) {
-        return _strdup("error=Unexpected exception");
+        return nullptr;
     }
 }
 
 // Frees memory allocated for game server response
 extern "C" void FreeGameServerResponse(const char* response) {
     if (response) {
-        free((void*)response);
+        responsePool.Release(response);
     }
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <string>
 #include <memory>
 #include <map>
+#include <cstddef>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -10,8 +11,10 @@
 #include <ws2tcpip.h>
 #endif
 
-// Defines export/import macro for DLL linkage on Windows
-#ifdef GAMESERVERQUERY_EXPORTS
+// Defines export/import macro for DLL linkage on Windows; elsewhere the API is the shared library's visible symbols
+#if !defined(_WIN32)
+#define GAMESERVERQUERY_API __attribute__((visibility("default")))
+#elif defined(GAMESERVERQUERY_EXPORTS)
 #define GAMESERVERQUERY_API __declspec(dllexport)
 #else
 #define GAMESERVERQUERY_API __declspec(dllimport)
@@ -21,17 +24,29 @@
 class ProtocolHandler {
 public:
     virtual ~ProtocolHandler() = default; // Virtual destructor for proper cleanup
-    // Processes a command for a specific game server protocol
+    // Processes a command for a specific game server protocol (builds, sends and parses the query)
     virtual std::string ProcessCommand(
         bool raw,                           // If true, returns raw response
         const std::string& ip,              // Server IP address
         int port,                           // Server port
         const std::string& command,         // Command to execute
         const std::string& rconPassword     // RCON password for authentication
+    );
+    // Builds the UDP packet for a command; returns an error string, or empty on success
+    virtual std::string BuildQuery(
+        const std::string& command,         // Sanitized command to execute
+        const std::string& rconPassword,    // RCON password for authentication
+        std::string& query                  // Receives the packet to send
+    ) = 0;
+    // Converts a server response (or an "error=" string from the transport) into the final result
+    virtual std::string ParseResponse(
+        bool raw,                           // If true, returns raw response
+        const std::string& command,         // Sanitized command that was sent
+        std::string response                // Response received from the server
     ) = 0;
 };
 
-// Resolves a hostname to an IP address with DNS caching
+// Resolves a hostname to an IP address with DNS caching (5-minute TTL, background refresh, negative caching)
 std::string ResolveHostname(const std::string& hostname);
 
 // Sends a UDP query to a game server and returns the response
@@ -42,6 +57,88 @@ std::string SendUDPQuery(
     int timeoutMs = 5000        // Timeout in milliseconds (default: 5000)
 );
 
+// Initializes networking once and pre-opens a pool of UDP sockets that all queries borrow and return.
+// Optional: without it every call starts and stops Winsock and opens its own socket. Returns false on failure.
+extern "C" GAMESERVERQUERY_API bool GameServerQueryInit(
+    int socketPoolSize          // Number of sockets to keep open (e.g., the number of querying threads)
+);
+
+// Stops the background threads of asynchronous queries, watches, rcon queues and the DNS cache, then closes
+// pooled sockets and releases the resources acquired by GameServerQueryInit. Call it before unloading the library
+// (FreeLibrary, dlclose), even if GameServerQueryInit was never called: threads still running at unload would
+// otherwise be joined from static destructors, which deadlocks under the Windows loader lock.
+extern "C" GAMESERVERQUERY_API void GameServerQueryShutdown();
+
+// Sends a UDP query and joins every reply packet (stripping repeated "print" headers)
+// until no new packet arrives for quietMs or the timeout expires
+std::string SendUDPQueryMultiPacket(
+    const std::string& ip,      // Server IP address
+    int port,                   // Server port
+    const std::string& query,   // Query to send
+    int timeoutMs = 5000,       // Maximum time to wait in milliseconds (default: 5000)
+    int quietMs = 100           // Gap with no new packet that completes the response (default: 100)
+);
+
+// Reports response cache counters since the library was loaded (any pointer may be null)
+extern "C" GAMESERVERQUERY_API void GetGameServerQueryCacheStats(
+    unsigned long long* hits,       // Results served from the cache
+    unsigned long long* misses,     // Queries sent to a server
+    unsigned long long* coalesced   // Callers that waited for an identical in-flight query
+);
+
+// Output formats for GetGameServerQueryStats
+enum GameServerQueryStatsFormat {
+    GSQ_STATS_JSON = 0,         // {"counters":{...},"latency":[...]}
+    GSQ_STATS_PROMETHEUS = 1    // Prometheus text exposition format
+};
+
+// Writes a NUL-terminated snapshot of the built-in metrics: counters for queries, timeouts, send/receive
+// errors and system calls, list-scan steals, response pool reuse, parse arena spills, bytes in/out, DNS and
+// response cache hits, and latency histograms per phase (resolve, network, parse, json, total) and protocol
+// ID. Returns false if the buffer is too small or the format is unknown; *needed always receives the
+// required size including the NUL.
+extern "C" GAMESERVERQUERY_API bool GetGameServerQueryStats(
+    int format,                 // GameServerQueryStatsFormat value
+    char* buf,                  // Output buffer (may be null to only query the size)
+    size_t cap,                 // Size of buf in bytes
+    size_t* needed              // Receives the required buffer size (may be null)
+);
+
+// Resets every metrics counter and histogram, including the response cache counters
+extern "C" GAMESERVERQUERY_API void ResetGameServerQueryStats();
+
+// Identifies an asynchronous query (0 means the query could not be queued)
+typedef unsigned long long GameServerQueryHandle;
+
+// Receives the result of an asynchronous query on the library's I/O thread.
+// response uses the same format as ProcessGameServerCommand and is only valid during the call.
+typedef void (*GameServerQueryCallback)(
+    GameServerQueryHandle handle,   // Handle returned by ProcessGameServerCommandAsync
+    const char* response,           // JSON, raw or "error=" response
+    void* userData                  // Pointer passed to ProcessGameServerCommandAsync
+);
+
+// Tunable library settings for SetGameServerQueryOption
+enum GameServerQueryOption {
+    GSQ_OPTION_QUIET_PERIOD_MS = 1,     // Quiet gap that completes a multi-packet rcon reply (default: 100)
+    GSQ_OPTION_CACHE_TTL_MS = 2,        // Lifetime of cached getstatus/getinfo results; 0 disables the cache (default: 0)
+    GSQ_OPTION_DNS_NEGATIVE_TTL_MS = 3, // How long a failed hostname lookup is remembered (default: 30000)
+    GSQ_OPTION_MAX_RETRANSMITS = 4,     // Resends of an unanswered getinfo/getstatus query; 0 disables (default: 2)
+    GSQ_OPTION_CLEAN_NAMES = 5,         // 1 adds "clean_name" (color codes removed) next to each player "name" (default: 0)
+    GSQ_OPTION_SIMD_LEVEL = 6,          // Highest instruction set for the response tokenizer: 0 scalar, 1 SSE2, 2 AVX2 (default: 2,
+                                        // limited to what the CPU supports)
+    GSQ_OPTION_BATCHED_IO = 7,          // 1 moves batch, async, scan and watch traffic with sendmmsg/recvmmsg on Linux, 0 uses one
+                                        // system call per datagram (default: 1; other platforms always use one per datagram)
+    GSQ_OPTION_PLAYER_INDEX = 8         // 1 records the players of every getstatus and rcon status reply for FindGameServerPlayer,
+                                        // 0 stops recording and clears the index (default: 0)
+};
+
+// Updates a tunable library setting; returns false for unknown options or invalid values
+extern "C" GAMESERVERQUERY_API bool SetGameServerQueryOption(
+    int option,                 // GameServerQueryOption value
+    int value                   // New value for the option
+);
+
 // Processes a game server command and returns the response as a C-string
 extern "C" GAMESERVERQUERY_API const char* ProcessGameServerCommand(
     int protocolId,             // Protocol ID (e.g., 1 for Medal of Honor, 2 for Call of Duty)
@@ -52,5 +149,414 @@ extern "C" GAMESERVERQUERY_API const char* ProcessGameServerCommand(
     const char* rconPassword    // RCON password for authentication
 );
 
-// Frees memory allocated for the game server response
+// Processes a game server command and writes the NUL-terminated response (same format as
+// ProcessGameServerCommand) into a caller-provided buffer, so hot callers can reuse one buffer.
+// Returns false if the buffer is too small; *needed always receives the required size including the NUL.
+extern "C" GAMESERVERQUERY_API bool ProcessGameServerCommandInto(
+    int protocolId,             // Protocol ID (e.g., 1 for Medal of Honor, 2 for Call of Duty)
+    bool raw,                   // If true, returns raw response
+    const char* ipOrHostname,   // Server IP or hostname
+    int port,                   // Server port
+    const char* command,        // Command to execute
+    const char* rconPassword,   // RCON password for authentication
+    char* buf,                  // Output buffer (may be null to only query the size)
+    size_t cap,                 // Size of buf in bytes
+    size_t* needed              // Receives the required buffer size (may be null)
+);
+
+// Executes a command like ProcessGameServerCommand, but writes only the fields listed in 'fields': server
+// settings by name, "players.<column>" for player columns (slot, score, ping, name, clean_name and the rcon
+// status columns) and "players.count" for the player count, e.g. "sv_hostname,mapname,players.count".
+// Applies to getstatus, getinfo and rcon status; other commands return their usual output. Settings the
+// server does not report are left out. Returns "error=Invalid field list" if 'fields' is empty or names an
+// unknown player column. Free the result with FreeGameServerResponse.
+extern "C" GAMESERVERQUERY_API const char* ProcessGameServerCommandFields(
+    int protocolId,             // Protocol ID (e.g., 1 for Medal of Honor, 2 for Call of Duty)
+    const char* ipOrHostname,   // Server IP or hostname
+    int port,                   // Server port
+    const char* command,        // Command to execute
+    const char* rconPassword,   // RCON password for authentication
+    const char* fields          // Comma-separated fields to return
+);
+
+// Parses a captured response the way ProcessGameServerCommandFields would, without any network I/O.
+// Free the result with FreeGameServerResponse.
+extern "C" GAMESERVERQUERY_API const char* ParseGameServerResponseFields(
+    int protocolId,             // Protocol ID (e.g., 1 for Medal of Honor, 2 for Call of Duty)
+    const char* command,        // Command that produced the response
+    const char* response,       // Response packet as received from the server
+    const char* fields          // Comma-separated fields to return
+);
+
+// Parses a response captured from a server (including its \xFF\xFF\xFF\xFF header) exactly as
+// ProcessGameServerCommand would, without any network I/O. Free the result with FreeGameServerResponse.
+extern "C" GAMESERVERQUERY_API const char* ParseGameServerResponse(
+    int protocolId,             // Protocol ID (e.g., 1 for Medal of Honor, 2 for Call of Duty)
+    bool raw,                   // If true, returns raw response
+    const char* command,        // Command that produced the response
+    const char* response        // Response packet as received from the server
+);
+
+// Queries a server like ProcessGameServerCommand, but returns only what changed since the previous delta
+// query for the same protocol, server and command (getstatus, getinfo or rcon status). The first call
+// returns everything with "full":true. Later calls return "{}" when nothing changed, or any of:
+// "server" (changed or added cvars), "removed" (cvar names), "joined" and "left" (player objects), and
+// "updated" (current player objects with a "changed" list of field names). Free the result with FreeGameServerResponse.
+extern "C" GAMESERVERQUERY_API const char* ProcessGameServerCommandDelta(
+    int protocolId,             // Protocol ID (e.g., 1 for Medal of Honor, 2 for Call of Duty)
+    const char* ipOrHostname,   // Server IP or hostname
+    int port,                   // Server port
+    const char* command,        // "getstatus", "getinfo" or "rcon status"
+    const char* rconPassword    // RCON password for rcon status (may be null otherwise)
+);
+
+// Forgets every snapshot kept by ProcessGameServerCommandDelta, so the next call for each server is a full one
+extern "C" GAMESERVERQUERY_API void ResetGameServerDeltaState();
+
+// Outcome of a typed query (GameServerResult::status)
+enum GameServerResultCode {
+    GSQ_RESULT_OK = 0,
+    GSQ_RESULT_INVALID_ARGUMENT = 1,    // Null input, invalid protocol ID, port or IP address, or empty command
+    GSQ_RESULT_UNSUPPORTED_COMMAND = 2, // The protocol does not support the command
+    GSQ_RESULT_RESOLVE_FAILED = 3,      // The hostname could not be resolved
+    GSQ_RESULT_NETWORK_ERROR = 4,       // Winsock, socket or send failure
+    GSQ_RESULT_TIMEOUT = 5,             // The server did not answer in time
+    GSQ_RESULT_INVALID_RESPONSE = 6,    // The reply was empty or had an unexpected header
+    GSQ_RESULT_BAD_RCON_PASSWORD = 7,   // The server rejected the rcon password
+    GSQ_RESULT_INTERNAL_ERROR = 8,      // Unexpected failure inside the library
+    GSQ_RESULT_DROPPED = 9              // A queued command was cancelled, or the library shut down, before its reply arrived
+};
+
+// Server setting from a getstatus/getinfo reply
+struct GameServerKeyValue {
+    const char* key;
+    const char* value;
+};
+
+// Player from a getstatus or rcon status reply. Numbers a reply does not carry are 0 (getstatus has no
+// lastmsg, qport or rate; Call of Duty getstatus has no slot; Medal of Honor getstatus has no score or ping)
+// and strings it does not carry are empty, never null.
+struct GameServerPlayer {
+    int slot;
+    int score;
+    int ping;
+    int lastmsg;
+    int qport;
+    int rate;
+    const char* name;           // Name as reported, with color codes
+    const char* cleanName;      // Name with Quake color codes removed
+    const char* address;        // rcon status only
+    const char* guid;           // Non-Steam rcon status only
+    const char* playerid;       // Steam rcon status only
+    const char* steamid;        // Steam rcon status only
+};
+
+// Typed query result. The structure, its arrays and all strings live in a single allocation that is
+// released with FreeGameServerResult; every pointer stays valid until then.
+struct GameServerResult {
+    int status;                             // GameServerResultCode
+    const char* error;                      // Error message without the "error=" prefix; empty on success
+    const char* text;                       // Reply of rcon commands other than status (or the map change message); empty otherwise
+    int serverInfoCount;
+    const GameServerKeyValue* serverInfo;   // getstatus/getinfo settings, sorted by key
+    int playerCount;
+    const GameServerPlayer* players;        // getstatus/rcon status players in reply order
+};
+
+// Queries a server like ProcessGameServerCommand, but returns typed records instead of JSON text.
+// Returns null only if the result could not be allocated.
+extern "C" GAMESERVERQUERY_API const GameServerResult* ProcessGameServerCommandTyped(
+    int protocolId,             // Protocol ID (e.g., 1 for Medal of Honor, 2 for Call of Duty)
+    const char* ipOrHostname,   // Server IP or hostname
+    int port,                   // Server port
+    const char* command,        // Command to execute (e.g., "getstatus", "rcon status")
+    const char* rconPassword    // RCON password for authentication (may be null)
+);
+
+// Parses a captured response (including its \xFF\xFF\xFF\xFF header) into typed records without any network I/O
+extern "C" GAMESERVERQUERY_API const GameServerResult* ParseGameServerResponseTyped(
+    int protocolId,             // Protocol ID the response came from
+    const char* command,        // Command that produced the response
+    const char* response        // Captured response packet
+);
+
+// Frees a result returned by ProcessGameServerCommandTyped or ParseGameServerResponseTyped (null is ignored)
+extern "C" GAMESERVERQUERY_API void FreeGameServerResult(const GameServerResult* result);
+
+// Describes a single query within a batch request
+struct GameServerQueryRequest {
+    int protocolId;             // Protocol ID (e.g., 1 for Medal of Honor, 2 for Call of Duty)
+    bool raw;                   // If true, returns raw response
+    const char* ipOrHostname;   // Server IP or hostname
+    int port;                   // Server port
+    const char* command;        // Command to execute
+    const char* rconPassword;   // RCON password for authentication (may be null)
+};
+
+// Sends every query in the batch from a single socket and waits for all replies or the deadline.
+// results[i] receives the response for requests[i] and must be freed with FreeGameServerResponse.
+// Returns the number of requests that received a reply, or -1 on invalid arguments.
+extern "C" GAMESERVERQUERY_API int ProcessGameServerCommandBatch(
+    const GameServerQueryRequest* requests, // Queries to send
+    int count,                              // Number of queries
+    int timeoutMs,                          // Overall deadline for the whole batch in milliseconds
+    const char** results                    // Receives one response per query
+);
+
+// Queues a command on the background I/O thread and returns immediately; a hostname missing from the DNS cache is
+// resolved in the background first. The callback runs exactly once, on the I/O thread, with the result, a timeout
+// error, or "error=Cancelled" (on the thread calling GameServerQueryShutdown if the hostname was still being
+// resolved). Returns 0 if it could not be queued.
+extern "C" GAMESERVERQUERY_API GameServerQueryHandle ProcessGameServerCommandAsync(
+    int protocolId,                     // Protocol ID (e.g., 1 for Medal of Honor, 2 for Call of Duty)
+    bool raw,                           // If true, returns raw response
+    const char* ipOrHostname,           // Server IP or hostname
+    int port,                           // Server port
+    const char* command,                // Command to execute
+    const char* rconPassword,           // RCON password for authentication (may be null)
+    int timeoutMs,                      // Deadline for this request in milliseconds (0 for the command default)
+    GameServerQueryCallback callback,   // Receives the result
+    void* userData                      // Passed through to the callback
+);
+
+// Cancels a pending asynchronous query; its callback receives "error=Cancelled" unless the result was
+// already being delivered. Returns false if the handle is unknown or has already completed.
+extern "C" GAMESERVERQUERY_API bool CancelGameServerCommand(GameServerQueryHandle handle);
+
+// Receives one server found by ScanGameServers, on the calling thread, as soon as its query finishes.
+// response uses the same format as ProcessGameServerCommand and is only valid during the call.
+typedef void (*GameServerScanCallback)(
+    const char* ip,             // Server address reported by the master server
+    int port,                   // Server port reported by the master server
+    const char* response,       // JSON, raw or "error=" response
+    void* userData              // Pointer passed to ScanGameServers
+);
+
+// Asks a Quake3-style master server for its server list ("getservers <protocolVersion> full empty") and
+// queries every listed server with getinfo or getstatus while the list is still arriving. Queries are
+// paced to queriesPerSecond and each server is reported once through the callback.
+// Returns the number of servers that replied, or -1 on invalid arguments or if the master could not be reached.
+extern "C" GAMESERVERQUERY_API int ScanGameServers(
+    int protocolId,                     // Protocol ID used to query the listed servers (e.g., 2 for Call of Duty)
+    bool raw,                           // If true, reports raw responses
+    const char* masterHostname,         // Master server IP or hostname
+    int masterPort,                     // Master server port
+    int protocolVersion,                // Game protocol version sent in getservers (e.g., 6 for Call of Duty 1.5)
+    const char* command,                // "getinfo" or "getstatus"
+    int queriesPerSecond,               // Send rate for server queries (0 for unpaced)
+    int timeoutMs,                      // Per-server reply deadline, and the longest gap allowed between master packets
+    GameServerScanCallback callback,    // Receives each server's result
+    void* userData                      // Passed through to the callback
+);
+
+// Receives the result for targets[index] of ScanGameServerList. Calls come from the worker threads, several at
+// a time, so the callback must be thread-safe; response is only valid during the call.
+typedef void (*GameServerListCallback)(
+    int index,                  // Position of the target in the list
+    const char* response,       // JSON, raw or "error=" response
+    void* userData              // Pointer passed to ScanGameServerList
+);
+
+// Queries a known list of servers (a census) on several worker threads. The list is split into one shard per
+// thread; each worker sends from its own socket, parses its own replies, and steals half of the largest remaining
+// shard when its own runs out. Each worker keeps up to 256 queries outstanding. Returns once every target has been
+// reported, with the number that replied, or -1 on invalid arguments.
+extern "C" GAMESERVERQUERY_API int ScanGameServerList(
+    const GameServerQueryRequest* targets,  // Servers and commands to query
+    int count,                              // Number of targets
+    int threads,                            // Worker threads (0 for one per hardware thread, at most 64)
+    int timeoutMs,                          // Per-target reply deadline in milliseconds
+    GameServerListCallback callback,        // Receives each target's result
+    void* userData                          // Passed through to the callback
+);
+
+// Identifies a watched server (0 means the watch could not be added)
+typedef unsigned long long GameServerWatchHandle;
+
+// Receives every poll result of a watched server on the library's I/O thread.
+// response uses the same format as ProcessGameServerCommand and is only valid during the call.
+typedef void (*GameServerWatchCallback)(
+    GameServerWatchHandle handle,   // Handle returned by AddGameServerWatch
+    const char* response,           // JSON, raw or "error=" response
+    void* userData                  // Pointer passed to AddGameServerWatch
+);
+
+// Polls a server with the given command every intervalMs (at least 100). The library spreads the polls
+// of all watches evenly with jitter, runs them on the background I/O thread, and skips a poll while the
+// previous one is still running. Returns 0 on invalid arguments.
+extern "C" GAMESERVERQUERY_API GameServerWatchHandle AddGameServerWatch(
+    int protocolId,                     // Protocol ID (e.g., 1 for Medal of Honor, 2 for Call of Duty)
+    bool raw,                           // If true, reports raw responses
+    const char* ipOrHostname,           // Server IP or hostname (resolved through the DNS cache on every poll)
+    int port,                           // Server port
+    const char* command,                // Command to send on every poll
+    const char* rconPassword,           // RCON password for authentication (may be null)
+    int intervalMs,                     // Time between polls in milliseconds
+    GameServerWatchCallback callback,   // Receives each poll result
+    void* userData                      // Passed through to the callback
+);
+
+// Stops polling a server. Unless called from the watch's own callback, a callback already running for it
+// finishes before this returns, so userData may be released afterwards. Returns false if the handle is unknown.
+extern "C" GAMESERVERQUERY_API bool RemoveGameServerWatch(GameServerWatchHandle handle);
+
+// Suspends (paused = true) or resumes polling a server. Returns false if the handle is unknown.
+extern "C" GAMESERVERQUERY_API bool PauseGameServerWatch(GameServerWatchHandle handle, bool paused);
+
+// Receives the outcome of a queued rcon command on the library's I/O thread; output is only valid during the call
+typedef void (*GameServerRconCallback)(
+    GameServerQueryHandle handle,   // Handle returned by QueueGameServerRcon
+    int status,                     // GameServerResultCode: OK, BAD_RCON_PASSWORD, TIMEOUT, DROPPED or a validation error
+    const char* output,             // Console output printed by the server, or the error message
+    void* userData                  // Pointer passed to QueueGameServerRcon
+);
+
+// Appends an rcon command to the server's queue and returns immediately. Each server has its own queue:
+// commands are sent one at a time in submission order, never closer together than minIntervalMs, and the
+// server's "print" reply is matched to the command in flight. Queues of different servers run in parallel.
+// The callback runs exactly once per command; CancelGameServerCommand drops a command that has not completed.
+// Returns 0 on invalid arguments or if the server already has
+// 256 commands waiting.
+extern "C" GAMESERVERQUERY_API GameServerQueryHandle QueueGameServerRcon(
+    int protocolId,                     // Protocol ID (e.g., 1 for Medal of Honor, 2 for Call of Duty)
+    const char* ipOrHostname,           // Server IP or hostname
+    int port,                           // Server port
+    const char* command,                // Console command, with or without the "rcon " prefix (e.g., "say hello")
+    const char* rconPassword,           // RCON password for authentication
+    int minIntervalMs,                  // Least time between two commands sent to this server (e.g., 500 for
+                                        // sv_floodprotect); 0 sends each command as soon as the previous one completes
+    int timeoutMs,                      // Reply deadline counted from when the command is sent (0 for the command default)
+    GameServerRconCallback callback,    // Receives the outcome
+    void* userData                      // Passed through to the callback
+);
+
+// Sends an rcon command and returns as soon as the datagram is out, without waiting for the reply. Use it for
+// commands that change server state (map, kick, say, set) when the console output is not needed. Returns a
+// GameServerResultCode: OK once sent, or the validation, resolve or network error.
+extern "C" GAMESERVERQUERY_API int SendGameServerRcon(
+    int protocolId,             // Protocol ID (e.g., 1 for Medal of Honor, 2 for Call of Duty)
+    const char* ipOrHostname,   // Server IP or hostname
+    int port,                   // Server port
+    const char* command,        // Console command, with or without the "rcon " prefix (e.g., "map mp_harbor")
+    const char* rconPassword    // RCON password for authentication
+);
+
+// Receives the outcome of a verified rcon write on the library's I/O thread; observedValue is only valid during the call
+typedef void (*GameServerVerifyCallback)(
+    int status,                 // GSQ_RESULT_OK (value matched), GSQ_RESULT_TIMEOUT or GSQ_RESULT_DROPPED (shutdown)
+    const char* observedValue,  // Latest value of the setting reported by the server (empty if never seen)
+    void* userData              // Pointer passed to SendGameServerRconVerified
+);
+
+// Sends an rcon command like SendGameServerRcon, then polls getstatus every pollIntervalMs until the server
+// setting key equals expectedValue (ignoring case) or timeoutMs passes, and reports through the callback.
+// With key and expectedValue null the setting is derived from the command: "map"/"devmap <name>" checks
+// mapname and "set"/"seta"/"sets <cvar> <value>" checks the cvar, which must be a serverinfo cvar.
+// Returns the result of the send; the callback runs exactly once if and only if this returns GSQ_RESULT_OK.
+extern "C" GAMESERVERQUERY_API int SendGameServerRconVerified(
+    int protocolId,                     // Protocol ID (e.g., 1 for Medal of Honor, 2 for Call of Duty)
+    const char* ipOrHostname,           // Server IP or hostname
+    int port,                           // Server port
+    const char* command,                // Console command, with or without the "rcon " prefix
+    const char* rconPassword,           // RCON password for authentication
+    const char* key,                    // Server setting to check (e.g., "mapname"), or null to derive it
+    const char* expectedValue,          // Value that confirms the write, or null to derive it
+    int pollIntervalMs,                 // Time between getstatus polls, at least 100; the first poll waits one interval
+    int timeoutMs,                      // Deadline for the confirmation, at least pollIntervalMs
+    GameServerVerifyCallback callback,  // Receives the outcome
+    void* userData                      // Passed through to the callback
+);
+
+// How FindGameServerPlayer matches its query against player names, after color codes are removed and
+// letters lowercased on both sides
+enum GameServerPlayerMatch {
+    GSQ_PLAYER_MATCH_EXACT = 0,         // Every word of the query is a whole word of the name, or the query equals a guid,
+                                        // steamid or address (with or without port)
+    GSQ_PLAYER_MATCH_PREFIX = 1,        // As exact, but the last word (or the identifier) only has to start the name word
+    GSQ_PLAYER_MATCH_SUBSTRING = 2      // The name contains the query anywhere
+};
+
+// Looks up which servers a player is on, using the players recorded from the getstatus and rcon status replies
+// received while GSQ_OPTION_PLAYER_INDEX is on. Each server keeps the players of its latest reply. Returns a
+// JSON array of up to maxResults matches, most recently seen first, each with "server" (ip:port), "protocol",
+// "slot" (when known), "name", "clean_name", "guid"/"steamid"/"address" (from rcon status, when known) and
+// "last_seen" (Unix time in milliseconds). Free the result with FreeGameServerResponse.
+extern "C" GAMESERVERQUERY_API const char* FindGameServerPlayer(
+    const char* query,          // Name, name words, guid, steamid or address to look for
+    int match,                  // GameServerPlayerMatch value
+    int maxResults              // Largest number of matches to return, at least 1
+);
+
+// Forgets every player and server recorded in the player index
+extern "C" GAMESERVERQUERY_API void ClearGameServerPlayerIndex();
+
+// averagePing of history samples from a protocol whose getstatus lists no pings (Medal of Honor)
+enum GameServerHistoryValue {
+    GSQ_HISTORY_NO_PING = 0xFFFF
+};
+
+// Contiguous run of history samples, one array per column. The arrays point straight into the memory-mapped
+// ring file: they stay valid until the history is closed, and the ring overwrites the oldest samples as new ones
+// arrive, so copy anything that must outlive the next few polls.
+struct GameServerHistorySpan {
+    int count;                          // Samples in this span
+    const long long* timestamps;        // Unix time in milliseconds, never decreasing
+    const unsigned short* players;      // Player count
+    const unsigned int* mapIds;         // Map ID; GetGameServerHistoryMapName returns the name (0 means no mapname)
+    const unsigned short* averagePing;  // Mean ping of the listed players in milliseconds (0 without players, GSQ_HISTORY_NO_PING
+                                        // when the protocol reports none)
+    const unsigned int* rttMicros;      // Time the server took to answer, in microseconds
+};
+
+// Samples of one time bucket, averaged by DownsampleGameServerHistory
+struct GameServerHistoryBucket {
+    long long start;                    // Bucket start, Unix time in milliseconds
+    int samples;                        // Samples in the bucket (never 0; empty buckets are left out)
+    int minPlayers;
+    int maxPlayers;
+    float averagePlayers;
+    float averagePing;                  // Mean of the samples' average pings, in milliseconds, or -1 if none reported a ping
+    float averageRttMs;                 // Mean query round trip, in milliseconds
+    unsigned int mapId;                 // Map of the last sample in the bucket
+};
+
+// Starts recording a sample of every getstatus reply received from a server: timestamp, player count, map,
+// average ping and query round trip. Each server gets a ring file of samplesPerServer fixed-width samples in
+// directory (created if missing), named after its address and port, plus a shared maps.txt table of map names.
+// Existing files are reopened with their history intact and keep their own size. A null directory stops
+// recording and closes the files. Returns false if the directory or map table cannot be opened.
+extern "C" GAMESERVERQUERY_API bool OpenGameServerHistory(
+    const char* directory,      // Directory for the ring files, or null to close the history
+    int samplesPerServer        // Ring size for servers that have no file yet, at least 1
+);
+
+// Points spans[0] and spans[1] at a server's samples taken between fromMs and toMs (inclusive), oldest first.
+// The second span is only used when the range wraps around the end of the ring; unused spans have count 0.
+// Nothing is copied. Returns the number of samples, or -1 if the history is closed or the arguments are invalid.
+extern "C" GAMESERVERQUERY_API int ReadGameServerHistory(
+    const char* ipOrHostname,   // Server IP or hostname
+    int port,                   // Server port
+    long long fromMs,           // Range start, Unix time in milliseconds
+    long long toMs,             // Range end, Unix time in milliseconds
+    GameServerHistorySpan* spans // Array of two spans to fill
+);
+
+// Averages a server's samples between fromMs and toMs into buckets of bucketMs, aligned to fromMs.
+// Returns the number of buckets written (up to maxBuckets), or -1 if the history is closed or the
+// arguments are invalid.
+extern "C" GAMESERVERQUERY_API int DownsampleGameServerHistory(
+    const char* ipOrHostname,   // Server IP or hostname
+    int port,                   // Server port
+    long long fromMs,           // Range start, Unix time in milliseconds
+    long long toMs,             // Range end, Unix time in milliseconds
+    long long bucketMs,         // Bucket width in milliseconds
+    GameServerHistoryBucket* buckets, // Receives the buckets
+    int maxBuckets              // Size of the buckets array
+);
+
+// Returns the map name of a history map ID, or null for an unknown ID. Free the result with FreeGameServerResponse.
+extern "C" GAMESERVERQUERY_API const char* GetGameServerHistoryMapName(int mapId);
+
+// Frees a response returned by this library, handing its buffer back to the response pool (null is ignored).
+// Responses must not be released with free().
 extern "C" GAMESERVERQUERY_API void FreeGameServerResponse(const char* response);
\ No newline at end of file
@@ -0,0 +1,1243 @@
+#include "GameServerQuery.h"
+#include "GameServerEmulator.h"
+#include <iostream>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <iomanip>
+#include <memory>
+#include <filesystem>
+#include <climits>
+
+// Counts heap allocations made by this executable (and by the library when it is linked statically)
+static std::atomic<size_t> allocationCount{ 0 };
+
+void* operator new(size_t size) {
+    ++allocationCount;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+    // Parser used before the string_view rewrite, kept as the baseline for the parse benchmark
+    namespace legacy {
+        // Escapes special characters in a string for JSON output
+        std::string EscapeJson(const std::string& input) {
+            std::string result;
+            for (char c : input) {
+                if (c == '"') result += "\\\"";
+                else if (c == '\\') result += "\\\\";
+                else if (c == '\n') result += "\\n";
+                else if (c == '\r') continue;
+                else result += c;
+            }
+            return result;
+        }
+
+        // Parses key-value pairs from server response
+        std::map<std::string, std::string> ParseKeyValues(const std::string& response) {
+            std::map<std::string, std::string> result;
+            std::string key;
+            size_t pos = 0;
+
+            while (pos < response.size() && response[pos] == '\n') {
+                ++pos;
+            }
+
+            while (pos < response.size()) {
+                if (response[pos] != '\\') {
+                    break;
+                }
+                ++pos;
+                size_t next = response.find('\\', pos);
+                if (next == std::string::npos) {
+                    break;
+                }
+                key = response.substr(pos, next - pos);
+                pos = next + 1;
+                next = response.find('\\', pos);
+                if (next == std::string::npos) {
+                    next = response.find('\n', pos);
+                    if (next == std::string::npos) {
+                        next = response.size();
+                    }
+                }
+                if (!key.empty()) {
+                    result[key] = response.substr(pos, next - pos);
+                }
+                pos = next;
+            }
+            return result;
+        }
+
+        // Parses player data from getstatus response
+        std::vector<std::map<std::string, std::string>> ParseGetStatusPlayers(const std::string& response, int protocolId) {
+            std::vector<std::map<std::string, std::string>> players;
+            std::stringstream ss(response);
+            std::string line;
+            bool inKeyValues = true;
+
+            while (std::getline(ss, line)) {
+                if (line.empty()) {
+                    inKeyValues = false;
+                    continue;
+                }
+                if (inKeyValues && line[0] == '\\') {
+                    continue;
+                }
+                inKeyValues = false;
+                // Trim whitespace
+                line.erase(line.begin(), std::find_if(line.begin(), line.end(), [](char c) { return !std::isspace(c); }));
+                line.erase(std::find_if(line.rbegin(), line.rend(), [](char c) { return !std::isspace(c); }).base(), line.end());
+                if (line.empty()) {
+                    continue;
+                }
+                std::stringstream playerStream(line);
+                std::vector<std::string> tokens;
+                std::string token;
+                bool inQuotes = false;
+                for (char c : line) {
+                    if (c == '"') {
+                        inQuotes = !inQuotes;
+                        token += c;
+                        continue;
+                    }
+                    if (c == ' ' && !inQuotes && !token.empty()) {
+                        tokens.push_back(token);
+                        token.clear();
+                        continue;
+                    }
+                    token += c;
+                }
+                if (!token.empty()) {
+                    tokens.push_back(token);
+                }
+                if (protocolId == 1 && tokens.size() >= 2) { // Medal of Honor: slot "name"
+                    std::map<std::string, std::string> player;
+                    player["slot"] = tokens[0];
+                    std::string name = tokens[1];
+                    if (name.size() >= 2 && name[0] == '"' && name.back() == '"') {
+                        player["name"] = name.substr(1, name.size() - 2);
+                        player["score"] = "0";
+                        player["ping"] = "0";
+                        if (std::all_of(player["slot"].begin(), player["slot"].end(), ::isdigit)) {
+                            players.push_back(player);
+                        }
+                    }
+                }
+                else if (protocolId == 2 && tokens.size() >= 3) { // Call of Duty: score ping "name"
+                    std::map<std::string, std::string> player;
+                    player["score"] = tokens[0];
+                    player["ping"] = tokens[1];
+                    std::string name = tokens[2];
+                    if (name.size() >= 2 && name[0] == '"' && name.back() == '"') {
+                        player["name"] = name.substr(1, name.size() - 2);
+                        player["slot"] = "0";
+                        if ((player["score"].empty() || std::all_of(player["score"].begin(), player["score"].end(), ::isdigit) ||
+                            (player["score"].size() > 1 && player["score"][0] == '-' &&
+                                std::all_of(player["score"].begin() + 1, player["score"].end(), ::isdigit))) &&
+                            (player["ping"].empty() || std::all_of(player["ping"].begin(), player["ping"].end(), ::isdigit))) {
+                            players.push_back(player);
+                        }
+                    }
+                }
+            }
+            return players;
+        }
+
+        // Converts key-value pairs and player data to JSON format
+        std::string ToJson(const std::map<std::string, std::string>& kv, const std::vector<std::map<std::string, std::string>>& players) {
+            std::string result = "{";
+            result += "\"server\":{";
+            bool first = true;
+            for (const auto& pair : kv) {
+                if (!first) result += ",";
+                result += "\"" + EscapeJson(pair.first) + "\":\"" + EscapeJson(pair.second) + "\"";
+                first = false;
+            }
+            result += "},\"players\":[";
+            first = true;
+            for (const auto& player : players) {
+                if (!first) result += ",";
+                result += "{";
+                result += "\"slot\":\"" + EscapeJson(player.at("slot")) + "\",";
+                result += "\"score\":\"" + EscapeJson(player.at("score")) + "\",";
+                result += "\"ping\":\"" + EscapeJson(player.at("ping")) + "\",";
+                result += "\"name\":\"" + EscapeJson(player.at("name")) + "\"";
+                if (player.count("lastmsg")) result += ",\"lastmsg\":\"" + EscapeJson(player.at("lastmsg")) + "\"";
+                if (player.count("address")) result += ",\"address\":\"" + EscapeJson(player.at("address")) + "\"";
+                if (player.count("qport")) result += ",\"qport\":\"" + EscapeJson(player.at("qport")) + "\"";
+                if (player.count("rate")) result += ",\"rate\":\"" + EscapeJson(player.at("rate")) + "\"";
+                if (player.count("guid")) result += ",\"guid\":\"" + EscapeJson(player.at("guid")) + "\"";
+                if (player.count("playerid")) result += ",\"playerid\":\"" + EscapeJson(player.at("playerid")) + "\"";
+                if (player.count("steamid")) result += ",\"steamid\":\"" + EscapeJson(player.at("steamid")) + "\"";
+                result += "}";
+                first = false;
+            }
+            result += "]}";
+            return result;
+        }
+
+        // Mirrors the former getstatus branch of the protocol handlers
+        std::string ParseStatus(const std::string& packet, int protocolId) {
+            size_t pos = packet.find("statusResponse");
+            if (pos == std::string::npos) {
+                return "error=Invalid server response;raw=" + packet;
+            }
+            std::string response = packet.substr(pos + 14);
+            auto kv = ParseKeyValues(response);
+            auto players = ParseGetStatusPlayers(response, protocolId);
+            return ToJson(kv, players);
+        }
+    }
+
+    // Times one parser over a payload and reports nanoseconds and heap allocations per call
+    template <typename ParseFn>
+    void MeasureParse(const char* label, int iterations, ParseFn parse) {
+        size_t allocationsBefore = allocationCount;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            parse();
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        double allocations = static_cast<double>(allocationCount - allocationsBefore) / iterations;
+        std::cout << "  " << label << static_cast<long>(ns / iterations) << " ns/parse, " << allocations << " allocations/parse" << std::endl;
+    }
+
+    // Renders a typed getstatus result in the JSON layout of ParseGameServerResponse, so it can be checked
+    // against the full parse: player count, every player's slot, score, ping and name, and the settings
+    std::string TypedToJson(const GameServerResult* result) {
+        if (!result || result->status != GSQ_RESULT_OK) {
+            return "";
+        }
+        std::string json = "{\"server\":{";
+        for (int i = 0; i < result->serverInfoCount; ++i) {
+            const GameServerKeyValue& pair = result->serverInfo[i];
+            json += (i > 0 ? ",\"" : "\"") + legacy::EscapeJson(pair.key) + "\":\"" + legacy::EscapeJson(pair.value) + "\"";
+        }
+        json += "},\"players\":[";
+        for (int i = 0; i < result->playerCount; ++i) {
+            const GameServerPlayer& player = result->players[i];
+            json += (i > 0 ? ",{" : "{");
+            json += "\"slot\":\"" + std::to_string(player.slot) + "\",\"score\":\"" + std::to_string(player.score)
+                + "\",\"ping\":\"" + std::to_string(player.ping) + "\",\"name\":\"" + legacy::EscapeJson(player.name) + "\"}";
+        }
+        return json + "]}";
+    }
+
+    // Output a projection of the given settings plus players.count should produce, taken from the full parse
+    // of the same packet in its typed form
+    std::string ExpectedFields(const GameServerResult* result, const std::vector<std::string>& keys) {
+        if (!result || result->status != GSQ_RESULT_OK) {
+            return "";
+        }
+        std::string json = "{\"server\":{";
+        bool first = true;
+        for (const std::string& key : keys) {
+            for (int i = 0; i < result->serverInfoCount; ++i) {
+                if (key == result->serverInfo[i].key) {
+                    json += (first ? "\"" : ",\"") + legacy::EscapeJson(key) + "\":\"" + legacy::EscapeJson(result->serverInfo[i].value) + "\"";
+                    first = false;
+                    break;
+                }
+            }
+        }
+        return json + "},\"player_count\":" + std::to_string(result->playerCount) + "}";
+    }
+
+    // Compares the legacy and current getstatus parsers on MOH and COD payloads, and the typed records and a
+    // projection with the current parser's output; returns non-zero if any of them differ
+    int RunParseBenchmark(int iterations) {
+        int mismatches = 0;
+        for (int protocolId = 1; protocolId <= 2; ++protocolId) {
+            std::string packet = GameServerEmulator::StatusReply(protocolId, 64);
+            std::cout << (protocolId == 1 ? "Medal of Honor" : "Call of Duty") << " getstatus, 64 players, " << packet.size() << " bytes" << std::endl;
+
+            const char* current = ParseGameServerResponse(protocolId, false, "getstatus", packet.c_str());
+            bool matches = legacy::ParseStatus(packet, protocolId) == current;
+            mismatches += matches ? 0 : 1;
+            std::cout << "  Output matches legacy parser: " << (matches ? "yes" : "no") << std::endl;
+            const GameServerResult* typed = ParseGameServerResponseTyped(protocolId, "getstatus", packet.c_str());
+            matches = TypedToJson(typed) == current;
+            mismatches += matches ? 0 : 1;
+            std::cout << "  Typed records match output: " << (matches ? "yes" : "no") << std::endl;
+            FreeGameServerResponse(current);
+
+            MeasureParse("Legacy parser:  ", iterations, [&]() {
+                std::string json = legacy::ParseStatus(packet, protocolId);
+            });
+            MeasureParse("Current parser: ", iterations, [&]() {
+                FreeGameServerResponse(ParseGameServerResponse(protocolId, false, "getstatus", packet.c_str()));
+            });
+            MeasureParse("Typed records:  ", iterations, [&]() {
+                FreeGameServerResult(ParseGameServerResponseTyped(protocolId, "getstatus", packet.c_str()));
+            });
+
+            const char* fields = "sv_hostname,mapname,g_gametype,sv_maxclients,players.count";
+            const char* projected = ParseGameServerResponseFields(protocolId, "getstatus", packet.c_str(), fields);
+            const char* full = ParseGameServerResponse(protocolId, false, "getstatus", packet.c_str());
+            matches = ExpectedFields(typed, { "sv_hostname", "mapname", "g_gametype", "sv_maxclients" }) == projected;
+            mismatches += matches ? 0 : 1;
+            std::cout << "  Projected output: " << std::strlen(projected) << " bytes (full output " << std::strlen(full) << " bytes), "
+                << (matches ? "matches" : "MISMATCH") << std::endl;
+            FreeGameServerResult(typed);
+            FreeGameServerResponse(projected);
+            FreeGameServerResponse(full);
+            MeasureParse("Projected:      ", iterations, [&]() {
+                FreeGameServerResponse(ParseGameServerResponseFields(protocolId, "getstatus", packet.c_str(), fields));
+            });
+        }
+        return mismatches > 0 ? 1 : 0;
+    }
+
+    // One captured reply of the tokenizer corpus
+    struct CorpusEntry {
+        const char* label;
+        int protocolId;
+        const char* command;
+        std::string packet;
+    };
+
+    // Times every corpus payload at each tokenizer instruction set, then with color-code stripping enabled;
+    // returns non-zero if the instruction sets produce different output
+    int RunTokenizerBenchmark(int iterations) {
+        int mismatches = 0;
+        const std::string print = "\xFF\xFF\xFF\xFFprint\n";
+        std::vector<CorpusEntry> corpus = {
+            { "MOH getstatus", 1, "getstatus", GameServerEmulator::StatusReply(1, 64) },
+            { "COD getstatus", 2, "getstatus", GameServerEmulator::StatusReply(2, 64) },
+            { "MOH rcon status", 1, "rcon status", print + GameServerEmulator::RconStatusText(1, 64, false) },
+            { "COD rcon status", 2, "rcon status", print + GameServerEmulator::RconStatusText(2, 64, false) },
+            { "COD Steam rcon status", 2, "rcon status", print + GameServerEmulator::RconStatusText(2, 64, true) },
+        };
+        struct Setting {
+            const char* label;
+            int simdLevel;
+            bool cleanNames;
+        };
+        const Setting settings[] = {
+            { "scalar", 0, false }, { "SSE2", 1, false }, { "AVX2", 2, false }, { "AVX2 + clean", 2, true },
+        };
+
+        std::cout << "Tokenizer corpus, 64 players per payload (ns/parse; instruction sets the CPU lacks fall back)" << std::endl;
+        std::cout << "  " << std::left << std::setw(24) << "payload" << std::right << std::setw(7) << "bytes";
+        for (const Setting& setting : settings) {
+            std::cout << std::setw(14) << setting.label;
+        }
+        std::cout << std::endl;
+
+        for (const CorpusEntry& entry : corpus) {
+            std::cout << "  " << std::left << std::setw(24) << entry.label << std::right << std::setw(7) << entry.packet.size();
+            std::string reference;
+            bool consistent = true;
+            for (const Setting& setting : settings) {
+                SetGameServerQueryOption(GSQ_OPTION_SIMD_LEVEL, setting.simdLevel);
+                SetGameServerQueryOption(GSQ_OPTION_CLEAN_NAMES, setting.cleanNames ? 1 : 0);
+                const char* output = ParseGameServerResponse(entry.protocolId, false, entry.command, entry.packet.c_str());
+                if (!setting.cleanNames) {
+                    if (reference.empty()) reference = output;
+                    consistent = consistent && reference == output;
+                }
+                FreeGameServerResponse(output);
+
+                auto start = std::chrono::steady_clock::now();
+                for (int i = 0; i < iterations; ++i) {
+                    FreeGameServerResponse(ParseGameServerResponse(entry.protocolId, false, entry.command, entry.packet.c_str()));
+                }
+                double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+                std::cout << std::setw(14) << static_cast<long>(ns);
+            }
+            std::cout << (consistent ? "" : "  OUTPUT MISMATCH") << std::endl;
+            mismatches += consistent ? 0 : 1;
+        }
+        SetGameServerQueryOption(GSQ_OPTION_SIMD_LEVEL, 2);
+        SetGameServerQueryOption(GSQ_OPTION_CLEAN_NAMES, 0);
+        return mismatches > 0 ? 1 : 0;
+    }
+
+    // Runs the given number of getstatus queries spread over several threads and returns queries per second
+    double MeasureQueriesPerSecond(int port, int queries, int threads, int& failures) {
+        std::atomic<int> failed{ 0 };
+        std::vector<std::thread> workers;
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t]() {
+                for (int i = t; i < queries; i += threads) {
+                    const char* result = ProcessGameServerCommand(2, false, "127.0.0.1", port, "getstatus", nullptr);
+                    if (!result || std::string(result).find("error=") == 0) {
+                        ++failed;
+                    }
+                    FreeGameServerResponse(result);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        failures = failed;
+        return seconds > 0 ? queries / seconds : 0;
+    }
+
+    // Benchmarks ProcessGameServerCommand with and without the socket pool against a local stand-in server
+    int RunPoolBenchmark(int queries, int threads) {
+#ifdef _WIN32
+        WSADATA wsaData;
+        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+            std::cerr << "Error: Winsock initialization failed" << std::endl;
+            return 1;
+        }
+#endif
+        GameServerEmulatorConfig config;
+        config.players = 2;
+        GameServerEmulator standIn(config);
+        if (!standIn.Start()) {
+            std::cerr << "Error: Could not start local stand-in server" << std::endl;
+#ifdef _WIN32
+            WSACleanup();
+#endif
+            return 1;
+        }
+
+        int failures = 0;
+        double unpooled = MeasureQueriesPerSecond(standIn.Port(), queries, threads, failures);
+        std::cout << "Per-call sockets: " << static_cast<long>(unpooled) << " queries/sec (" << failures << " failed)" << std::endl;
+
+        if (!GameServerQueryInit(threads)) {
+            std::cerr << "Error: GameServerQueryInit failed" << std::endl;
+        }
+        else {
+            double pooled = MeasureQueriesPerSecond(standIn.Port(), queries, threads, failures);
+            std::cout << "Socket pool:      " << static_cast<long>(pooled) << " queries/sec (" << failures << " failed)" << std::endl;
+            if (unpooled > 0) {
+                std::cout << "Speedup:          " << pooled / unpooled << "x" << std::endl;
+            }
+            GameServerQueryShutdown();
+        }
+
+        standIn.Stop();
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return 0;
+    }
+
+    // Reads one counter from the JSON metrics snapshot
+    unsigned long long StatCounter(const char* name) {
+        size_t needed = 0;
+        GetGameServerQueryStats(GSQ_STATS_JSON, nullptr, 0, &needed);
+        std::string json(needed, '\0');
+        GetGameServerQueryStats(GSQ_STATS_JSON, &json[0], json.size(), &needed);
+        size_t pos = json.find("\"" + std::string(name) + "\":");
+        return pos == std::string::npos ? 0 : std::strtoull(json.c_str() + pos + std::strlen(name) + 3, nullptr, 10);
+    }
+
+    // Mean time of one phase in nanoseconds for a protocol, from the library's latency histograms
+    double PhaseNanos(const char* phase, int protocolId) {
+        size_t needed = 0;
+        GetGameServerQueryStats(GSQ_STATS_JSON, nullptr, 0, &needed);
+        std::string json(needed, '\0');
+        GetGameServerQueryStats(GSQ_STATS_JSON, &json[0], json.size(), &needed);
+        size_t pos = json.find("\"phase\":\"" + std::string(phase) + "\",\"protocol\":" + std::to_string(protocolId) + ",");
+        if (pos == std::string::npos) {
+            return 0;
+        }
+        size_t count = json.find("\"count\":", pos);
+        size_t sum = json.find("\"sum_ns\":", pos);
+        double samples = static_cast<double>(std::strtoull(json.c_str() + count + 8, nullptr, 10));
+        return samples > 0 ? static_cast<double>(std::strtoull(json.c_str() + sum + 9, nullptr, 10)) / samples : 0;
+    }
+
+    // Sweeps a batch of loopback emulators with ProcessGameServerCommandBatch, once with sendmmsg/recvmmsg and
+    // once with one system call per datagram, and compares system calls per query and throughput
+    int RunSyscallBenchmark(int servers, int rounds) {
+        std::vector<std::unique_ptr<GameServerEmulator>> emulators;
+        GameServerEmulatorConfig config;
+        config.players = 8;
+        for (int i = 0; i < servers; ++i) {
+            emulators.push_back(std::make_unique<GameServerEmulator>(config));
+            if (!emulators.back()->Start()) {
+                std::cerr << "Error: Could not start emulator " << i << std::endl;
+                return 1;
+            }
+        }
+        std::vector<GameServerQueryRequest> requests;
+        for (const auto& emulator : emulators) {
+            requests.push_back({ 2, true, "127.0.0.1", emulator->Port(), "getinfo", nullptr });
+        }
+        std::vector<const char*> results(requests.size());
+        if (!GameServerQueryInit(1)) {
+            std::cerr << "Error: GameServerQueryInit failed" << std::endl;
+            return 1;
+        }
+
+        std::cout << servers << " loopback servers, " << rounds << " batch rounds of getinfo" << std::endl;
+        std::cout << "  " << std::left << std::setw(12) << "mode" << std::right << std::setw(12) << "queries/s" << std::setw(12) << "send calls"
+            << std::setw(14) << "receive calls" << std::setw(14) << "calls/query" << std::setw(8) << "failed" << std::endl;
+        bool passed = true;
+        for (int batched : { 1, 0 }) {
+            SetGameServerQueryOption(GSQ_OPTION_BATCHED_IO, batched);
+            ResetGameServerQueryStats();
+            int replies = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int round = 0; round < rounds; ++round) {
+                replies += (std::max)(0, ProcessGameServerCommandBatch(requests.data(), static_cast<int>(requests.size()), 2000, results.data()));
+                for (const char* result : results) {
+                    FreeGameServerResponse(result);
+                }
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            int queries = servers * rounds;
+            unsigned long long sendCalls = StatCounter("send_calls");
+            unsigned long long receiveCalls = StatCounter("receive_calls");
+            std::cout << "  " << std::left << std::setw(12) << (batched ? "batched" : "per-packet") << std::right
+                << std::setw(12) << static_cast<long>(seconds > 0 ? queries / seconds : 0)
+                << std::setw(12) << sendCalls << std::setw(14) << receiveCalls
+                << std::setw(14) << std::fixed << std::setprecision(3) << static_cast<double>(sendCalls + receiveCalls) / queries
+                << std::setw(8) << queries - replies << std::endl;
+            passed = passed && replies == queries;
+        }
+        SetGameServerQueryOption(GSQ_OPTION_BATCHED_IO, 1);
+        GameServerQueryShutdown();
+        return passed ? 0 : 1;
+    }
+
+    // Counts the results of a ScanGameServerList run; the callback is called from every worker thread
+    struct ShardTally {
+        std::atomic<int> reported{ 0 };
+        std::atomic<int> failed{ 0 };
+    };
+
+    void OnShardResult(int, const char* response, void* userData) {
+        ShardTally* tally = static_cast<ShardTally*>(userData);
+        ++tally->reported;
+        if (std::strncmp(response, "error=", 6) == 0) {
+            ++tally->failed;
+        }
+    }
+
+    // Sweeps a target list of getstatus queries against loopback emulators with ScanGameServerList, doubling the
+    // worker count up to maxThreads, and compares throughput against a single worker
+    int RunShardBenchmark(int servers, int rounds, int maxThreads) {
+        std::vector<std::unique_ptr<GameServerEmulator>> emulators;
+        GameServerEmulatorConfig config;
+        config.players = 32;
+        for (int i = 0; i < servers; ++i) {
+            emulators.push_back(std::make_unique<GameServerEmulator>(config));
+            if (!emulators.back()->Start()) {
+                std::cerr << "Error: Could not start emulator " << i << std::endl;
+                return 1;
+            }
+        }
+        std::vector<GameServerQueryRequest> targets;
+        for (int round = 0; round < rounds; ++round) {
+            for (const auto& emulator : emulators) {
+                targets.push_back({ 2, false, "127.0.0.1", emulator->Port(), "getstatus", nullptr });
+            }
+        }
+        if (!GameServerQueryInit(1)) {
+            std::cerr << "Error: GameServerQueryInit failed" << std::endl;
+            return 1;
+        }
+
+        std::cout << targets.size() << " getstatus targets across " << servers << " loopback servers, "
+            << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+        std::cout << "  " << std::setw(8) << "threads" << std::setw(12) << "queries/s" << std::setw(10) << "speedup"
+            << std::setw(8) << "steals" << std::setw(8) << "failed" << std::endl;
+        bool passed = true;
+        double baseline = 0;
+        for (int threads = 1; threads <= maxThreads; threads *= 2) {
+            ResetGameServerQueryStats();
+            ShardTally tally;
+            auto start = std::chrono::steady_clock::now();
+            ScanGameServerList(targets.data(), static_cast<int>(targets.size()), threads, 2000, OnShardResult, &tally);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double rate = seconds > 0 ? targets.size() / seconds : 0;
+            if (threads == 1) {
+                baseline = rate;
+            }
+            std::cout << "  " << std::setw(8) << threads << std::setw(12) << static_cast<long>(rate)
+                << std::setw(9) << std::fixed << std::setprecision(2) << (baseline > 0 ? rate / baseline : 0) << "x"
+                << std::setw(8) << StatCounter("scan_steals") << std::setw(8) << tally.failed << std::endl;
+            passed = passed && tally.reported == static_cast<int>(targets.size()) && tally.failed == 0;
+        }
+        GameServerQueryShutdown();
+        return passed ? 0 : 1;
+    }
+
+    // Fills the player index from loopback emulators that each list different players, then times exact, prefix
+    // and substring lookups against it
+    int RunIndexBenchmark(int servers, int players, int lookups) {
+        std::vector<std::unique_ptr<GameServerEmulator>> emulators;
+        GameServerEmulatorConfig config;
+        config.players = players;
+        for (int i = 0; i < servers; ++i) {
+            config.firstPlayer = i * players;
+            emulators.push_back(std::make_unique<GameServerEmulator>(config));
+            if (!emulators.back()->Start()) {
+                std::cerr << "Error: Could not start emulator " << i << std::endl;
+                return 1;
+            }
+        }
+        if (!GameServerQueryInit(1)) {
+            std::cerr << "Error: GameServerQueryInit failed" << std::endl;
+            return 1;
+        }
+
+        std::cout << servers << " loopback servers with " << players << " players each (" << servers * players << " players)" << std::endl;
+        bool passed = true;
+        // rcon status replies take several datagrams each, so those are fetched a few servers at a time
+        // to stay within the socket's receive buffer
+        auto scan = [&](const char* command, bool indexed, int group) {
+            std::vector<GameServerQueryRequest> targets;
+            for (const auto& emulator : emulators) {
+                targets.push_back({ 2, false, "127.0.0.1", emulator->Port(), command, "secret" });
+            }
+            SetGameServerQueryOption(GSQ_OPTION_PLAYER_INDEX, indexed ? 1 : 0);
+            ShardTally tally;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t first = 0; first < targets.size(); first += group) {
+                int count = static_cast<int>((std::min)(targets.size() - first, static_cast<size_t>(group)));
+                ScanGameServerList(targets.data() + first, count, 1, 5000, OnShardResult, &tally);
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "  " << std::left << std::setw(34) << (std::string(command) + (indexed ? ", index on:" : ", index off:")) << std::right
+                << std::setw(8) << std::fixed << std::setprecision(1) << ms << " ms, " << tally.failed << " failed" << std::endl;
+            passed = passed && tally.failed == 0;
+        };
+        scan("getstatus", false, servers);
+        scan("getstatus", true, servers);
+        scan("rcon status", true, 32);
+        scan("getstatus", true, servers);
+        scan("getstatus", true, servers);
+        scan("getstatus", true, servers);
+
+        // Player numbers are unique across the emulators; see GameServerEmulatorConfig::firstPlayer
+        int player = servers * players / 2 + 7;
+        std::string number = std::to_string(player);
+        std::string guid = std::to_string(100000 + player * 7919);
+        std::string address = "10." + std::to_string(player / 62500) + "." + std::to_string(player / 250 % 250) + "." + std::to_string(player % 250 + 1);
+        struct Lookup {
+            std::string label;
+            std::string query;
+            int match;
+        };
+        const Lookup queries[] = {
+            { "exact name", "Player #" + number, GSQ_PLAYER_MATCH_EXACT },
+            { "exact guid", guid, GSQ_PLAYER_MATCH_EXACT },
+            { "exact address", address, GSQ_PLAYER_MATCH_EXACT },
+            { "prefix", "player " + number.substr(0, number.size() - 1), GSQ_PLAYER_MATCH_PREFIX },
+            { "substring", "r #" + number.substr(0, number.size() - 1), GSQ_PLAYER_MATCH_SUBSTRING },
+            { "substring, no match", "nobody here", GSQ_PLAYER_MATCH_SUBSTRING },
+        };
+        std::cout << "  " << std::left << std::setw(22) << "lookup" << std::setw(22) << "query" << std::right
+            << std::setw(9) << "matches" << std::setw(12) << "us/lookup" << std::endl;
+        for (const Lookup& lookup : queries) {
+            const char* result = FindGameServerPlayer(lookup.query.c_str(), lookup.match, 100);
+            std::string json = result;
+            FreeGameServerResponse(result);
+            size_t matches = 0;
+            for (size_t pos = json.find("\"server\""); pos != std::string::npos; pos = json.find("\"server\"", pos + 1)) ++matches;
+            bool found = lookup.match == GSQ_PLAYER_MATCH_SUBSTRING && lookup.query == "nobody here" ? matches == 0
+                : json.find("#" + number + "\"") != std::string::npos;
+            passed = passed && found;
+
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < lookups; ++i) {
+                FreeGameServerResponse(FindGameServerPlayer(lookup.query.c_str(), lookup.match, 100));
+            }
+            double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / lookups;
+            std::cout << "  " << std::left << std::setw(22) << lookup.label << std::setw(22) << lookup.query << std::right
+                << std::setw(9) << matches << std::setw(12) << std::setprecision(2) << us << (found ? "" : "  MISSING") << std::endl;
+        }
+        SetGameServerQueryOption(GSQ_OPTION_PLAYER_INDEX, 0);
+        GameServerQueryShutdown();
+        return passed ? 0 : 1;
+    }
+
+    // Sweeps loopback emulators with getstatus while recording history, then times zero-copy range reads and
+    // downsampling, and checks that the rings read back the same after the history is closed and reopened
+    int RunHistoryBenchmark(int servers, int rounds, int samples) {
+        std::vector<std::unique_ptr<GameServerEmulator>> emulators;
+        GameServerEmulatorConfig config;
+        config.players = 24;
+        for (int i = 0; i < servers; ++i) {
+            emulators.push_back(std::make_unique<GameServerEmulator>(config));
+            if (!emulators.back()->Start()) {
+                std::cerr << "Error: Could not start emulator " << i << std::endl;
+                return 1;
+            }
+        }
+        std::vector<GameServerQueryRequest> targets;
+        for (const auto& emulator : emulators) {
+            targets.push_back({ 2, false, "127.0.0.1", emulator->Port(), "getstatus", nullptr });
+        }
+        std::string directory = (std::filesystem::temp_directory_path() / "gsq_history_bench").string();
+        std::filesystem::remove_all(directory);
+        if (!GameServerQueryInit(1)) {
+            std::cerr << "Error: GameServerQueryInit failed" << std::endl;
+            return 1;
+        }
+
+        std::cout << servers << " loopback servers, " << rounds << " getstatus sweeps, " << samples << " samples per ring in " << directory << std::endl;
+        bool passed = true;
+        auto sweep = [&](bool recorded) {
+            if (recorded && !OpenGameServerHistory(directory.c_str(), samples)) {
+                std::cerr << "Error: OpenGameServerHistory failed" << std::endl;
+                passed = false;
+            }
+            ResetGameServerQueryStats();
+            ShardTally tally;
+            auto start = std::chrono::steady_clock::now();
+            for (int round = 0; round < rounds; ++round) {
+                ScanGameServerList(targets.data(), static_cast<int>(targets.size()), 1, 2000, OnShardResult, &tally);
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "  Sweeps, history " << (recorded ? "on: " : "off:") << std::setw(9) << std::fixed << std::setprecision(1) << ms
+                << " ms, parse " << std::setprecision(0) << PhaseNanos("parse", 2) << " ns per reply, " << tally.failed << " failed" << std::endl;
+            passed = passed && tally.failed == 0;
+        };
+        sweep(false);
+        sweep(true);
+
+        // Reads every ring in full, checking it holds the newest samples in time order
+        const int port = emulators[0]->Port();
+        auto readAll = [&](const char* label, long long& first) {
+            auto start = std::chrono::steady_clock::now();
+            GameServerHistorySpan spans[2];
+            int count = ReadGameServerHistory("127.0.0.1", port, 0, LLONG_MAX, spans);
+            double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            bool ordered = count == (std::min)(rounds, samples);
+            long long previous = 0;
+            for (const GameServerHistorySpan& span : spans) {
+                for (int i = 0; i < span.count; ++i) {
+                    ordered = ordered && span.timestamps[i] >= previous && span.players[i] == 24 && span.mapIds[i] != 0;
+                    previous = span.timestamps[i];
+                }
+            }
+            first = count > 0 ? spans[0].timestamps[0] : 0;
+            std::cout << "  " << label << std::setw(7) << count << " samples in " << (spans[1].count ? 2 : 1) << " span(s), "
+                << std::setprecision(2) << us << " us" << (ordered ? "" : "  MISMATCH") << std::endl;
+            passed = passed && ordered;
+        };
+        long long first = 0, reopenedFirst = 0;
+        readAll("Read:           ", first);
+
+        GameServerHistoryBucket buckets[60];
+        auto start = std::chrono::steady_clock::now();
+        const int iterations = 1000;
+        int bucketCount = 0;
+        for (int i = 0; i < iterations; ++i) {
+            bucketCount = DownsampleGameServerHistory("127.0.0.1", port, first, first + 60000, 1000, buckets, 60);
+        }
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+        const char* map = bucketCount > 0 ? GetGameServerHistoryMapName(buckets[0].mapId) : nullptr;
+        std::cout << "  Downsample:      " << std::setw(7) << bucketCount << " one-second buckets, " << us << " us, map "
+            << (map ? map : "(none)") << std::endl;
+        passed = passed && bucketCount > 0 && map && std::string(map) == "mp_harbor";
+        FreeGameServerResponse(map);
+
+        OpenGameServerHistory(nullptr, 0);
+        OpenGameServerHistory(directory.c_str(), samples);
+        readAll("After reopening:", reopenedFirst);
+        passed = passed && reopenedFirst == first;
+
+        // Reopening with a larger ring size must leave existing rings as they are when they are written to
+        std::string ring = directory + "/127.0.0.1_" + std::to_string(port) + ".gsqh";
+        std::error_code error;
+        uintmax_t sizeBefore = std::filesystem::file_size(ring, error);
+        OpenGameServerHistory(nullptr, 0);
+        OpenGameServerHistory(directory.c_str(), samples * 2);
+        ShardTally tally;
+        ScanGameServerList(targets.data(), static_cast<int>(targets.size()), 1, 2000, OnShardResult, &tally);
+        uintmax_t sizeAfter = std::filesystem::file_size(ring, error);
+        std::cout << "  Larger ring size: " << sizeBefore << " byte ring file, " << sizeAfter << " bytes after reopening and polling"
+            << (sizeAfter == sizeBefore ? "" : "  MISMATCH") << std::endl;
+        passed = passed && tally.failed == 0 && sizeBefore > 0 && sizeAfter == sizeBefore;
+
+        OpenGameServerHistory(nullptr, 0);
+        GameServerQueryShutdown();
+        std::filesystem::remove_all(directory);
+        return passed ? 0 : 1;
+    }
+
+    // Names of the player objects in one array of a delta reply ("joined", "left" or "updated"), sorted
+    std::vector<std::string> DeltaNames(const std::string& delta, const char* list) {
+        std::vector<std::string> names;
+        size_t pos = delta.find(std::string("\"") + list + "\":[");
+        if (pos == std::string::npos) {
+            return names;
+        }
+        pos = delta.find('[', pos);
+        int depth = 0;
+        bool quoted = false;
+        for (size_t i = pos; i < delta.size(); ++i) {
+            char c = delta[i];
+            if (quoted) {
+                if (c == '\\') ++i;
+                else if (c == '"') quoted = false;
+                continue;
+            }
+            if (c == '"') {
+                if (delta.compare(i, 8, "\"name\":\"") == 0) {
+                    size_t end = delta.find('"', i + 8);
+                    names.push_back(delta.substr(i + 8, end - i - 8));
+                    i = end;
+                    continue;
+                }
+                quoted = true;
+            }
+            else if (c == '[') ++depth;
+            else if (c == ']' && --depth == 0) break;
+        }
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    // Names the emulator gives players first to last - 1 as the parser reports them, sorted
+    std::vector<std::string> EmulatorNames(int first, int last, const char* suffix) {
+        std::vector<std::string> names;
+        for (int n = first; n < last; ++n) {
+            names.push_back("^" + std::to_string(n % 10) + "Player ^7#" + std::to_string(n) + suffix);
+        }
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    // Polls a loopback emulator with delta queries while its player list changes between polls, and checks the
+    // full first reply, the empty reply for an unchanged poll and the joined, left and updated players
+    int RunDeltaBenchmark(int players) {
+        if (!GameServerQueryInit(1)) {
+            std::cerr << "Error: GameServerQueryInit failed" << std::endl;
+            return 1;
+        }
+        struct Case {
+            const char* name;
+            int protocolId;
+            const char* command;
+            bool scores;        // Status lines carry the score, so a score change shows up as an update
+            const char* suffix; // Kept after each name (the ^7 color reset Call of Duty prints in rcon status)
+        };
+        const Case cases[] = {
+            { "MOH getstatus", 1, "getstatus", false, "" },
+            { "MOH rcon status", 1, "rcon status", true, "" },
+            { "COD getstatus", 2, "getstatus", true, "" },
+            { "COD rcon status", 2, "rcon status", true, "^7" },
+        };
+        std::cout << "Delta polls of a loopback server with " << players << " players" << std::endl;
+        bool passed = true;
+        for (const Case& test : cases) {
+            GameServerEmulatorConfig config;
+            config.players = players;
+            auto emulator = std::make_unique<GameServerEmulator>(config);
+            if (!emulator->Start()) {
+                std::cerr << "Error: Could not start emulator" << std::endl;
+                return 1;
+            }
+            const int port = emulator->Port();
+            // Restarts the emulator on the same port with a different player list
+            auto change = [&](int count, int scoreOffset) {
+                emulator.reset();
+                config.players = count;
+                config.scoreOffset = scoreOffset;
+                emulator = std::make_unique<GameServerEmulator>(config);
+                return emulator->Start(port);
+            };
+            auto poll = [&]() {
+                const char* result = ProcessGameServerCommandDelta(test.protocolId, "127.0.0.1", port, test.command, config.rconPassword.c_str());
+                std::string delta = result ? result : "";
+                FreeGameServerResponse(result);
+                return delta;
+            };
+            auto matches = [&](const std::string& delta, const std::vector<std::string>& joined, const std::vector<std::string>& left,
+                const std::vector<std::string>& updated) {
+                return delta.find("error=") != 0 && DeltaNames(delta, "joined") == joined && DeltaNames(delta, "left") == left
+                    && DeltaNames(delta, "updated") == updated;
+            };
+            const std::vector<std::string> none;
+
+            ResetGameServerDeltaState();
+            std::string first = poll();
+            bool full = first.find("\"full\":true") != std::string::npos && matches(first, EmulatorNames(0, players, test.suffix), none, none)
+                && (std::string(test.command) != "getstatus" || first.find("\"mapname\":\"mp_harbor\"") != std::string::npos);
+            bool unchanged = poll() == "{}";
+            // One player joins and every score goes up
+            bool joined = change(players + 1, 10);
+            joined = joined && matches(poll(), EmulatorNames(players, players + 1, test.suffix), none, test.scores ? EmulatorNames(0, players, test.suffix) : none);
+            // Two players leave
+            bool left = change(players - 1, 10);
+            left = left && matches(poll(), none, EmulatorNames(players - 1, players + 1, test.suffix), none);
+            // After a reset the next poll is a full one again
+            ResetGameServerDeltaState();
+            std::string reset = poll();
+            bool again = reset.find("\"full\":true") != std::string::npos && matches(reset, EmulatorNames(0, players - 1, test.suffix), none, none);
+
+            bool ok = full && unchanged && joined && left && again;
+            std::cout << "  " << std::left << std::setw(18) << test.name << std::right << "full " << (full ? "ok" : "MISMATCH")
+                << ", unchanged " << (unchanged ? "ok" : "MISMATCH") << ", joined " << (joined ? "ok" : "MISMATCH")
+                << ", left " << (left ? "ok" : "MISMATCH") << ", reset " << (again ? "ok" : "MISMATCH") << std::endl;
+            passed = passed && ok;
+        }
+        ResetGameServerDeltaState();
+        GameServerQueryShutdown();
+        return passed ? 0 : 1;
+    }
+
+    // Per-watch state for the watch check
+    struct WatchTally {
+        std::atomic<int> polls{ 0 };
+        std::atomic<int> failed{ 0 };
+        std::atomic<bool> inside{ false };      // The callback is running
+        std::atomic<bool> removed{ false };     // RemoveGameServerWatch has returned
+        std::atomic<int> late{ 0 };             // Callbacks that started after removal
+        int holdMs = 0;                         // Time each callback takes
+    };
+
+    void OnWatchResult(GameServerWatchHandle, const char* response, void* userData) {
+        WatchTally* tally = static_cast<WatchTally*>(userData);
+        if (tally->removed) {
+            ++tally->late;
+        }
+        tally->inside = true;
+        ++tally->polls;
+        if (std::strncmp(response, "error=", 6) == 0) {
+            ++tally->failed;
+        }
+        if (tally->holdMs > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(tally->holdMs));
+        }
+        tally->inside = false;
+    }
+
+    // Watches a loopback emulator at several intervals and checks the poll counts over a fixed window, that a
+    // paused watch is not called back, and that no callback runs once RemoveGameServerWatch has returned
+    int RunWatchBenchmark(int windowMs, int removals) {
+        GameServerEmulator server;
+        if (!server.Start()) {
+            std::cerr << "Error: Could not start emulator" << std::endl;
+            return 1;
+        }
+        if (!GameServerQueryInit(1)) {
+            std::cerr << "Error: GameServerQueryInit failed" << std::endl;
+            return 1;
+        }
+
+        std::cout << "Watching a loopback server for " << windowMs << " ms" << std::endl;
+        std::cout << "  " << std::setw(10) << "interval" << std::setw(10) << "expected" << std::setw(8) << "polls"
+            << std::setw(8) << "failed" << std::endl;
+        bool passed = true;
+        const int intervals[] = { 100, 250, 500 };
+        WatchTally tallies[3];
+        GameServerWatchHandle handles[3];
+        for (int i = 0; i < 3; ++i) {
+            handles[i] = AddGameServerWatch(2, false, "127.0.0.1", server.Port(), "getinfo", nullptr, intervals[i], OnWatchResult, &tallies[i]);
+            passed = passed && handles[i] != 0;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(windowMs));
+        for (int i = 0; i < 3; ++i) {
+            RemoveGameServerWatch(handles[i]);
+            // The first poll falls somewhere within the first interval and later ones are jittered by up to 5%
+            double expected = static_cast<double>(windowMs) / intervals[i];
+            int polls = tallies[i].polls;
+            bool counted = polls >= expected - 1 - expected * 0.1 && polls <= expected + 1 + expected * 0.1;
+            std::cout << "  " << std::setw(8) << intervals[i] << "ms" << std::setw(10) << std::fixed << std::setprecision(1) << expected
+                << std::setw(8) << polls << std::setw(8) << tallies[i].failed << (counted ? "" : "  MISMATCH") << std::endl;
+            passed = passed && counted && tallies[i].failed == 0;
+        }
+
+        // A paused watch may still report a poll that was already running, so the count is taken after one interval
+        WatchTally paused;
+        GameServerWatchHandle handle = AddGameServerWatch(2, false, "127.0.0.1", server.Port(), "getinfo", nullptr, 100, OnWatchResult, &paused);
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        PauseGameServerWatch(handle, true);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        int beforePause = paused.polls;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+        int whilePaused = paused.polls - beforePause;
+        PauseGameServerWatch(handle, false);
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        int afterResume = paused.polls - beforePause - whilePaused;
+        RemoveGameServerWatch(handle);
+        std::cout << "  Paused:   " << beforePause << " polls before, " << whilePaused << " while paused, " << afterResume
+            << " after resuming" << (whilePaused == 0 && afterResume > 0 ? "" : "  MISMATCH") << std::endl;
+        passed = passed && beforePause > 0 && whilePaused == 0 && afterResume > 0 && paused.failed == 0;
+
+        // Removes watches while their (slow) callback is running; RemoveGameServerWatch must wait for it
+        int overlapped = 0, late = 0;
+        for (int i = 0; i < removals; ++i) {
+            WatchTally tally;
+            tally.holdMs = 50;
+            handle = AddGameServerWatch(2, false, "127.0.0.1", server.Port(), "getinfo", nullptr, 100, OnWatchResult, &tally);
+            auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+            while (!tally.inside && std::chrono::steady_clock::now() < giveUp) {
+                std::this_thread::yield();
+            }
+            overlapped += tally.inside ? 1 : 0;
+            RemoveGameServerWatch(handle);
+            bool running = tally.inside;
+            tally.removed = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(250));
+            late += tally.late + (running ? 1 : 0);
+        }
+        std::cout << "  Removed:  " << removals << " watches, " << overlapped << " during a callback, " << late
+            << " callbacks after removal" << (late == 0 ? "" : "  MISMATCH") << std::endl;
+        passed = passed && overlapped == removals && late == 0;
+
+        GameServerQueryShutdown();
+        return passed ? 0 : 1;
+    }
+
+    // A query run against one emulator setup by the regression suite
+    struct Scenario {
+        const char* name;
+        int protocolId;
+        const char* command;
+        int players;
+        bool steamLayout;
+        int latencyMs;
+        int jitterMs;
+        double lossRate;
+        int queries;
+    };
+
+    // Captured reply for a scenario, used to time the parser on its own
+    std::string ScenarioReply(const Scenario& scenario) {
+        if (std::string(scenario.command) == "getinfo") {
+            return GameServerEmulator::InfoReply(scenario.players);
+        }
+        if (std::string(scenario.command) == "getstatus") {
+            return GameServerEmulator::StatusReply(scenario.protocolId, scenario.players);
+        }
+        std::string header = scenario.protocolId == 1 ? "\xFF\xFF\xFF\xFF\x01print\n" : "\xFF\xFF\xFF\xFFprint\n";
+        return header + GameServerEmulator::RconStatusText(scenario.protocolId, scenario.players, scenario.steamLayout);
+    }
+
+    double Percentile(const std::vector<double>& sorted, double fraction) {
+        if (sorted.empty()) {
+            return 0;
+        }
+        size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+        return sorted[(std::min)(index, sorted.size() - 1)];
+    }
+
+    // Runs one scenario and prints its row; returns false if more queries failed than its packet loss explains
+    bool RunScenario(const Scenario& scenario, int threads) {
+        GameServerEmulatorConfig config;
+        config.players = scenario.players;
+        config.steamLayout = scenario.steamLayout;
+        config.latencyMs = scenario.latencyMs;
+        config.jitterMs = scenario.jitterMs;
+        config.lossRate = scenario.lossRate;
+        GameServerEmulator server(config);
+        if (!server.Start()) {
+            std::cerr << "Error: Could not start emulator for " << scenario.name << std::endl;
+            return false;
+        }
+
+        std::atomic<int> failed{ 0 };
+        std::vector<std::vector<double>> latencies(threads);
+        std::vector<std::thread> workers;
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t]() {
+                for (int i = t; i < scenario.queries; i += threads) {
+                    auto sent = std::chrono::steady_clock::now();
+                    const char* result = ProcessGameServerCommand(scenario.protocolId, false, "127.0.0.1", server.Port(), scenario.command, config.rconPassword.c_str());
+                    latencies[t].push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent).count());
+                    if (!result || std::strncmp(result, "error=", 6) == 0) {
+                        ++failed;
+                    }
+                    FreeGameServerResponse(result);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        server.Stop();
+
+        std::vector<double> all;
+        for (const auto& perThread : latencies) {
+            all.insert(all.end(), perThread.begin(), perThread.end());
+        }
+        std::sort(all.begin(), all.end());
+
+        std::string packet = ScenarioReply(scenario);
+        const int parseIterations = 2000;
+        auto parseStart = std::chrono::steady_clock::now();
+        for (int i = 0; i < parseIterations; ++i) {
+            FreeGameServerResponse(ParseGameServerResponse(scenario.protocolId, false, scenario.command, packet.c_str()));
+        }
+        double parseNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - parseStart).count() / parseIterations;
+
+        // Each lost datagram fails at most one query; allow generous headroom over the expected loss
+        int allowed = scenario.lossRate > 0 ? static_cast<int>(scenario.queries * scenario.lossRate * 3) + 2 : 0;
+        bool passed = failed <= allowed;
+        std::cout << std::left << std::setw(38) << scenario.name << std::right
+            << std::setw(10) << static_cast<long>(seconds > 0 ? scenario.queries / seconds : 0)
+            << std::setw(10) << std::fixed << std::setprecision(2) << Percentile(all, 0.50)
+            << std::setw(10) << Percentile(all, 0.99)
+            << std::setw(10) << static_cast<long>(parseNs)
+            << std::setw(8) << failed.load() << (passed ? "" : "  REGRESSION") << std::endl;
+        return passed;
+    }
+
+    // Runs every scenario against fresh emulators; returns 1 if any scenario regressed
+    int RunSuite(int threads) {
+        const Scenario scenarios[] = {
+            { "MOH getstatus, 16 players", 1, "getstatus", 16, false, 0, 0, 0.0, 2000 },
+            { "COD getinfo", 2, "getinfo", 16, false, 0, 0, 0.0, 2000 },
+            { "COD getstatus, 64 players", 2, "getstatus", 64, false, 0, 0, 0.0, 2000 },
+            { "MOH rcon status, 40 players", 1, "rcon status", 40, false, 0, 0, 0.0, 200 },
+            { "COD rcon status, 40 players", 2, "rcon status", 40, false, 0, 0, 0.0, 200 },
+            { "COD rcon status, Steam, 40 players", 2, "rcon status", 40, true, 0, 0, 0.0, 200 },
+            { "COD getstatus, 20+5 ms, 1% loss", 2, "getstatus", 16, false, 20, 5, 0.01, 400 },
+        };
+
+        if (!GameServerQueryInit(threads)) {
+            std::cerr << "Error: GameServerQueryInit failed" << std::endl;
+            return 1;
+        }
+        // Loopback replies arrive together, so a short quiet period keeps rcon timings about the library, not the wait
+        SetGameServerQueryOption(GSQ_OPTION_QUIET_PERIOD_MS, 20);
+
+        std::cout << std::left << std::setw(38) << "Scenario" << std::right << std::setw(10) << "qps" << std::setw(10) << "p50 ms"
+            << std::setw(10) << "p99 ms" << std::setw(10) << "parse ns" << std::setw(8) << "failed" << std::endl;
+        bool passed = true;
+        for (const Scenario& scenario : scenarios) {
+            passed = RunScenario(scenario, threads) && passed;
+        }
+
+        SetGameServerQueryOption(GSQ_OPTION_QUIET_PERIOD_MS, 100);
+        GameServerQueryShutdown();
+        return passed ? 0 : 1;
+    }
+
+    // Runs a standalone emulator until Enter is pressed, for pointing the test harness or other tools at
+    int RunEmulator(int port, int players, bool steamLayout, int latencyMs, int jitterMs, double lossRate) {
+        GameServerEmulatorConfig config;
+        config.players = players;
+        config.steamLayout = steamLayout;
+        config.latencyMs = latencyMs;
+        config.jitterMs = jitterMs;
+        config.lossRate = lossRate;
+        GameServerEmulator server(config);
+        if (!server.Start(port)) {
+            std::cerr << "Error: Could not bind 127.0.0.1:" << port << std::endl;
+            return 1;
+        }
+        std::cout << "Emulating a server on 127.0.0.1:" << server.Port() << " (rcon password \"" << config.rconPassword
+            << "\"); press Enter to stop" << std::endl;
+        std::string line;
+        std::getline(std::cin, line);
+        server.Stop();
+        std::cout << server.Received() << " queries received, " << server.Dropped() << " replies dropped" << std::endl;
+        return 0;
+    }
+}
+
+// Runs the library benchmarks without real game servers
+// Usage: GameServerQueryBench [suite [threads] | pool [queries] [threads] | parse [iterations] | tokenize [iterations] |
+//                              syscalls [servers] [rounds] | shard [servers] [rounds] [maxThreads] |
+//                              index [servers] [players] [lookups] | history [servers] [rounds] [samples] |
+//                              delta [players] | watch [windowMs] [removals] |
+//                              serve [port] [players] [latencyMs] [jitterMs] [lossPercent] [steam]]
+int main(int argc, char* argv[]) {
+    std::string mode = argc > 1 ? argv[1] : "all";
+    if (mode == "serve") {
+        int port = argc > 2 ? std::atoi(argv[2]) : 28960;
+        int players = argc > 3 ? std::atoi(argv[3]) : 16;
+        int latencyMs = argc > 4 ? std::atoi(argv[4]) : 0;
+        int jitterMs = argc > 5 ? std::atoi(argv[5]) : 0;
+        double lossRate = argc > 6 ? std::atof(argv[6]) / 100.0 : 0.0;
+        bool steamLayout = argc > 7 && std::string(argv[7]) == "steam";
+        return RunEmulator(port, players, steamLayout, latencyMs, jitterMs, lossRate);
+    }
+    if (mode == "suite") {
+        int threads = argc > 2 ? std::atoi(argv[2]) : 4;
+        return threads > 0 ? RunSuite(threads) : 1;
+    }
+    if (mode == "pool" || mode == "all") {
+        int queries = mode == "pool" && argc > 2 ? std::atoi(argv[2]) : 5000;
+        int threads = mode == "pool" && argc > 3 ? std::atoi(argv[3]) : 1;
+        if (queries <= 0 || threads <= 0 || RunPoolBenchmark(queries, threads) != 0) {
+            return 1;
+        }
+    }
+    if (mode == "syscalls") {
+        int servers = argc > 2 ? std::atoi(argv[2]) : 128;
+        int rounds = argc > 3 ? std::atoi(argv[3]) : 50;
+        return servers > 0 && rounds > 0 ? RunSyscallBenchmark(servers, rounds) : 1;
+    }
+    if (mode == "shard") {
+        int servers = argc > 2 ? std::atoi(argv[2]) : 256;
+        int rounds = argc > 3 ? std::atoi(argv[3]) : 40;
+        int maxThreads = argc > 4 ? std::atoi(argv[4]) : (std::max)(1u, std::thread::hardware_concurrency());
+        return servers > 0 && rounds > 0 && maxThreads > 0 ? RunShardBenchmark(servers, rounds, maxThreads) : 1;
+    }
+    if (mode == "index") {
+        int servers = argc > 2 ? std::atoi(argv[2]) : 800;
+        int players = argc > 3 ? std::atoi(argv[3]) : 64;
+        int lookups = argc > 4 ? std::atoi(argv[4]) : 1000;
+        return servers > 0 && players > 0 && lookups > 0 ? RunIndexBenchmark(servers, players, lookups) : 1;
+    }
+    if (mode == "history") {
+        int servers = argc > 2 ? std::atoi(argv[2]) : 32;
+        int rounds = argc > 3 ? std::atoi(argv[3]) : 400;
+        int samples = argc > 4 ? std::atoi(argv[4]) : 256;
+        return servers > 0 && rounds > 0 && samples > 0 ? RunHistoryBenchmark(servers, rounds, samples) : 1;
+    }
+    if (mode == "delta") {
+        int players = argc > 2 ? std::atoi(argv[2]) : 16;
+        return players > 1 ? RunDeltaBenchmark(players) : 1;
+    }
+    if (mode == "watch") {
+        int windowMs = argc > 2 ? std::atoi(argv[2]) : 3000;
+        int removals = argc > 3 ? std::atoi(argv[3]) : 10;
+        return windowMs > 0 && removals > 0 ? RunWatchBenchmark(windowMs, removals) : 1;
+    }
+    if (mode == "parse" || mode == "all") {
+        int iterations = mode == "parse" && argc > 2 ? std::atoi(argv[2]) : 20000;
+        if (iterations <= 0 || RunParseBenchmark(iterations) != 0) {
+            return 1;
+        }
+    }
+    if (mode == "tokenize" || mode == "all") {
+        int iterations = mode == "tokenize" && argc > 2 ? std::atoi(argv[2]) : 5000;
+        if (iterations <= 0 || RunTokenizerBenchmark(iterations) != 0) {
+            return 1;
+        }
+    }
+    if (mode == "all") {
+        return RunSuite(4);
+    }
+    if (mode != "pool" && mode != "parse" && mode != "tokenize") {
+        std::cerr << "Usage: GameServerQueryBench [suite [threads] | pool [queries] [threads] | parse [iterations] | tokenize [iterations] |" << std::endl
+            << "                            syscalls [servers] [rounds] | shard [servers] [rounds] [maxThreads] |" << std::endl
+            << "                            index [servers] [players] [lookups] | history [servers] [rounds] [samples] |" << std::endl
+            << "                            delta [players] | watch [windowMs] [removals] |" << std::endl
+            << "                            serve [port] [players] [latencyMs] [jitterMs] [lossPercent] [steam]]" << std::endl;
+        return 1;
+    }
+    return 0;
+}
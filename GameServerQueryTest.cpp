@@ -4,6 +4,30 @@
 #include <string>
 #include <thread>
 #include <chrono>
+#include <vector>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Counts heap allocations made through operator new. With a statically linked library, or a shared library on
+// Linux, the library's own allocations are included; a Windows DLL allocates from its own runtime and is not.
+static std::atomic<size_t> allocationCount{ 0 };
+
+void* operator new(size_t size) {
+    ++allocationCount;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
 
 // Executes a single game server query test and prints the result
 void RunTest(int testId, int protocolId, bool raw, const char* ipOrHostname, int port, const char* command, const char* rconPassword) {
@@ -25,6 +49,255 @@ void RunTest(int testId, int protocolId, bool raw, const char* ipOrHostname, int
     std::this_thread::sleep_for(std::chrono::milliseconds(500));
 }
 
+// Executes a batch of queries in one call and prints each result
+void RunBatchTest(int testId, const GameServerQueryRequest* requests, int count, int timeoutMs) {
+    std::cout << "Test " << testId << ": ";
+    std::vector<const char*> results(count);
+    auto start = std::chrono::steady_clock::now();
+    int replies = ProcessGameServerCommandBatch(requests, count, timeoutMs, results.data());
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << (replies > 0 ? "PASSED: " : "FAILED: ") << replies << "/" << count << " replies in " << elapsed << " ms" << std::endl;
+    for (int i = 0; i < count; ++i) {
+        std::cout << "  [" << i << "] " << (results[i] ? results[i] : "Null result") << std::endl;
+        FreeGameServerResponse(results[i]);
+    }
+    std::cout << std::endl << std::endl;
+}
+
+// Counts asynchronous results and prints each one as it arrives
+std::atomic<int> asyncCompleted{ 0 };
+void OnAsyncResult(GameServerQueryHandle handle, const char* response, void* userData) {
+    int testId = *static_cast<int*>(userData);
+    std::cout << "Test " << testId << " (handle " << handle << "): " << (strstr(response, "error=") ? "FAILED: " : "PASSED: ") << response << std::endl;
+    ++asyncCompleted;
+}
+
+// Queues asynchronous queries, cancels the last one, and waits for every callback
+void RunAsyncTest(int testId, const GameServerQueryRequest* requests, int count) {
+    static int ids[64];
+    asyncCompleted = 0;
+    GameServerQueryHandle last = 0;
+    for (int i = 0; i < count && i < 64; ++i) {
+        ids[i] = testId;
+        last = ProcessGameServerCommandAsync(requests[i].protocolId, requests[i].raw, requests[i].ipOrHostname, requests[i].port,
+            requests[i].command, requests[i].rconPassword, 1000, OnAsyncResult, &ids[i]);
+    }
+    std::cout << "Test " << testId << ": cancel last request " << (CancelGameServerCommand(last) ? "requested" : "too late") << std::endl;
+    while (asyncCompleted < count) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::cout << std::endl << std::endl;
+}
+
+// Prints every server reported by a master-server scan
+void OnScanResult(const char* ip, int port, const char* response, void* userData) {
+    ++*static_cast<int*>(userData);
+    std::cout << "  " << ip << ":" << port << " " << response << std::endl;
+}
+
+// Scans a master server's list with getinfo and prints a summary
+void RunScanTest(int testId, const char* masterHostname, int masterPort, int protocolVersion) {
+    std::cout << "Test " << testId << ":" << std::endl;
+    int reported = 0;
+    auto start = std::chrono::steady_clock::now();
+    int replies = ScanGameServers(2, false, masterHostname, masterPort, protocolVersion, "getinfo", 200, 1000, OnScanResult, &reported);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << (replies > 0 ? "PASSED: " : "FAILED: ") << replies << "/" << reported << " servers replied in " << elapsed << " ms" << std::endl;
+    std::cout << std::endl << std::endl;
+}
+
+// Counts list-scan results; called from several worker threads at once
+void OnListResult(int, const char*, void* userData) {
+    static_cast<std::atomic<int>*>(userData)->fetch_add(1);
+}
+
+// Queries a target list repeated across worker threads and checks that every target is reported once
+void RunListScanTest(int testId, const GameServerQueryRequest* requests, int count, int repeats, int threads) {
+    std::cout << "Test " << testId << ": ";
+    std::vector<GameServerQueryRequest> targets;
+    for (int i = 0; i < repeats; ++i) {
+        targets.insert(targets.end(), requests, requests + count);
+    }
+    std::atomic<int> reported{ 0 };
+    auto start = std::chrono::steady_clock::now();
+    int replies = ScanGameServerList(targets.data(), static_cast<int>(targets.size()), threads, 1000, OnListResult, &reported);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    bool passed = replies > 0 && reported == static_cast<int>(targets.size());
+    std::cout << (passed ? "PASSED: " : "FAILED: ") << replies << "/" << reported << " targets replied on " << threads
+        << " threads in " << elapsed << " ms" << std::endl;
+    std::cout << std::endl << std::endl;
+}
+
+// Executes a query through the typed API and prints its records
+void RunTypedTest(int testId, int protocolId, const char* ipOrHostname, int port, const char* command, const char* rconPassword) {
+    std::cout << "Test " << testId << ": ";
+    const GameServerResult* result = ProcessGameServerCommandTyped(protocolId, ipOrHostname, port, command, rconPassword);
+    if (!result) {
+        std::cout << "FAILED: Null result" << std::endl << std::endl << std::endl;
+        return;
+    }
+    if (result->status != GSQ_RESULT_OK) {
+        std::cout << "FAILED: status " << result->status << " (" << result->error << ")" << std::endl;
+    }
+    else {
+        std::cout << "PASSED: " << result->serverInfoCount << " settings, " << result->playerCount << " players" << std::endl;
+        for (int i = 0; i < result->playerCount; ++i) {
+            const GameServerPlayer& player = result->players[i];
+            std::cout << "  " << player.slot << " " << player.score << " " << player.ping << " " << player.cleanName << std::endl;
+        }
+    }
+    FreeGameServerResult(result);
+    std::cout << std::endl << std::endl;
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+}
+
+// Prints each queued rcon outcome with the time since the burst was queued
+std::atomic<int> rconCompleted{ 0 };
+std::chrono::steady_clock::time_point rconQueuedAt;
+void OnRconResult(GameServerQueryHandle, int status, const char* output, void* userData) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - rconQueuedAt).count();
+    std::cout << "  " << static_cast<const char*>(userData) << " after " << elapsed << " ms: " << (status == GSQ_RESULT_OK ? "PASSED" : "FAILED: status " + std::to_string(status))
+        << " " << output << std::endl;
+    ++rconCompleted;
+}
+
+// Queues a burst of rcon commands on one server and waits until every command reports its outcome
+void RunRconQueueTest(int testId, int protocolId, const char* ipOrHostname, int port, const char* rconPassword, int minIntervalMs) {
+    static const char* commands[] = { "say Queued command 1", "say Queued command 2", "say Queued command 3", "serverinfo" };
+    std::cout << "Test " << testId << ":" << std::endl;
+    rconCompleted = 0;
+    rconQueuedAt = std::chrono::steady_clock::now();
+    int queued = 0;
+    for (const char* command : commands) {
+        if (QueueGameServerRcon(protocolId, ipOrHostname, port, command, rconPassword, minIntervalMs, 0, OnRconResult, (void*)command)) {
+            ++queued;
+        }
+    }
+    while (rconCompleted < queued) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::cout << std::endl << std::endl;
+}
+
+// Prints the outcome of a verified rcon write
+std::atomic<bool> verifyDone{ false };
+void OnVerifyResult(int status, const char* observedValue, void* userData) {
+    std::cout << "Test " << *static_cast<int*>(userData) << ": " << (status == GSQ_RESULT_OK ? "PASSED" : "FAILED: status " + std::to_string(status))
+        << " (server reports " << observedValue << ")" << std::endl;
+    verifyDone = true;
+}
+
+// Sends an rcon write without waiting for its reply and waits for the getstatus confirmation
+void RunVerifiedWriteTest(int testId, int protocolId, const char* ipOrHostname, int port, const char* command, const char* rconPassword) {
+    static int id;
+    id = testId;
+    verifyDone = false;
+    auto start = std::chrono::steady_clock::now();
+    int status = SendGameServerRconVerified(protocolId, ipOrHostname, port, command, rconPassword, nullptr, nullptr, 500, 10000, OnVerifyResult, &id);
+    auto sentUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Test " << testId << ": sent with status " << status << " in " << sentUs << " us" << std::endl;
+    while (status == GSQ_RESULT_OK && !verifyDone) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::cout << std::endl << std::endl;
+}
+
+// Reads one counter from the library's JSON metrics
+unsigned long long StatCounter(const char* name) {
+    char stats[16384];
+    size_t needed = 0;
+    if (!GetGameServerQueryStats(GSQ_STATS_JSON, stats, sizeof(stats), &needed)) {
+        return 0;
+    }
+    const char* pos = std::strstr(stats, (std::string("\"") + name + "\":").c_str());
+    return pos ? std::strtoull(pos + std::strlen(name) + 3, nullptr, 10) : 0;
+}
+
+// Repeats a query once it has warmed up and reports heap allocations and new response buffers per call;
+// steady-state polling should need neither
+void RunAllocationTest(int testId, int protocolId, const char* ipOrHostname, int port, const char* command, const char* captured, int calls) {
+    std::cout << "Test " << testId << ": ";
+    auto query = [&]() {
+        FreeGameServerResponse(captured ? ParseGameServerResponse(protocolId, false, command, captured)
+            : ProcessGameServerCommand(protocolId, false, ipOrHostname, port, command, nullptr));
+    };
+    for (int i = 0; i < 10; ++i) {
+        query();
+    }
+    unsigned long long buffersBefore = StatCounter("pool_allocated");
+    size_t allocationsBefore = allocationCount;
+    for (int i = 0; i < calls; ++i) {
+        query();
+    }
+    double allocations = static_cast<double>(allocationCount - allocationsBefore) / calls;
+    double buffers = static_cast<double>(StatCounter("pool_allocated") - buffersBefore) / calls;
+    std::cout << (allocations == 0 && buffers == 0 ? "PASSED: " : "FAILED: ") << allocations << " heap allocations and "
+        << buffers << " new response buffers per " << (captured ? "parse" : "query") << std::endl;
+    std::cout << std::endl << std::endl;
+}
+
+// Executes a query that returns only the listed fields and prints the result
+void RunFieldsTest(int testId, int protocolId, const char* ipOrHostname, int port, const char* command, const char* rconPassword, const char* fields) {
+    std::cout << "Test " << testId << ": ";
+    const char* result = ProcessGameServerCommandFields(protocolId, ipOrHostname, port, command, rconPassword, fields);
+    std::cout << (strstr(result, "error=") ? "FAILED: " : "PASSED: ") << result << std::endl;
+    FreeGameServerResponse(result);
+    std::cout << std::endl << std::endl;
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+}
+
+// Records a server's players in the player index, then looks up the first listed player by name
+void RunPlayerIndexTest(int testId, int protocolId, const char* ipOrHostname, int port) {
+    std::cout << "Test " << testId << ": ";
+    SetGameServerQueryOption(GSQ_OPTION_PLAYER_INDEX, 1);
+    const char* status = ProcessGameServerCommand(protocolId, false, ipOrHostname, port, "getstatus", nullptr);
+    std::string json = status;
+    FreeGameServerResponse(status);
+    size_t start = json.find("\"name\":\"");
+    if (json.find("error=") == 0 || start == std::string::npos) {
+        std::cout << "FAILED: No players to look up: " << json << std::endl;
+    }
+    else {
+        start += 8;
+        std::string name = json.substr(start, json.find('"', start) - start);
+        const char* result = FindGameServerPlayer(name.c_str(), GSQ_PLAYER_MATCH_SUBSTRING, 10);
+        std::cout << (strstr(result, "\"server\"") ? "PASSED: " : "FAILED: ") << name << " -> " << result << std::endl;
+        FreeGameServerResponse(result);
+    }
+    SetGameServerQueryOption(GSQ_OPTION_PLAYER_INDEX, 0);
+    std::cout << std::endl << std::endl;
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+}
+
+// Records two polls of a server in a history ring, then reads the samples back with their map name
+void RunHistoryTest(int testId, int protocolId, const char* ipOrHostname, int port, const char* directory) {
+    std::cout << "Test " << testId << ": ";
+    if (!OpenGameServerHistory(directory, 1000)) {
+        std::cout << "FAILED: Could not open history in " << directory << std::endl;
+    }
+    else {
+        long long from = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        for (int i = 0; i < 2; ++i) {
+            FreeGameServerResponse(ProcessGameServerCommand(protocolId, false, ipOrHostname, port, "getstatus", nullptr));
+        }
+        GameServerHistorySpan spans[2];
+        int samples = ReadGameServerHistory(ipOrHostname, port, from, from + 60000, spans);
+        if (samples < 2) {
+            std::cout << "FAILED: " << samples << " samples recorded" << std::endl;
+        }
+        else {
+            const GameServerHistorySpan& last = spans[1].count ? spans[1] : spans[0];
+            const char* map = GetGameServerHistoryMapName(static_cast<int>(last.mapIds[last.count - 1]));
+            std::cout << "PASSED: " << samples << " samples, last " << last.players[last.count - 1] << " players on "
+                << (map ? map : "(none)") << ", " << last.rttMicros[last.count - 1] << " us round trip" << std::endl;
+            FreeGameServerResponse(map);
+        }
+        OpenGameServerHistory(nullptr, 0);
+    }
+    std::cout << std::endl << std::endl;
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+}
+
 // Main function to run a comprehensive suite of game server query tests for the dll
 int main() {
     // Prompt for RCON passwords
@@ -88,5 +361,49 @@ int main() {
     // Test 18: Call of Duty with high port number
     RunTest(18, 2, false, "myserver.com", 65535, "getstatus", nullptr);
 
+    // Test 19: Batch query across both protocols, including an invalid entry
+    GameServerQueryRequest batch[] = {
+        { 1, false, "127.0.0.1", 12203, "getstatus", nullptr },
+        { 2, false, "myserver.com", 28960, "getstatus", nullptr },
+        { 2, false, "myserver.com", 28960, "getinfo", nullptr },
+        { 999, false, "127.0.0.1", 28960, "getstatus", nullptr },
+    };
+    RunBatchTest(19, batch, 4, 1000);
+
+    // Test 20: Asynchronous queries with cancellation of the last request
+    RunAsyncTest(20, batch, 4);
+
+    // Test 21: Master-server scan streamed into a getinfo sweep
+    RunScanTest(21, "127.0.0.1", 20510, 6);
+
+    // Test 22: Typed records for a Call of Duty rcon status
+    RunTypedTest(22, 2, "myserver.com", 28960, "rcon status", codRconPassword.c_str());
+
+    // Test 23: Burst of Call of Duty rcon commands paced for sv_floodprotect
+    RunRconQueueTest(23, 2, "myserver.com", 28960, codRconPassword.c_str(), 500);
+
+    // Test 24: Call of Duty map change sent without waiting, confirmed through getstatus
+    RunVerifiedWriteTest(24, 2, "myserver.com", 28960, "map mp_carentan", codRconPassword.c_str());
+
+    // Test 25: Batch targets repeated 50 times and split across 4 worker threads
+    RunListScanTest(25, batch, 4, 50, 4);
+
+    // Test 26: Steady-state allocations for a captured getstatus reply
+    const char* capturedStatus = "\xFF\xFF\xFF\xFFstatusResponse\n\\sv_hostname\\Test Server\\mapname\\mp_harbor\\g_gametype\\tdm\n"
+        "12 48 \"^1Player^7One\"\n3 112 \"Player Two\"\n";
+    RunAllocationTest(26, 2, nullptr, 0, "getstatus", capturedStatus, 1000);
+
+    // Test 27: Steady-state allocations while polling a Call of Duty server
+    RunAllocationTest(27, 2, "myserver.com", 28960, "getstatus", nullptr, 20);
+
+    // Test 28: Call of Duty getstatus limited to a few settings and the player count
+    RunFieldsTest(28, 2, "myserver.com", 28960, "getstatus", nullptr, "sv_hostname,mapname,g_gametype,sv_maxclients,players.count");
+
+    // Test 29: Find a Call of Duty player through the player index
+    RunPlayerIndexTest(29, 2, "myserver.com", 28960);
+
+    // Test 30: Record and read back Call of Duty server history
+    RunHistoryTest(30, 2, "myserver.com", 28960, "history");
+
     return 0;
 }
\ No newline at end of file